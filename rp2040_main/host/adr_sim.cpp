@@ -0,0 +1,169 @@
+/*
+    Host simulation of the adaptive data rate controller against a link trace.
+
+    build: g++ -std=c++17 -O2 -I../include adr_sim.cpp ../include/adr.cpp ../include/airtime.cpp -o adr_sim
+    usage: ./adr_sim [trace.csv]
+
+    A trace is a CSV file with `time_ms,rssi,snr` lines, recorded at 125 kHz bandwidth.
+    Without a trace a synthetic ascent/descent is generated.
+*/
+#include <adr.hpp>
+#include <airtime.hpp>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#define REPORT_BYTES 64 // payload of a report packet, including the Comm header
+#define REPORT_GAP_MS 50 // processing time between two reports
+#define PAD_MS 300000 // countdown on the pad before the launch
+
+struct TracePoint {
+    double t;
+    double rssi;
+    double snr;
+};
+
+// Time on air in ms (explicit header, CRC on, 8 symbol preamble)
+double airtime_ms(const RadioProfile& p, int bytes)
+{
+    LoRaModem modem = {p.sf, p.bw, p.cr, 8, false, true, false};
+    modem.ldro = symbol_time_us(modem) > 16000;
+
+    return time_on_air_us(modem, bytes) / 1000.0;
+}
+
+std::vector<TracePoint> loadTrace(const char* file)
+{
+    std::vector<TracePoint> trace;
+    std::ifstream in(file);
+    std::string line;
+
+    while (std::getline(in, line))
+    {
+        TracePoint p;
+        if (std::sscanf(line.c_str(), "%lf,%lf,%lf", &p.t, &p.rssi, &p.snr) == 3) trace.push_back(p);
+    }
+    return trace;
+}
+
+// countdown on the pad, 1 km ascent in 10 s, then a 5 m/s descent, 10 km from the ground station
+std::vector<TracePoint> syntheticTrace()
+{
+    std::vector<TracePoint> trace;
+    for (double t = -PAD_MS; t < 210000; t += 100)
+    {
+        double h = t < 0 ? 0 : t < 10000 ? t / 10.0 : std::max(0.0, 1000.0 - (t - 10000) / 200.0);
+        double d = std::sqrt(10000.0 * 10000.0 + h * h);
+
+        // free space path loss at 868 MHz, +14 dBm, 30 dB of antenna and body losses, and ground clutter near the pad
+        double rssi = 14 - (20 * std::log10(d / 1000.0) + 91.2) - 30 - (h < 100 ? (100 - h) * 0.15 : 0);
+        double snr = rssi + 123; // noise floor at 125 kHz is about -123 dBm
+
+        trace.push_back({t, rssi, std::min(snr, 10.0)});
+    }
+    return trace;
+}
+
+// nearest point of the trace, traces are assumed to be sorted
+const TracePoint& at(const std::vector<TracePoint>& trace, double t)
+{
+    static size_t i = 0;
+    if (i >= trace.size() || trace[i].t > t) i = 0;
+    while (i + 1 < trace.size() && trace[i + 1].t <= t) i++;
+    return trace[i];
+}
+
+struct Result {
+    double goodput;
+    int sent;
+    int lost;
+    int changes;
+};
+
+/*
+    Runs the whole trace. fixedProfile < 0 means the controller is used
+*/
+Result run(const std::vector<TracePoint>& trace, int fixedProfile, bool verbose)
+{
+    std::mt19937 rng(1234);
+    std::normal_distribution<double> fading(0.0, 1.5);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    AdaptiveRate adr(fixedProfile < 0 ? ADR_DEFAULT_PROFILE : fixedProfile);
+    Result r = {0, 0, 0, 0};
+    double t = trace.front().t;
+    double end = trace.back().t;
+    long delivered = 0;
+
+    while (t < end)
+    {
+        const RadioProfile& p = adrProfiles[adr.getProfile()];
+        const TracePoint& tp = at(trace, t);
+
+        double snr = tp.snr - p.bwDb + fading(rng);
+        double margin = snr - p.snrFloor;
+
+        // packet error rate goes from 0 to 1 within about 2 dB of the floor
+        bool ok = uniform(rng) < 1.0 / (1.0 + std::exp(-3.0 * margin));
+
+        r.sent++;
+        if (ok)
+        {
+            delivered += REPORT_BYTES;
+            adr.addPacket((float) snr);
+            adr.addLoss(1, 0);
+        }
+        else
+        {
+            r.lost++;
+            adr.addLoss(0, 1);
+        }
+
+        t += airtime_ms(p, REPORT_BYTES) + REPORT_GAP_MS;
+
+        if (fixedProfile >= 0) continue;
+
+        int next = adr.decide();
+        if (next >= 0)
+        {
+            // the profile change is announced PROFILE_REPEAT (3) times on the old settings
+            t += 3 * airtime_ms(p, 5);
+            if (verbose) std::printf("%8.1f s  SF%d/%ldk -> SF%d/%ldk  snr %.1f dB\n", t / 1000.0, p.sf, p.bw / 1000, adrProfiles[next].sf, adrProfiles[next].bw / 1000, snr);
+            adr.setProfile(next);
+            r.changes++;
+        }
+    }
+
+    r.goodput = delivered / ((end - trace.front().t) / 1000.0);
+    return r;
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<TracePoint> trace = argc > 1 ? loadTrace(argv[1]) : syntheticTrace();
+    if (trace.size() < 2)
+    {
+        std::cerr << "trace is empty\n";
+        return 1;
+    }
+
+    Result adaptive = run(trace, -1, true);
+
+    std::printf("\n%-12s %10s %8s %8s %8s\n", "profile", "goodput", "sent", "lost", "changes");
+    for (int i = 0; i < ADR_PROFILE_COUNT; i++)
+    {
+        Result r = run(trace, i, false);
+        char name[32];
+        std::snprintf(name, sizeof(name), "SF%d/%ldk", adrProfiles[i].sf, adrProfiles[i].bw / 1000);
+        std::printf("%-12s %8.1f/s %8d %8d %8d\n", name, r.goodput, r.sent, r.lost, r.changes);
+    }
+    std::printf("%-12s %8.1f/s %8d %8d %8d\n", "adaptive", adaptive.goodput, adaptive.sent, adaptive.lost, adaptive.changes);
+
+    return 0;
+}
@@ -0,0 +1,229 @@
+/*
+    Runs the Mahony AHRS over a synthetic flight and measures its tilt error and cost, and checks the packed quaternion.
+    The cycle count on the RP2040 itself is printed by the firmware when built with AHRS_BENCHMARK.
+
+    build: g++ -std=c++17 -O2 -I../include ahrs_bench.cpp ../include/ahrs.cpp -o ahrs_bench
+    usage: ./ahrs_bench
+
+    The flight: 5 s tilted on the pad (used for the gyro bias, like the firmware), 3 s boost at 6 g spinning
+    at 1 rev/s, a tumbling coast and a swinging parachute descent. The gyro has a bias and noise, and the
+    accelerometer noise and vibration during the boost.
+*/
+#include <ahrs.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+#define IMU_RATE 1000
+#define AHRS_DECIMATION 2 // like the firmware
+#define PAD_TIME 5.0
+#define BOOST_TIME 3.0
+#define COAST_TIME 12.0
+#define FLIGHT_TIME 60.0
+
+struct Quat {
+    double w, x, y, z;
+};
+
+Quat multiply(const Quat& a, const Quat& b)
+{
+    return {
+        a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z,
+        a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+        a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+        a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w
+    };
+}
+
+// earth z axis in the sensor frame
+void up_in_sensor(const Quat& q, double* v)
+{
+    v[0] = 2 * (q.x * q.z - q.w * q.y);
+    v[1] = 2 * (q.w * q.x + q.y * q.z);
+    v[2] = q.w * q.w - q.x * q.x - q.y * q.y + q.z * q.z;
+}
+
+// true angular rate in rad/s and vertical acceleration in g (gravity removed) at time t
+void motion(double t, double* rate, double* accel)
+{
+    rate[0] = rate[1] = rate[2] = 0;
+    *accel = 0;
+
+    if (t < PAD_TIME) return;
+    t -= PAD_TIME;
+
+    if (t < BOOST_TIME)
+    {
+        rate[2] = 2 * M_PI;
+        rate[0] = 0.05 * sin(3 * t);
+        *accel = 6;
+    }
+    else if (t < BOOST_TIME + COAST_TIME)
+    {
+        // slow tumble, the accelerometer reads close to 0 g in free fall
+        rate[0] = 1.5 * sin(0.7 * t);
+        rate[1] = 1.0 * cos(0.5 * t);
+        rate[2] = 2 * M_PI * exp(-(t - BOOST_TIME) / 3);
+        *accel = -1;
+    }
+    else
+    {
+        // swinging under the parachute at constant speed
+        rate[0] = 0.8 * sin(2 * t);
+        rate[1] = 0.6 * cos(1.7 * t);
+        rate[2] = 0.3;
+    }
+}
+
+double angle_between(const double* a, const double* b)
+{
+    double dot = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    return acos(std::fmax(-1.0, std::fmin(1.0, dot))) * 180 / M_PI;
+}
+
+int main()
+{
+    std::mt19937 rng(1);
+    std::normal_distribution<double> gauss;
+
+    const double bias[3] = {0.02, -0.015, 0.01};   // rad/s, about 1 dps
+    const double gyroNoise = 0.005;                 // rad/s per sample
+    const double accelNoise = 0.01;                 // g per sample
+    const double vibration = 0.3;                   // g during the boost
+
+    // tilted by 10 degrees around x and 5 around y on the pad
+    Quat truth = multiply(Quat{cos(0.0873), sin(0.0873), 0, 0}, Quat{cos(0.0436), 0, sin(0.0436), 0});
+
+    Mahony ahrs;
+    double gyroBias[3] = {0, 0, 0};
+    double padAccel[3] = {0, 0, 0};
+    int padSamples = 0;
+
+    float gyroSum[3] = {0, 0, 0};
+    float accelSum[3] = {0, 0, 0};
+    int pending = 0;
+
+    double tiltSq = 0, tiltMax = 0;
+    double verticalSq = 0, padAxisSq = 0;
+    int flying = 0;
+    const double dt = 1.0 / IMU_RATE;
+
+    for (int n = 0; n < FLIGHT_TIME * IMU_RATE; n++)
+    {
+        double t = n * dt;
+        double rate[3], vertical;
+        motion(t, rate, &vertical);
+
+        // exact rotation over the step
+        double w = sqrt(rate[0] * rate[0] + rate[1] * rate[1] + rate[2] * rate[2]);
+        if (w > 0)
+        {
+            double s = sin(w * dt / 2) / w;
+            truth = multiply(truth, Quat{cos(w * dt / 2), rate[0] * s, rate[1] * s, rate[2] * s});
+        }
+
+        // measured specific force: vertical acceleration plus gravity, in the sensor frame
+        double up[3];
+        up_in_sensor(truth, up);
+        double shake = t >= PAD_TIME && t < PAD_TIME + BOOST_TIME ? vibration : 0;
+
+        float gyro[3], accel[3];
+        for (int i = 0; i < 3; i++)
+        {
+            gyro[i] = rate[i] + bias[i] + gyroNoise * gauss(rng);
+            accel[i] = (vertical + 1) * up[i] + (accelNoise + shake) * gauss(rng);
+        }
+
+        if (t < PAD_TIME)
+        {
+            for (int i = 0; i < 3; i++)
+            {
+                gyroBias[i] += gyro[i];
+                padAccel[i] += accel[i];
+            }
+            if (++padSamples == PAD_TIME * IMU_RATE)
+            {
+                float a[3];
+                for (int i = 0; i < 3; i++)
+                {
+                    gyroBias[i] /= padSamples;
+                    padAccel[i] /= padSamples;
+                    a[i] = padAccel[i];
+                }
+                ahrs.reset(a);
+            }
+            continue;
+        }
+
+        for (int i = 0; i < 3; i++)
+        {
+            gyroSum[i] += gyro[i] - gyroBias[i];
+            accelSum[i] += accel[i];
+        }
+        if (++pending == AHRS_DECIMATION)
+        {
+            for (int i = 0; i < 3; i++)
+            {
+                gyroSum[i] /= pending;
+                accelSum[i] /= pending;
+            }
+            ahrs.update(gyroSum, accelSum, pending * dt);
+            for (int i = 0; i < 3; i++) gyroSum[i] = accelSum[i] = 0;
+            pending = 0;
+        }
+
+        float q[4];
+        ahrs.getQuaternion(q);
+        Quat estimate = {q[0], q[1], q[2], q[3]};
+        double estimatedUp[3];
+        up_in_sensor(estimate, estimatedUp);
+
+        double tilt = angle_between(up, estimatedUp);
+        tiltSq += tilt * tilt;
+        tiltMax = std::fmax(tiltMax, tilt);
+
+        // vertical acceleration as the altitude filter sees it, against projecting onto the pad axis
+        double padNorm = sqrt(padAccel[0] * padAccel[0] + padAccel[1] * padAccel[1] + padAccel[2] * padAccel[2]);
+        double padAxis = (accel[0] * padAccel[0] + accel[1] * padAccel[1] + accel[2] * padAccel[2]) / padNorm - 1;
+        double fused = ahrs.vertical(accel) - 1;
+        verticalSq += (fused - vertical) * (fused - vertical);
+        padAxisSq += (padAxis - vertical) * (padAxis - vertical);
+        flying++;
+    }
+
+    std::printf("%d samples in flight, %lu updates without accelerometer correction\n", flying, (unsigned long) ahrs.getUncorrected());
+    std::printf("tilt error: RMS %.2f deg, max %.2f deg\n", sqrt(tiltSq / flying), tiltMax);
+    std::printf("vertical acceleration RMS error: AHRS %.3f g, pad axis %.3f g\n", sqrt(verticalSq / flying), sqrt(padAxisSq / flying));
+
+    // packed quaternions, over random rotations
+    double packMax = 0;
+    for (int n = 0; n < 100000; n++)
+    {
+        float q[4], r[4];
+        float norm = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            q[i] = gauss(rng);
+            norm += q[i] * q[i];
+        }
+        for (int i = 0; i < 4; i++) q[i] /= sqrtf(norm);
+
+        unpack_quaternion(pack_quaternion(q), r);
+        double dot = fabs(q[0] * r[0] + q[1] * r[1] + q[2] * r[2] + q[3] * r[3]);
+        packMax = std::fmax(packMax, 2 * acos(std::fmin(1.0, dot)) * 180 / M_PI);
+    }
+    std::printf("packed quaternion: max error %.3f deg\n", packMax);
+
+    // host timing, on the RP2040 the float operations are in software. The cycle count there comes from AHRS_BENCHMARK
+    const int runs = 1000000;
+    const float gyro[3] = {0.1f, -0.2f, 0.3f};
+    const float accel[3] = {0.05f, 0.02f, 0.99f};
+
+    auto start = std::chrono::steady_clock::now();
+    for (int n = 0; n < runs; n++) ahrs.update(gyro, accel, 0.002f);
+    auto end = std::chrono::steady_clock::now();
+
+    std::printf("host ns/update: %.1f\n", std::chrono::duration<double, std::nano>(end - start).count() / runs);
+    return 0;
+}
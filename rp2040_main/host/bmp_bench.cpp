@@ -0,0 +1,105 @@
+/*
+    Checks the integer BMP390 compensation against the double reference, and times both paths.
+    The cycle counts on the RP2040 itself are printed by the firmware when built with BMP_BENCHMARK.
+
+    build: g++ -std=c++17 -O2 -I../include bmp_bench.cpp ../include/bmp390.cpp -o bmp_bench
+    usage: ./bmp_bench
+*/
+#include <bmp390.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+// typical calibration NVM contents, in the layout of BMP3_REG_CALIB_DATA
+const uint8_t calib[21] = {
+    0xA5, 0x6A, 0x6E, 0x49, 0xF6, 0xE5, 0xFA, 0xF1, 0xF3, 0x23, 0x01,
+    0x9C, 0x62, 0x10, 0x77, 0x03, 0xF8, 0x17, 0x2D, 0x15, 0xC4
+};
+
+int main()
+{
+    parse_calib_data(calib);
+
+    // raw values from -40 C to 85 C and 300 hPa to 1250 hPa
+    double maxTemp = 0;
+    double maxPress = 0;
+    int samples = 0;
+
+    for (uint32_t t = 6000000; t < 10000000; t += 20011)
+    {
+        double temp = compensate_temperature(t);
+        int32_t tempInt = compensate_temperature_int(t);
+        if (temp < -40 || temp > 85) continue;
+
+        for (uint32_t p = 3000000; p < 12000000; p += 30011)
+        {
+            double press = compensate_pressure(p);
+            uint32_t pressInt = compensate_pressure_int(p);
+            if (press < 30000 || press > 125000) continue;
+
+            maxTemp = std::fmax(maxTemp, std::fabs(tempInt / 100.0 - temp));
+            maxPress = std::fmax(maxPress, std::fabs(pressInt / 100.0 - press));
+            samples++;
+        }
+    }
+
+    std::printf("%d samples, max error: temperature %.4f C, pressure %.4f Pa\n", samples, maxTemp, maxPress);
+
+    // a FIFO burst: temperature/pressure frames with the other frame types mixed in
+    uint8_t fifo[BMP_FIFO_SIZE];
+    baro_frame raw[BMP_FIFO_MAX_FRAMES];
+    int length = 0;
+    int frames = 0;
+    fifo[length++] = BMP_FIFO_CONFIG_CHANGE;
+    fifo[length++] = 0;
+    while (length + BMP_FIFO_FRAME_SIZE <= BMP_FIFO_SIZE - 4)
+    {
+        uint32_t t = 8400000 + frames / 8;
+        uint32_t p = 7000000 + frames * 37;
+        fifo[length++] = BMP_FIFO_TEMP_PRESS_FRAME;
+        for (int b = 0; b < 3; b++) fifo[length++] = t >> (8 * b);
+        for (int b = 0; b < 3; b++) fifo[length++] = p >> (8 * b);
+        frames++;
+    }
+    fifo[length++] = BMP_FIFO_TIME_FRAME;
+    length += 3;
+
+    int parsed = parse_fifo_frames(fifo, length, raw, BMP_FIFO_MAX_FRAMES);
+    baro_sample batch[BMP_FIFO_MAX_FRAMES];
+    compensate_batch(raw, batch, parsed);
+
+    int mismatches = 0;
+    for (int n = 0; n < parsed; n++)
+    {
+        int32_t t = compensate_temperature_int(raw[n].uncomp_temp);
+        if (batch[n].temperature != t || batch[n].pressure != compensate_pressure_int(raw[n].uncomp_press)) mismatches++;
+    }
+    std::printf("FIFO: %d of %d frames parsed, %d differ from single compensation\n", parsed, frames, mismatches);
+
+    // host timing, with an FPU the double path is faster here. The RP2040 numbers come from BMP_BENCHMARK
+    const int runs = 1000000;
+    volatile double d = 0;
+    volatile uint32_t i = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int n = 0; n < runs; n++)
+    {
+        d = compensate_temperature(8400000 + n % 1000);
+        d = compensate_pressure(7000000 + n % 1000);
+    }
+    auto mid = std::chrono::steady_clock::now();
+    for (int n = 0; n < runs; n++)
+    {
+        i = compensate_temperature_int(8400000 + n % 1000);
+        i = compensate_pressure_int(7000000 + n % 1000);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    std::printf("host ns/sample: double %.1f, integer %.1f\n",
+        std::chrono::duration<double, std::nano>(mid - start).count() / runs,
+        std::chrono::duration<double, std::nano>(end - mid).count() / runs);
+
+    (void) d;
+    (void) i;
+    return 0;
+}
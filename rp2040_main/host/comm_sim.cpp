@@ -0,0 +1,234 @@
+/*
+    Runs Comm end to end over a simulated LoRa channel, and measures throughput, latency and loss recovery.
+
+    build: g++ -std=c++17 -O2 -I../include comm_sim.cpp sim_radio.cpp ../include/airtime.cpp ../include/Print.cpp -o comm_sim
+    usage: ./comm_sim
+*/
+#include <comm.hpp>
+#include "sim_radio.hpp"
+#include <cstdio>
+#include <vector>
+
+#define REPORTS 400
+#define REPORT_GAP_US 20000 // time spent on sensors between two reports
+#define OUTAGE_START 150    // reports sent before the outage of the outage scenarios
+#define OUTAGE_US 5000000
+#define REPORT_SIZE 44      // size of the fields below
+
+SimRadio* satRadio;
+SimRadio* groundRadio;
+Comm* satComm;
+Comm* groundComm;
+SimChannel* channel;
+
+// what the ground station sends, it goes out after the packet it answers, like through lora_receiver.ino
+std::vector<std::vector<uint8_t>> uplink;
+
+int sat_send(uint8_t* data, int size)
+{
+    satRadio->beginPacket();
+    satRadio->write(data, size);
+    int sent = satRadio->endPacket();
+
+    satRadio->receive();
+    return sent ? 0 : -1;
+}
+
+int sat_send_implicit(uint8_t* data, int size)
+{
+    satRadio->beginPacket(true);
+    satRadio->write(data, size);
+    int sent = satRadio->endPacket();
+
+    satRadio->receive();
+    return sent ? 0 : -1;
+}
+
+void sat_receive(int size)
+{
+    uint8_t buff[255];
+    for (int i = 0; i < size; i++) buff[i] = satRadio->read();
+
+    satComm->receiverCallback(buff, size);
+}
+
+int ground_send(uint8_t* data, int size)
+{
+    uplink.emplace_back(data, data + size);
+    return 0;
+}
+
+void ground_flush()
+{
+    std::vector<std::vector<uint8_t>> packets;
+    packets.swap(uplink);
+
+    for (std::vector<uint8_t>& packet : packets)
+    {
+        groundRadio->beginPacket();
+        groundRadio->write(packet.data(), packet.size());
+        groundRadio->endPacket();
+        groundRadio->receive(groundComm->getAnnouncedFrameSize());
+    }
+}
+
+void check_report();
+
+// every report is counted as it arrives, Comm only remembers the newest one
+void ground_receive(int size)
+{
+    uint8_t buff[255];
+    for (int i = 0; i < size; i++) buff[i] = groundRadio->read();
+
+    groundComm->receiverCallback(buff, size);
+    check_report();
+}
+
+void ground_frame_change(int size)
+{
+    groundRadio->receive(size);
+}
+
+struct Scenario {
+    const char* name;
+    SimConditions conditions;
+    bool outage;
+    bool implicit;
+};
+
+struct Stats {
+    int received = 0;
+    double latencySum = 0;
+    uint64_t latencyMax = 0;
+    uint64_t outageEnd = 0;
+    uint64_t recovery = 0; // time between the end of the outage and the first report that arrives after it
+};
+
+Stats stats;
+
+void check_report()
+{
+    if (!groundComm->isUpdated()) return;
+
+    uint64_t now = channel->now();
+    uint64_t latency = now - groundComm->getField<uint64_t>("time");
+
+    stats.received++;
+    stats.latencySum += latency;
+    if (latency > stats.latencyMax) stats.latencyMax = latency;
+    if (stats.outageEnd && !stats.recovery && now > stats.outageEnd) stats.recovery = now - stats.outageEnd;
+}
+
+void run(const Scenario& s)
+{
+    SimChannel ch(s.conditions);
+    SimRadio sat(ch), ground(ch);
+    Comm sComm(sat_send), gComm(ground_send);
+
+    channel = &ch;
+    satRadio = &sat;
+    groundRadio = &ground;
+    satComm = &sComm;
+    groundComm = &gComm;
+    uplink.clear();
+    stats = Stats();
+
+    // no CRC, like the firmware
+    for (SimRadio* r : {&sat, &ground})
+    {
+        r->setSpreadingFactor(9);
+        r->setSignalBandwidth(125E3);
+    }
+
+    sat.onReceive(sat_receive);
+    sat.receive();
+    ground.onReceive(ground_receive);
+    gComm.onFrameChange(ground_frame_change);
+    ground.receive();
+
+    sComm.addField<uint64_t>("time");
+    sComm.addField<uint32_t>("counter");
+    sComm.addField<float>("pressure");
+    sComm.addField<float>("temperature");
+    sComm.addField<std::string>("gps", 24);
+    sComm.sendStructure();
+
+    if (s.implicit) sComm.setImplicitReports(sat_send_implicit);
+
+    uint64_t start = ch.now();
+    uint64_t outageStart = 0;
+    for (uint32_t i = 0; i < REPORTS; i++)
+    {
+        if (s.outage && i == OUTAGE_START)
+        {
+            SimConditions down = s.conditions;
+            down.loss = 1;
+            ch.setConditions(down);
+            outageStart = ch.now();
+        }
+        // a report that started in the outage is lost, so the next one is the first that can arrive
+        if (outageStart && !stats.outageEnd && ch.now() - outageStart > OUTAGE_US)
+        {
+            ch.setConditions(s.conditions);
+            stats.outageEnd = outageStart + OUTAGE_US;
+        }
+
+        sComm.setField("time", ch.now());
+        sComm.setField("counter", i);
+        sComm.setField("pressure", 101325.0f);
+        sComm.setField("temperature", 21.5f);
+        sComm.setField<std::string>("gps", "4729.1234N01903.5678E");
+        sComm.sendReport();
+        ground_flush();
+
+        ch.advance(REPORT_GAP_US);
+    }
+    ch.advance(s.conditions.reorderDelayUs);
+
+    double seconds = (ch.now() - start) / 1e6;
+    std::printf("%-10s %9.1f %9.1f %9.1f %8.1f%% %9.1f %9.1f %10.1f\n",
+        s.name,
+        sat.getAirtime() / 1000.0 / REPORTS,
+        stats.received / seconds,
+        stats.received * (4 + REPORT_SIZE) / seconds,
+        100.0 * (REPORTS - stats.received) / REPORTS,
+        stats.received ? stats.latencySum / stats.received / 1000 : 0,
+        stats.latencyMax / 1000.0,
+        stats.recovery / 1000.0);
+}
+
+int main()
+{
+    SimConditions clear;
+
+    SimConditions lossy;
+    lossy.loss = 0.1;
+
+    SimConditions bursty;
+    bursty.burstStart = 0.05;
+    bursty.burstEnd = 0.3;
+
+    SimConditions reordering;
+    reordering.reorder = 0.05;
+    reordering.reorderDelayUs = 300000;
+
+    SimConditions weak;
+    weak.snr = -9;
+    weak.fading = 2;
+
+    Scenario scenarios[] = {
+        {"clear", clear, false, false},
+        {"implicit", clear, false, true},
+        {"lossy", lossy, false, false},
+        {"bursty", bursty, false, false},
+        {"reorder", reordering, false, false},
+        {"weak", weak, false, false},
+        {"outage", clear, true, false},
+    };
+
+    std::printf("SF9/125k, %d reports of %d bytes\n", REPORTS, REPORT_SIZE);
+    std::printf("%-10s %9s %9s %9s %9s %9s %9s %10s\n", "scenario", "air ms", "reports/s", "bytes/s", "loss", "avg ms", "max ms", "recover ms");
+    for (const Scenario& s : scenarios) run(s);
+
+    return 0;
+}
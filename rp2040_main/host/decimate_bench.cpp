@@ -0,0 +1,94 @@
+/*
+    Measures the frequency response of the CIC + FIR decimation chain, checks the window statistics against a
+    double precision reference, and times both on the host.
+
+    build: g++ -std=c++17 -O2 -I../include decimate_bench.cpp ../include/decimator.cpp -o decimate_bench
+    usage: ./decimate_bench
+
+    Frequencies above the output Nyquist frequency (31.25 Hz with the default chain) should be strongly attenuated,
+    since anything that gets through is aliased into the telemetry.
+*/
+#include <decimator.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#define INPUT_RATE 1000.0
+#define AMPLITUDE 10000.0
+
+// gain of the chain in dB for a sine of the given frequency, from the output amplitude after the filters settled
+double response(double frequency)
+{
+    CicDecimator cic(1);
+    FirDecimator fir(1);
+
+    double sumSq = 0;
+    int outputs = 0;
+    for (int n = 0; n < 20000; n++)
+    {
+        int16_t in = (int16_t) lround(AMPLITUDE * sin(2 * M_PI * frequency * n / INPUT_RATE));
+        int16_t mid, out;
+        if (!cic.push(&in, &mid) || !fir.push(&mid, &out)) continue;
+
+        if (n < 2000) continue;
+        sumSq += (double) out * out;
+        outputs++;
+    }
+
+    double amplitude = sqrt(2 * sumSq / outputs);
+    return 20 * log10(std::fmax(amplitude, 0.5) / AMPLITUDE);
+}
+
+int main()
+{
+    double outputRate = INPUT_RATE / CIC_RATIO / FIR_RATIO;
+    std::printf("chain: %.0f Hz -> %.1f Hz -> %.2f Hz, %d FIR taps\n", INPUT_RATE, INPUT_RATE / CIC_RATIO, outputRate, FIR_TAPS);
+
+    const double frequencies[] = {0.5, 2, 5, 10, 15, 20, 25, 31.25, 35, 40, 50, 62.5, 80, 100, 125, 200, 250, 375, 500};
+    for (double f : frequencies)
+        std::printf("%7.2f Hz %s %7.1f dB\n", f, f > outputRate / 2 ? "(aliased)" : "         ", response(f));
+
+    // statistics of a noisy window, against a two pass computation in double precision
+    std::mt19937 rng(1);
+    std::normal_distribution<double> gauss(3.0, 0.5);
+    std::vector<double> values;
+    WindowStats stats;
+    for (int n = 0; n < 1000; n++)
+    {
+        // an offset much larger than the spread, where a single precision sum of squares falls apart
+        float v = (float) (9.81 * 100 + gauss(rng));
+        values.push_back(v);
+        stats.add(v);
+    }
+
+    double mean = 0;
+    for (double v : values) mean += v;
+    mean /= values.size();
+    double var = 0;
+    for (double v : values) var += (v - mean) * (v - mean);
+    var /= values.size();
+
+    std::printf("stats: mean %.4f (reference %.4f), std %.4f (reference %.4f)\n", stats.getMean(), mean, stats.getStd(), sqrt(var));
+
+    // host timing per 1 kHz input sample, for 6 channels like the firmware
+    const int runs = 1000000;
+    CicDecimator cic(DECIMATOR_CHANNELS);
+    FirDecimator fir(DECIMATOR_CHANNELS);
+    int16_t in[DECIMATOR_CHANNELS] = {100, -200, 16000, 5, -7, 3};
+    int16_t mid[DECIMATOR_CHANNELS], out[DECIMATOR_CHANNELS];
+    volatile int16_t sink = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int n = 0; n < runs; n++)
+    {
+        in[0] = (int16_t) n;
+        if (cic.push(in, mid) && fir.push(mid, out)) sink = out[0];
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    std::printf("host ns/input sample: %.1f\n", std::chrono::duration<double, std::nano>(end - start).count() / runs);
+    (void) sink;
+    return 0;
+}
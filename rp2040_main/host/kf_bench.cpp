@@ -0,0 +1,206 @@
+/*
+    Runs the altitude Kalman filter and the flight phase detector over a recorded or synthetic flight,
+    and measures the error and cost of the filter.
+
+    build: g++ -std=c++17 -O2 -I../include kf_bench.cpp ../include/altitude_kf.cpp ../include/flight_phase.cpp -o kf_bench
+    usage: ./kf_bench [flight.csv]
+
+    A recorded flight is a CSV file with `time_s,pressure_pa,accel_up` lines, one per IMU sample
+    (pressure 0 when there is no barometer sample), with the vertical acceleration in m/s^2, gravity removed.
+    An optional fourth column with a reference altitude (e.g. from GPS) is used to compute the error.
+    Without a file a synthetic flight is generated: 2 s on the pad, 2.5 s boost at 8 g, coast to apogee
+    and a parachute descent at 8 m/s, 15 s on the ground, with sensor noise, an accelerometer bias and a pressure
+    spike at ejection.
+*/
+#include <altitude_kf.hpp>
+#include <flight_phase.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#define IMU_RATE 1000
+#define BARO_RATE 50
+#define BARO_BATCH 5 // frames per drain, like the firmware (BARO_PERIOD_US)
+#define SEA_LEVEL 101325.0f
+#define PHASE_RATE 100 // the phase detector runs in the fusion task, like the firmware (FUSION_PERIOD_US)
+
+struct Sample {
+    double t;
+    float pressure; // Pa, 0 if there is none
+    float accel;    // m/s^2
+    float altitude; // reference, NAN if unknown
+    float velocity; // reference, NAN if unknown
+};
+
+std::vector<Sample> load(const char* path)
+{
+    std::vector<Sample> flight;
+    std::ifstream file(path);
+    std::string line;
+
+    while (std::getline(file, line))
+    {
+        std::stringstream ss(line);
+        Sample s = {0, 0, 0, NAN, NAN};
+        char comma;
+        if (!(ss >> s.t >> comma >> s.pressure >> comma >> s.accel)) continue; // header
+        ss >> comma >> s.altitude;
+        flight.push_back(s);
+    }
+
+    return flight;
+}
+
+float altitude_pressure(float altitude)
+{
+    return SEA_LEVEL * powf(1 - altitude / 44330.0f, 5.255f);
+}
+
+std::vector<Sample> synthesize()
+{
+    std::mt19937 rng(1);
+    std::normal_distribution<float> baroNoise(0, 3.0f); // Pa, about 0.25 m
+    std::normal_distribution<float> accelNoise(0, 0.05f * STANDARD_GRAVITY);
+    const float accelBias = 0.02f * STANDARD_GRAVITY;
+
+    std::vector<Sample> flight;
+    double h = 0, v = 0;
+    bool deployed = false;
+    double ejection = -1;
+    double landing = -1;
+    double touchdown = 0;
+
+    for (int i = 0; ; i++)
+    {
+        double t = (double) i / IMU_RATE;
+        double a;
+
+        if (t < 2) a = 0;
+        // the ground stops the descent within 50 ms
+        else if (landing > 0) a = t - landing < 0.05 ? -touchdown / 0.05 : 0;
+        else if (t < 4.5) a = 8 * STANDARD_GRAVITY;
+        else if (!deployed && v > 0) a = -STANDARD_GRAVITY - 0.002 * v * std::fabs(v);
+        else
+        {
+            if (!deployed) ejection = t;
+            deployed = true;
+            // the parachute pulls the velocity to -8 m/s within about a second
+            a = (-8 - v) * 3;
+        }
+
+        v += a / IMU_RATE;
+        h += v / IMU_RATE;
+        if (landing < 0 && t > 5 && h <= 0)
+        {
+            landing = t;
+            touchdown = v;
+        }
+        if (landing > 0 && t - landing >= 0.05) v = 0;
+        if (landing > 0 && t - landing > 15) break;
+
+        Sample s = {t, 0, (float) a + accelBias + accelNoise(rng), (float) h, (float) v};
+
+        if (i % (IMU_RATE / BARO_RATE) == 0)
+        {
+            s.pressure = altitude_pressure((float) h) + baroNoise(rng);
+            // the ejection charge pressurizes the bay for a moment
+            if (ejection > 0 && t - ejection < 0.1) s.pressure -= 300;
+        }
+
+        flight.push_back(s);
+    }
+
+    return flight;
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<Sample> flight = argc > 1 ? load(argv[1]) : synthesize();
+    if (flight.size() < 2)
+    {
+        std::printf("no samples\n");
+        return 1;
+    }
+
+    AltitudeFilter filter;
+    FlightPhase phase;
+
+    // reference pressure from the first barometer sample
+    float reference = 0;
+    for (const Sample& s : flight) if (s.pressure > 0) { reference = s.pressure; break; }
+
+    // barometer frames are applied in batches, late, like on the board
+    struct Pending { double t; float altitude; };
+    std::vector<Pending> pending;
+
+    double sqAlt = 0, sqVel = 0, sqBaro = 0;
+    int errors = 0;
+    double apogee = -1, trueApogee = -1;
+    float maxAltitude = 0, trueMax = 0;
+
+    for (size_t i = 0; i < flight.size(); i++)
+    {
+        const Sample& s = flight[i];
+        if (i > 0) filter.predict((float) (s.t - flight[i - 1].t));
+        filter.updateAccel(s.accel);
+
+        if (s.pressure > 0) pending.push_back({s.t, pressure_altitude(s.pressure, reference)});
+        if (pending.size() == BARO_BATCH)
+        {
+            for (const Pending& p : pending) filter.updateBaro(p.altitude, (float) (s.t - p.t));
+            pending.clear();
+        }
+
+        if (i % (IMU_RATE / PHASE_RATE) == 0 &&
+            phase.update((uint64_t) (s.t * 1e6), filter.getAltitude(), filter.getVelocity(), filter.getAcceleration()))
+        {
+            std::printf("%8.3f s: %s at %.1f m, %.1f m/s\n", s.t, phase_name(phase.getPhase()), filter.getAltitude(), filter.getVelocity());
+        }
+
+        if (apogee < 0 && s.t > 5 && filter.getVelocity() < 0) apogee = s.t;
+        if (trueApogee < 0 && s.t > 5 && s.velocity < 0) trueApogee = s.t;
+        maxAltitude = std::fmax(maxAltitude, filter.getAltitude());
+        trueMax = std::fmax(trueMax, s.altitude);
+
+        if (!std::isnan(s.altitude))
+        {
+            sqAlt += std::pow(filter.getAltitude() - s.altitude, 2);
+            if (!std::isnan(s.velocity)) sqVel += std::pow(filter.getVelocity() - s.velocity, 2);
+            if (s.pressure > 0) sqBaro += std::pow(pressure_altitude(s.pressure, reference) - s.altitude, 2);
+            errors++;
+        }
+    }
+
+    std::printf("%zu samples, %.1f s, max altitude %.1f m, %u pressure altitudes rejected\n",
+        flight.size(), flight.back().t - flight.front().t, maxAltitude, filter.getRejected());
+
+    if (errors > 0)
+    {
+        std::printf("RMS error: altitude %.2f m (raw pressure altitude %.2f m), velocity %.2f m/s\n",
+            std::sqrt(sqAlt / errors), std::sqrt(sqBaro / (errors / (IMU_RATE / BARO_RATE))), std::sqrt(sqVel / errors));
+        std::printf("apogee: %.1f m at %.3f s, reference %.1f m at %.3f s\n", maxAltitude, apogee, trueMax, trueApogee);
+    }
+
+    // cost of one IMU step (predict + accel update) and one barometer update
+    const int runs = 1000000;
+    auto start = std::chrono::steady_clock::now();
+    for (int n = 0; n < runs; n++)
+    {
+        filter.predict(0.001f);
+        filter.updateAccel((n & 0xFF) * 0.01f);
+    }
+    auto mid = std::chrono::steady_clock::now();
+    for (int n = 0; n < runs; n++) filter.updateBaro(filter.getAltitude() + (n & 0xF) * 0.01f, 0.05f);
+    auto end = std::chrono::steady_clock::now();
+
+    std::printf("host ns: IMU step %.1f, barometer update %.1f\n",
+        std::chrono::duration<double, std::nano>(mid - start).count() / runs,
+        std::chrono::duration<double, std::nano>(end - mid).count() / runs);
+
+    return 0;
+}
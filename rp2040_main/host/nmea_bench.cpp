@@ -0,0 +1,133 @@
+/*
+    Checks the NMEA parser against known sentences, corrupted and cut off ones, and times it per character.
+
+    build: g++ -std=c++17 -O2 -I../include nmea_bench.cpp ../include/nmea.cpp -o nmea_bench
+    usage: ./nmea_bench [log.nmea]
+
+    With a file, every sentence in it is parsed (e.g. a recording of the NEO-6M) and the last fix is printed.
+*/
+#include <nmea.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+int failures = 0;
+
+void check(bool condition, const char* what)
+{
+    if (condition) return;
+    std::printf("FAIL: %s\n", what);
+    failures++;
+}
+
+int feed(NmeaParser& parser, const std::string& text)
+{
+    int updates = 0;
+    for (char c : text) updates += parser.feed(c);
+    return updates;
+}
+
+// adds $, the checksum and the line ending to the body of a sentence
+std::string sentence(const std::string& body)
+{
+    uint8_t checksum = 0;
+    for (char c : body) checksum ^= c;
+
+    char tail[8];
+    std::snprintf(tail, sizeof(tail), "*%02X\r\n", checksum);
+    return "$" + body + tail;
+}
+
+void print_fix(const gps_fix& fix)
+{
+    std::printf("fix: %02lu:%02lu:%06.3f date %06lu, %.7f %.7f, %.1f m, %.2f m/s %.1f deg, quality %d, %d satellites, hdop %.2f, %s\n",
+        (unsigned long) (fix.utc_ms / 3600000), (unsigned long) (fix.utc_ms / 60000 % 60), fix.utc_ms % 60000 / 1000.0,
+        (unsigned long) fix.date, fix.latitude * 1e-7, fix.longitude * 1e-7, fix.altitude, fix.speed, fix.course,
+        fix.quality, fix.satellites, fix.hdop, fix.valid ? "valid" : "invalid");
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1)
+    {
+        FILE* file = std::fopen(argv[1], "rb");
+        if (!file)
+        {
+            std::printf("can't open %s\n", argv[1]);
+            return 1;
+        }
+
+        NmeaParser parser;
+        int c;
+        while ((c = std::fgetc(file)) != EOF) parser.feed((char) c);
+        std::fclose(file);
+
+        std::printf("%lu sentences, %lu errors\n", (unsigned long) parser.getSentences(), (unsigned long) parser.getErrors());
+        print_fix(parser.getFix());
+        return 0;
+    }
+
+    NmeaParser parser;
+
+    // the examples of the NMEA reference, with their published checksums
+    check(feed(parser, "$GPGGA,123519,4807.038,N,01131.000,E,1,08,0.9,545.4,M,46.9,M,,*47\r\n") == 1, "GGA accepted");
+    const gps_fix& fix = parser.getFix();
+    check(fix.utc_ms == 45319000, "GGA time");
+    check(fix.latitude == 481173000, "GGA latitude");
+    check(fix.longitude == 115166666, "GGA longitude");
+    check(fix.quality == 1 && fix.satellites == 8, "GGA quality and satellites");
+    check(std::fabs(fix.hdop - 0.9f) < 1e-4f && std::fabs(fix.altitude - 545.4f) < 1e-3f, "GGA hdop and altitude");
+
+    check(feed(parser, "$GPRMC,123519,A,4807.038,N,01131.000,E,022.4,084.4,230394,003.1,W*6A\r\n") == 1, "RMC accepted");
+    check(fix.valid && fix.date == 230394, "RMC status and date");
+    check(std::fabs(fix.speed - 22.4f * 0.514444f) < 1e-3f && std::fabs(fix.course - 84.4f) < 1e-3f, "RMC speed and course");
+
+    // NEO-6M style, GN talker, southern and western hemisphere, milliseconds
+    check(feed(parser, sentence("GNGGA,235959.250,3351.12345,S,15112.54321,W,2,12,0.75,-12.30,M,20.1,M,,")) == 1, "GN talker accepted");
+    check(fix.utc_ms == 86399250, "time with milliseconds");
+    check(fix.latitude == -338520575 && fix.longitude == -1512090535, "hemispheres");
+    check(std::fabs(fix.altitude + 12.3f) < 1e-3f, "negative altitude");
+
+    // a corrupted sentence doesn't change the fix
+    int32_t latitude = fix.latitude;
+    uint32_t errors = parser.getErrors();
+    check(feed(parser, "$GPGGA,123519,1111.111,N,01131.000,E,1,08,0.9,545.4,M,46.9,M,,*47\r\n") == 0, "wrong checksum rejected");
+    check(fix.latitude == latitude && parser.getErrors() == errors + 1, "fix kept and error counted");
+
+    // cut off by the next sentence
+    check(feed(parser, "$GPGGA,123519,1111.1$GPRMC,123519,A,4807.038,N,01131.000,E,022.4,084.4,230394,003.1,W*6A\r\n") == 1, "cut off sentence skipped");
+    check(fix.latitude == 481173000 && parser.getErrors() == errors + 2, "only the complete one used");
+
+    // no fix yet: empty fields keep the last position
+    check(feed(parser, sentence("GPGGA,000001.00,,,,,0,00,99.99,,,,,,")) == 1, "empty GGA accepted");
+    check(fix.quality == 0 && fix.latitude == 481173000, "empty fields ignored");
+    check(feed(parser, sentence("GPRMC,000001.00,V,,,,,,,,,,N")) == 1 && !fix.valid, "void RMC");
+
+    // other sentences, garbage and a field that is too long
+    check(feed(parser, sentence("GPGSV,3,1,11,03,03,111,00,04,15,270,00,06,01,010,00,13,06,292,00")) == 0, "GSV ignored");
+    check(feed(parser, "\x01\xff garbage,*,\r\n$$$**") == 0, "garbage ignored");
+    check(feed(parser, sentence("GPGGA,123519,4807.0380000000000000000,N,01131.000,E,1,08,0.9,545.4,M,46.9,M,,")) == 0, "too long field rejected");
+
+    std::printf("%s, %lu sentences, %lu errors\n", failures ? "FAILED" : "all checks passed",
+        (unsigned long) parser.getSentences(), (unsigned long) parser.getErrors());
+
+    // host timing per character, one second of NEO-6M output at 1 Hz
+    std::string second = sentence("GPRMC,123519.00,A,4807.03812,N,01131.00012,E,0.004,,230394,,,A") +
+        sentence("GPVTG,,T,,M,0.004,N,0.007,K,A") +
+        sentence("GPGGA,123519.00,4807.03812,N,01131.00012,E,1,08,0.90,545.4,M,46.9,M,,") +
+        sentence("GPGSA,A,3,03,04,06,13,17,19,28,,,,,,1.62,0.90,1.35") +
+        sentence("GPGLL,4807.03812,N,01131.00012,E,123519.00,A,A");
+
+    const int runs = 10000;
+    volatile int updates = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int n = 0; n < runs; n++) updates = updates + feed(parser, second);
+    auto end = std::chrono::steady_clock::now();
+
+    std::printf("host ns/character: %.1f (%zu characters per second of output)\n",
+        std::chrono::duration<double, std::nano>(end - start).count() / runs / second.size(), second.size());
+
+    return failures ? 1 : 0;
+}
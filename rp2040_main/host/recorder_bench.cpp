@@ -0,0 +1,304 @@
+/*
+    Runs the flight recorder (include/recorder.hpp) on a simulated flash with the data rates of the firmware:
+    measures the write throughput and how long the cores are stopped, cuts the power during writes and erases
+    and checks what the recovery finds, and fills the log up.
+
+    build: g++ -std=c++17 -O2 -I../include recorder_bench.cpp sim_flash.cpp ../include/recorder.cpp -o recorder_bench
+    usage: ./recorder_bench
+*/
+#include <recorder.hpp>
+#include "sim_flash.hpp"
+#include <chrono>
+#include <cstdio>
+#include <algorithm>
+#include <cstring>
+#include <random>
+
+#define LOG_SIZE (1532 * 1024)      // the region the firmware uses
+#define SERVICE_PERIOD_MS 20        // recorder task
+#define PAD_MS 30000
+#define FLIGHT_MS 90000
+
+int failures = 0;
+
+void check(bool condition, const char* what)
+{
+    if (condition) return;
+    std::printf("FAIL: %s\n", what);
+    failures++;
+}
+
+/*
+    The records of the firmware: IMU samples at 1 kHz in batches of LOG_IMU_SAMPLES, barometer frames at 50 Hz
+    read every 100 ms. The sample number is in the time and the values, so the log can be checked
+*/
+class Source {
+public:
+    Source(FlightRecorder& recorder) : recorder(recorder) {}
+
+    // one millisecond
+    void step()
+    {
+        uint64_t time = ms * 1000;
+
+        if (pending == 0) std::memcpy(imu, &time, 8);
+        uint8_t* s = imu + 10 + pending * 12;
+        for (int i = 0; i < 6; i++)
+        {
+            int16_t v = (int16_t) (ms * 7 + i);
+            std::memcpy(s + 2 * i, &v, 2);
+        }
+        // the batches fill up the pages
+        int room = (recorder.getRoom() - 10) / 12;
+        if (++pending >= std::min(room > 0 ? room : LOG_IMU_SAMPLES, LOG_IMU_SAMPLES))
+        {
+            uint16_t interval = 1000;
+            std::memcpy(imu + 8, &interval, 2);
+            recorder.append(LOG_IMU, imu, 10 + pending * 12);
+            pending = 0;
+        }
+
+        if (ms % 100 == 99)
+        {
+            uint8_t baro[5 * 16];
+            for (int i = 0; i < 5; i++)
+            {
+                uint64_t t = (ms - 80 + i * 20) * 1000;
+                uint32_t temp = 8400000 + ms, press = 7000000 - ms;
+                std::memcpy(baro + i * 16, &t, 8);
+                std::memcpy(baro + i * 16 + 8, &temp, 4);
+                std::memcpy(baro + i * 16 + 12, &press, 4);
+            }
+            recorder.append(LOG_BARO, baro, sizeof(baro));
+        }
+
+        ms++;
+    }
+
+    uint64_t ms = 0;
+
+private:
+    FlightRecorder& recorder;
+    uint8_t imu[10 + LOG_IMU_SAMPLES * 12];
+    int pending = 0;
+};
+
+struct LogCheck {
+    uint32_t pages = 0;
+    uint32_t broken = 0;        // pages that aren't log pages
+    uint32_t records = 0;
+    uint32_t imuSamples = 0;
+    uint32_t gaps = 0;          // IMU samples missing within a session
+    uint64_t firstMs = UINT64_MAX;
+    uint64_t lastMs = 0;
+    uint16_t sessions = 0;
+};
+
+// reads the log back like the ground station would, and checks the IMU samples for gaps
+LogCheck check_log(FlightRecorder& recorder)
+{
+    LogCheck c;
+    uint16_t session = 0;
+    int64_t expected = -1;
+    log_record records[64];
+
+    for (uint32_t i = 0; i < recorder.getUsed(); i++)
+    {
+        const uint8_t* page = recorder.getPage(i);
+        int n = log_parse_page(page, records, 64);
+        c.pages++;
+        if (n <= 0)
+        {
+            c.broken++;
+            continue;
+        }
+
+        uint16_t s = page[2] | (page[3] << 8);
+        if (s != session)
+        {
+            session = s;
+            c.sessions++;
+            expected = -1;
+        }
+
+        for (int r = 0; r < n; r++)
+        {
+            c.records++;
+            if (records[r].type != LOG_IMU) continue;
+
+            uint64_t time;
+            std::memcpy(&time, records[r].payload, 8);
+            uint64_t first = time / 1000;
+            int samples = (records[r].length - 10) / 12;
+
+            if (expected >= 0 && (int64_t) first != expected) c.gaps++;
+            for (int k = 0; k < samples; k++)
+            {
+                int16_t v;
+                std::memcpy(&v, records[r].payload + 10 + k * 12, 2);
+                if (v != (int16_t) ((first + k) * 7)) c.gaps++;
+            }
+
+            c.imuSamples += samples;
+            c.firstMs = std::min(c.firstMs, first);
+            c.lastMs = std::max(c.lastMs, first + samples - 1);
+            expected = first + samples;
+        }
+    }
+
+    return c;
+}
+
+// the pad, the flight and the recovery of one power cut
+int main()
+{
+    SimFlash flash(LOG_SIZE);
+    FlightRecorder recorder(&flash);
+    check(recorder.begin() == 0 && recorder.getSession() == 1, "empty log");
+
+    // on the pad only the newest pages stay in RAM, nothing is written
+    Source source(recorder);
+    while (source.ms < PAD_MS)
+    {
+        source.step();
+        if (source.ms % SERVICE_PERIOD_MS == 0) recorder.service(true);
+    }
+    check(flash.getPrograms() == 0, "nothing written on the pad");
+
+    // flight
+    recorder.setRecording(true);
+    flash.resetStats();
+    uint32_t maxBatch = 0;
+    while (source.ms < PAD_MS + FLIGHT_MS)
+    {
+        source.step();
+        if (source.ms % SERVICE_PERIOD_MS == 0) maxBatch = std::max(maxBatch, (uint32_t) recorder.service(false));
+    }
+    recorder.flush();
+    recorder.service(false);
+    recorder.setRecording(false);
+
+    LogCheck c = check_log(recorder);
+    double pretrigger = (PAD_MS - c.firstMs) * 1e-3;
+    double seconds = FLIGHT_MS * 1e-3;
+    check(c.broken == 0 && c.gaps == 0, "flight log complete");
+    check(c.lastMs >= PAD_MS + FLIGHT_MS - LOG_IMU_SAMPLES, "flight log up to the last batch");
+    check(pretrigger > 0.5, "pre-trigger pages");
+    check(recorder.getDropped() == 0, "no pages dropped");
+
+    std::printf("flight: %lu pages (%.1f kB/s, %lu records), %.2f s before the launch, log %.0f%% full (%.0f s of flight)\n",
+        (unsigned long) c.pages, c.pages * FLASH_PAGE_BYTES / 1024.0 / (seconds + pretrigger), (unsigned long) c.records,
+        pretrigger, 100.0 * recorder.getUsed() / recorder.getCapacity(),
+        recorder.getCapacity() * (seconds + pretrigger) / c.pages);
+    std::printf("  cores stopped %.2f%% of the time, %lu us at most, up to %lu pages per service call\n",
+        flash.getBusyUs() * 100.0 / (FLIGHT_MS * 1000.0), (unsigned long) flash.getMaxStallUs(), (unsigned long) maxBatch);
+    std::printf("  flash can take %.0f kB/s\n", FLASH_PAGE_BYTES * 1e6 / 1024 / SimFlashTiming().programUs);
+
+    // power cuts during writing: everything before the cut is kept, the next session continues after it
+    std::mt19937 rng(7);
+    uint32_t worstReads = 0;
+    double recoveryUs = 0;
+    int trials = 50;
+    for (int trial = 0; trial < trials; trial++)
+    {
+        SimFlash cut(LOG_SIZE, SimFlashTiming(), trial);
+        FlightRecorder before(&cut);
+        before.begin();
+        before.setRecording(true);
+        cut.cutPowerAfter(std::uniform_int_distribution<int>(1, 3000)(rng));
+
+        Source s(before);
+        while (cut.isPowered())
+        {
+            s.step();
+            if (s.ms % SERVICE_PERIOD_MS == 0) before.service(false);
+        }
+        // the page the power was cut during counts as well, unless nothing of it made it
+        uint32_t written = cut.getPrograms();
+
+        cut.powerOn();
+        cut.resetStats();
+        FlightRecorder after(&cut);
+        auto start = std::chrono::steady_clock::now();
+        uint32_t used = after.begin();
+        recoveryUs += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        worstReads = std::max(worstReads, (uint32_t) cut.getReads());
+
+        LogCheck lost = check_log(after);
+        check((used == written || used == written - 1) && after.getSession() == 2, "recovery finds the end of the log");
+        check(lost.broken <= 1 && lost.gaps == 0, "only the page being written is lost");
+
+        Source again(after);
+        again.ms = s.ms;
+        after.setRecording(true);
+        for (int i = 0; i < 2000; i++)
+        {
+            again.step();
+            if (again.ms % SERVICE_PERIOD_MS == 0) after.service(false);
+        }
+        LogCheck resumed = check_log(after);
+        check(resumed.sessions == 2 && resumed.imuSamples > lost.imuSamples && resumed.gaps == 0, "log continues after the cut");
+    }
+    std::printf("power cuts: %d, recovery reads at most %lu pages, %.1f us on the host\n",
+        trials, (unsigned long) worstReads, recoveryUs / trials);
+
+    // clearing: one sector per call, a cut leaves a shorter log that is still valid
+    uint32_t used = recorder.getUsed();
+    recorder.clear();
+    flash.resetStats();
+    flash.cutPowerAfter(used / FLASH_PAGES_PER_SECTOR / 2);
+    int calls = 0;
+    while (recorder.isClearing() && flash.isPowered())
+    {
+        recorder.service(true);
+        calls++;
+    }
+    flash.powerOn();
+    FlightRecorder cleared(&flash);
+    uint32_t left = cleared.begin();
+    LogCheck half = check_log(cleared);
+    check(left > 0 && left < used && half.broken <= FLASH_PAGES_PER_SECTOR && half.gaps == 0, "log valid after a cut during the clear");
+    for (uint32_t p = left; p < cleared.getCapacity(); p += 97) check(cleared.getPage(p)[0] == 0xFF, "blank after the log");
+
+    cleared.clear();
+    check(!cleared.service(false) && cleared.isClearing(), "no erase when not allowed");
+    while (cleared.isClearing())
+    {
+        cleared.service(true);
+        calls++;
+    }
+    check(cleared.getUsed() == 0, "log cleared");
+    std::printf("clear: %d calls, %.1f s of erasing, %lu us per call, sector erased %lu times at most\n",
+        calls, flash.getBusyUs() * 1e-6, (unsigned long) SimFlashTiming().eraseUs, (unsigned long) flash.getMaxWear());
+
+    // a full log stops, and counts what it loses
+    cleared.setRecording(true);
+    Source fill(cleared);
+    uint64_t fullMs = 0;
+    while (fullMs == 0 || fill.ms < fullMs + 1000)
+    {
+        fill.step();
+        if (fill.ms % SERVICE_PERIOD_MS == 0) cleared.service(false);
+        if (fullMs == 0 && cleared.getUsed() == cleared.getCapacity()) fullMs = fill.ms;
+    }
+    check(cleared.getDropped() > 0, "full log drops pages");
+    std::printf("full log: %lu pages after %.0f s, %lu pages dropped in the second after\n", (unsigned long) cleared.getUsed(), fullMs * 1e-3,
+        (unsigned long) cleared.getDropped());
+
+    // cost of a record on the host
+    SimFlash spare(64 * 1024);
+    FlightRecorder timing(&spare);
+    uint8_t payload[10 + LOG_IMU_SAMPLES * 12] = {0};
+    const int runs = 200000;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < runs; i++)
+    {
+        timing.append(LOG_IMU, payload, sizeof(payload));
+        if (i % 16 == 0) timing.service(false);
+    }
+    auto end = std::chrono::steady_clock::now();
+    std::printf("host ns/IMU record: %.1f\n", std::chrono::duration<double, std::nano>(end - start).count() / runs);
+
+    std::printf("%s\n", failures ? "FAILED" : "all checks passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,116 @@
+#include "sim_flash.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+SimFlash::SimFlash(uint32_t size, SimFlashTiming timing, uint32_t seed)
+    : memory(size, 0xFF), wear(size / FLASH_SECTOR_BYTES, 0), timing(timing), rng(seed)
+{
+    assert(size % FLASH_SECTOR_BYTES == 0);
+}
+
+uint32_t SimFlash::size()
+{
+    return memory.size();
+}
+
+const uint8_t* SimFlash::read(uint32_t address)
+{
+    assert(address < memory.size());
+    reads++;
+    return memory.data() + address;
+}
+
+// false if the power goes off during this operation
+bool SimFlash::operate()
+{
+    if (untilCut > 0 && --untilCut == 0)
+    {
+        powered = false;
+        untilCut = -1;
+        return false;
+    }
+    return true;
+}
+
+void SimFlash::program(uint32_t address, const uint8_t* page)
+{
+    assert(address % FLASH_PAGE_BYTES == 0 && address < memory.size());
+    if (!powered) return;
+    bool complete = operate();
+
+    // cut off: only a part of the page made it, the last byte of it maybe with only some of its bits
+    int bytes = complete ? FLASH_PAGE_BYTES : std::uniform_int_distribution<int>(0, FLASH_PAGE_BYTES - 1)(rng);
+    for (int i = 0; i < bytes; i++) memory[address + i] &= page[i];
+    if (!complete) memory[address + bytes] &= page[bytes] | (uint8_t) rng();
+
+    programs++;
+    busyUs += timing.programUs;
+    maxStallUs = std::max(maxStallUs, timing.programUs);
+}
+
+void SimFlash::erase(uint32_t address)
+{
+    assert(address % FLASH_SECTOR_BYTES == 0 && address < memory.size());
+    if (!powered) return;
+    bool complete = operate();
+
+    // cut off: some bits are erased already, the others not yet
+    for (int i = 0; i < FLASH_SECTOR_BYTES; i++) memory[address + i] |= complete ? 0xFF : (uint8_t) rng();
+
+    erases++;
+    wear[address / FLASH_SECTOR_BYTES]++;
+    busyUs += timing.eraseUs;
+    maxStallUs = std::max(maxStallUs, timing.eraseUs);
+}
+
+void SimFlash::cutPowerAfter(int operations)
+{
+    untilCut = operations;
+}
+
+bool SimFlash::isPowered()
+{
+    return powered;
+}
+
+void SimFlash::powerOn()
+{
+    powered = true;
+}
+
+uint64_t SimFlash::getReads()
+{
+    return reads;
+}
+
+uint64_t SimFlash::getPrograms()
+{
+    return programs;
+}
+
+uint64_t SimFlash::getErases()
+{
+    return erases;
+}
+
+uint64_t SimFlash::getBusyUs()
+{
+    return busyUs;
+}
+
+uint32_t SimFlash::getMaxStallUs()
+{
+    return maxStallUs;
+}
+
+uint32_t SimFlash::getMaxWear()
+{
+    return *std::max_element(wear.begin(), wear.end());
+}
+
+void SimFlash::resetStats()
+{
+    reads = programs = erases = busyUs = 0;
+    maxStallUs = 0;
+}
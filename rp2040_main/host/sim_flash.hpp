@@ -0,0 +1,66 @@
+#pragma once
+
+#include <flash.hpp>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+/*
+    Timing of a simulated flash, typical values of the W25Q16JV on the Pico
+*/
+struct SimFlashTiming {
+    uint32_t programUs = 400;   // one page
+    uint32_t eraseUs = 45000;   // one sector
+};
+
+/*
+    Simulated NOR flash: programming can only clear bits, erasing sets a whole sector to 0xFF.
+    It keeps the time spent busy, which is the time both cores of the RP2040 would be stopped, and the wear.
+    The power can be cut after a number of operations: the operation it hits is left half done, and the
+    flash ignores everything after it until `powerOn()`, which keeps the contents, like a reset
+*/
+class SimFlash : public FlashMemory {
+public:
+    SimFlash(uint32_t size, SimFlashTiming timing = SimFlashTiming(), uint32_t seed = 1);
+
+    uint32_t size() override;
+    const uint8_t* read(uint32_t address) override;
+    void program(uint32_t address, const uint8_t* page) override;
+    void erase(uint32_t address) override;
+
+    /* cuts the power during the `operations`th program or erase from now */
+    void cutPowerAfter(int operations);
+    bool isPowered();
+    void powerOn();
+
+    /* number of reads, page programs and sector erases, and the time spent on them, in microseconds */
+    uint64_t getReads();
+    uint64_t getPrograms();
+    uint64_t getErases();
+    uint64_t getBusyUs();
+
+    /* longest program or erase, in microseconds */
+    uint32_t getMaxStallUs();
+
+    /* highest number of erases of a single sector */
+    uint32_t getMaxWear();
+
+    void resetStats();
+
+private:
+    bool operate();
+
+    std::vector<uint8_t> memory;
+    std::vector<uint32_t> wear;
+    SimFlashTiming timing;
+    std::mt19937 rng;
+
+    int untilCut = -1;
+    bool powered = true;
+
+    uint64_t reads = 0;
+    uint64_t programs = 0;
+    uint64_t erases = 0;
+    uint64_t busyUs = 0;
+    uint32_t maxStallUs = 0;
+};
@@ -0,0 +1,327 @@
+#include "sim_radio.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+// demodulation floor of the SX127x (datasheet table 13), in dB
+static double snr_floor(int sf)
+{
+    return sf == 6 ? -5.0 : -7.5 - 2.5 * (sf - 7);
+}
+
+SimChannel::SimChannel(SimConditions conditions, uint32_t seed) : conditions(conditions), rng(seed) {}
+
+void SimChannel::setConditions(SimConditions conditions)
+{
+    this->conditions = conditions;
+}
+
+uint64_t SimChannel::now()
+{
+    return clock;
+}
+
+int SimChannel::getSent()
+{
+    return sent;
+}
+
+int SimChannel::getDelivered()
+{
+    return delivered;
+}
+
+int SimChannel::getLost()
+{
+    return lost;
+}
+
+void SimChannel::attach(SimRadio* radio)
+{
+    radios.push_back(radio);
+}
+
+void SimChannel::transmit(SimRadio* from, const LoRaModem& modem, const std::vector<uint8_t>& data)
+{
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    // Gilbert-Elliott model: every packet is lost while in a burst
+    bool isLost = burst || uniform(rng) < conditions.loss;
+    burst = burst ? uniform(rng) >= conditions.burstEnd : uniform(rng) < conditions.burstStart;
+
+    uint64_t arrival = clock + time_on_air_us(modem, data.size());
+    if (uniform(rng) < conditions.reorder) arrival += conditions.reorderDelayUs;
+
+    inFlight.push_back({clock, arrival, from, modem, data, isLost});
+    sent++;
+}
+
+void SimChannel::deliver(InFlight& packet)
+{
+    if (packet.lost)
+    {
+        lost++;
+        return;
+    }
+
+    std::normal_distribution<double> fading(0.0, conditions.fading);
+    bool received = false;
+
+    for (SimRadio* radio : radios)
+    {
+        if (radio == packet.from || !radio->listensTo(packet.modem, packet.data.size())) continue;
+
+        // the noise floor rises with the bandwidth
+        double snr = conditions.snr - 10 * std::log10(packet.modem.bw / 125000.0) + fading(rng);
+        if (snr < snr_floor(packet.modem.sf)) continue;
+
+        SimRadio::Packet p;
+        p.data = packet.data;
+        p.snr = std::round(snr * 4) / 4; // the radio reports the SNR in 0.25 dB steps
+        p.rssi = (int) std::round(conditions.rssi + fading(rng));
+
+        radio->arrive(p);
+        received = true;
+    }
+
+    if (received) delivered++;
+    else lost++;
+}
+
+bool SimChannel::busy(const LoRaModem& modem)
+{
+    // CAD only detects preambles with the same spreading factor and bandwidth
+    for (const InFlight& p : inFlight)
+    {
+        if (p.start <= clock && clock < p.arrival && p.modem.sf == modem.sf && p.modem.bw == modem.bw) return true;
+    }
+    return false;
+}
+
+void SimChannel::advance(uint64_t us)
+{
+    uint64_t target = clock + us;
+
+    for (;;)
+    {
+        // earliest packet that arrives before the target
+        auto next = std::min_element(inFlight.begin(), inFlight.end(), [](const InFlight& a, const InFlight& b) { return a.arrival < b.arrival; });
+        if (next == inFlight.end() || next->arrival > target) break;
+
+        // removed before delivering, because the receiver may transmit from its callback
+        InFlight packet = *next;
+        inFlight.erase(next);
+
+        clock = std::max(clock, packet.arrival);
+        deliver(packet);
+    }
+
+    clock = std::max(clock, target);
+}
+
+SimRadio::SimRadio(SimChannel& channel) : channel(channel)
+{
+    channel.attach(this);
+}
+
+int SimRadio::beginPacket(int implicitHeader)
+{
+    if (mode == TX) return 0;
+
+    mode = STANDBY;
+    modem.implicitHeader = implicitHeader;
+    txBuffer.clear();
+
+    return 1;
+}
+
+int SimRadio::endPacket(bool async)
+{
+    mode = TX;
+    uint32_t toa = time_on_air_us(modem, txBuffer.size());
+
+    channel.transmit(this, modem, txBuffer);
+    airtime += toa;
+
+    // the transmitter is busy for the whole time on air
+    channel.advance(toa);
+    mode = STANDBY;
+
+    if (async && _onTxDone) _onTxDone();
+
+    return 1;
+}
+
+int SimRadio::parsePacket(int size)
+{
+    rxSize = size;
+    modem.implicitHeader = size > 0;
+
+    if (!pending.empty())
+    {
+        current = pending.front();
+        pending.pop_front();
+        index = 0;
+        mode = STANDBY;
+
+        return current.data.size();
+    }
+
+    if (mode != RX_SINGLE) mode = RX_SINGLE;
+    return 0;
+}
+
+int SimRadio::packetRssi()
+{
+    return current.rssi;
+}
+
+float SimRadio::packetSnr()
+{
+    return current.snr;
+}
+
+size_t SimRadio::write(uint8_t byte)
+{
+    return write(&byte, 1);
+}
+
+size_t SimRadio::write(const uint8_t *buffer, size_t size)
+{
+    size = std::min(size, MAX_PKT_LENGTH - txBuffer.size());
+    txBuffer.insert(txBuffer.end(), buffer, buffer + size);
+
+    return size;
+}
+
+int SimRadio::available()
+{
+    return current.data.size() - index;
+}
+
+int SimRadio::read()
+{
+    if (!available()) return -1;
+    return current.data[index++];
+}
+
+int SimRadio::peek()
+{
+    if (!available()) return -1;
+    return current.data[index];
+}
+
+void SimRadio::onReceive(void (*callback)(int))
+{
+    _onReceive = callback;
+}
+
+void SimRadio::onTxDone(void (*callback)())
+{
+    _onTxDone = callback;
+}
+
+void SimRadio::receive(int size)
+{
+    rxSize = size;
+    modem.implicitHeader = size > 0;
+    mode = RX_CONTINUOUS;
+}
+
+bool SimRadio::isChannelBusy()
+{
+    // a CAD takes about 2 symbols
+    channel.advance(2 * symbol_time_us(modem));
+    return channel.busy(modem);
+}
+
+void SimRadio::idle()
+{
+    mode = STANDBY;
+}
+
+void SimRadio::sleep()
+{
+    mode = SLEEP;
+}
+
+void SimRadio::setSpreadingFactor(int sf)
+{
+    modem.sf = std::clamp(sf, 6, 12);
+    modem.ldro = symbol_time_us(modem) > 16000;
+}
+
+void SimRadio::setSignalBandwidth(long sbw)
+{
+    static const long bandwidths[] = {7800, 10400, 15600, 20800, 31250, 41700, 62500, 125000, 250000, 500000};
+
+    // same rounding as the real radio: the smallest bandwidth that is at least sbw
+    modem.bw = 500000;
+    for (long bw : bandwidths)
+    {
+        if (sbw <= bw)
+        {
+            modem.bw = bw;
+            break;
+        }
+    }
+    modem.ldro = symbol_time_us(modem) > 16000;
+}
+
+void SimRadio::setCodingRate4(int denominator)
+{
+    modem.cr = std::clamp(denominator, 5, 8);
+}
+
+void SimRadio::setPreambleLength(long length)
+{
+    modem.preamble = length;
+}
+
+void SimRadio::enableCrc()
+{
+    modem.crc = true;
+}
+
+void SimRadio::disableCrc()
+{
+    modem.crc = false;
+}
+
+LoRaModem SimRadio::getModem()
+{
+    return modem;
+}
+
+uint64_t SimRadio::getAirtime()
+{
+    return airtime;
+}
+
+bool SimRadio::listensTo(const LoRaModem& m, int size)
+{
+    if (mode != RX_SINGLE && mode != RX_CONTINUOUS) return false;
+    if (m.sf != modem.sf || m.bw != modem.bw) return false;
+
+    // without a header the receiver has to know the length, coding rate and CRC of the packet
+    if (m.implicitHeader != modem.implicitHeader) return false;
+    if (m.implicitHeader) return size == rxSize && m.cr == modem.cr && m.crc == modem.crc;
+
+    return true;
+}
+
+void SimRadio::arrive(const Packet& packet)
+{
+    if (mode == RX_CONTINUOUS && _onReceive)
+    {
+        current = packet;
+        index = 0;
+        _onReceive(packet.data.size());
+        return;
+    }
+
+    pending.push_back(packet);
+
+    // single receive mode stops after a packet
+    if (mode == RX_SINGLE) mode = STANDBY;
+}
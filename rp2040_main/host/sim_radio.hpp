@@ -0,0 +1,145 @@
+#pragma once
+
+#include <radio.hpp>
+#include <cstdint>
+#include <deque>
+#include <random>
+#include <vector>
+
+/*
+    Conditions of a simulated LoRa channel
+*/
+struct SimConditions {
+    double loss = 0;                    // probability that a packet is lost, independent of the others
+    double burstStart = 0;              // probability that a burst of errors starts after a packet
+    double burstEnd = 0.5;              // probability that a burst ends after a packet
+    double reorder = 0;                 // probability that a packet is delayed, so it arrives after later ones
+    uint32_t reorderDelayUs = 500000;   // how much a reordered packet is delayed
+    double snr = 10;                    // SNR at 125 kHz bandwidth, in dB
+    double rssi = -100;                 // in dBm
+    double fading = 1;                  // standard deviation of the SNR and RSSI, in dB
+};
+
+class SimRadio;
+
+/*
+    A shared channel with a virtual clock. Packets take their exact time on air, and are only received
+    by radios that listen with the same modem settings, and above the demodulation floor of the spreading factor
+*/
+class SimChannel {
+public:
+    SimChannel(SimConditions conditions = SimConditions(), uint32_t seed = 1);
+
+    void setConditions(SimConditions conditions);
+
+    /* current time of the virtual clock in microseconds */
+    uint64_t now();
+
+    /* moves the clock forward, delivering packets that arrive in the meantime */
+    void advance(uint64_t us);
+
+    /* number of packets transmitted, delivered to at least one radio, and lost */
+    int getSent();
+    int getDelivered();
+    int getLost();
+
+private:
+    friend class SimRadio;
+
+    struct InFlight {
+        uint64_t start;
+        uint64_t arrival;
+        SimRadio* from;
+        LoRaModem modem;
+        std::vector<uint8_t> data;
+        bool lost;
+    };
+
+    void attach(SimRadio* radio);
+    void transmit(SimRadio* from, const LoRaModem& modem, const std::vector<uint8_t>& data);
+    void deliver(InFlight& packet);
+    bool busy(const LoRaModem& modem);
+
+    SimConditions conditions;
+    std::mt19937 rng;
+    uint64_t clock = 0;
+    bool burst = false;
+
+    std::vector<SimRadio*> radios;
+    std::vector<InFlight> inFlight;
+
+    int sent = 0;
+    int delivered = 0;
+    int lost = 0;
+};
+
+/*
+    Simulated SX127x, connected to a `SimChannel`
+*/
+class SimRadio : public Radio {
+public:
+    SimRadio(SimChannel& channel);
+
+    int beginPacket(int implicitHeader = false);
+    int endPacket(bool async = false);
+
+    int parsePacket(int size = 0);
+    int packetRssi();
+    float packetSnr();
+
+    virtual size_t write(uint8_t byte);
+    virtual size_t write(const uint8_t *buffer, size_t size);
+
+    int available();
+    int read();
+    int peek();
+
+    void onReceive(void (*callback)(int));
+    void onTxDone(void (*callback)());
+
+    void receive(int size = 0);
+    bool isChannelBusy();
+    void idle();
+    void sleep();
+
+    void setSpreadingFactor(int sf);
+    void setSignalBandwidth(long sbw);
+    void setCodingRate4(int denominator);
+    void setPreambleLength(long length);
+    void enableCrc();
+    void disableCrc();
+
+    LoRaModem getModem();
+
+    /* total time spent transmitting, in microseconds */
+    uint64_t getAirtime();
+
+private:
+    friend class SimChannel;
+
+    enum Mode { SLEEP, STANDBY, TX, RX_SINGLE, RX_CONTINUOUS };
+
+    struct Packet {
+        std::vector<uint8_t> data;
+        int rssi;
+        float snr;
+    };
+
+    void arrive(const Packet& packet);
+    bool listensTo(const LoRaModem& modem, int size);
+
+    SimChannel& channel;
+    LoRaModem modem = {7, 125000, 5, 8, false, false, false};
+    Mode mode = STANDBY;
+    int rxSize = 0; // payload length when receiving with an implicit header
+
+    std::vector<uint8_t> txBuffer;
+    std::deque<Packet> pending;
+    Packet current;
+    size_t index = 0;
+
+    uint64_t airtime = 0;
+
+    void (*_onReceive)(int) = nullptr;
+    void (*_onTxDone)() = nullptr;
+};
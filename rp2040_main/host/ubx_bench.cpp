@@ -0,0 +1,168 @@
+/*
+    Checks the UBX parser with generated navigation messages, acknowledgements and corrupted frames,
+    compares the UART load of UBX and NMEA, and times the parser per byte.
+
+    build: g++ -std=c++17 -O2 -I../include ubx_bench.cpp ../include/ubx.cpp -o ubx_bench
+    usage: ./ubx_bench
+*/
+#include <ubx.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+int failures = 0;
+
+void check(bool condition, const char* what)
+{
+    if (condition) return;
+    std::printf("FAIL: %s\n", what);
+    failures++;
+}
+
+void put16(uint8_t* p, uint16_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+
+void put32(uint8_t* p, uint32_t v)
+{
+    for (int i = 0; i < 4; i++) p[i] = (v >> (8 * i)) & 0xFF;
+}
+
+std::vector<uint8_t> frame(uint8_t cls, uint8_t id, const uint8_t* payload, int length)
+{
+    std::vector<uint8_t> out(length + UBX_OVERHEAD);
+    ubx_frame(cls, id, payload, length, out.data());
+    return out;
+}
+
+int feed(UbxParser& parser, const std::vector<uint8_t>& bytes)
+{
+    int updates = 0;
+    for (uint8_t b : bytes) updates += parser.feed(b);
+    return updates;
+}
+
+// one navigation solution, as the receiver sends it
+std::vector<uint8_t> epoch(uint32_t iTow, bool withTime)
+{
+    std::vector<uint8_t> out;
+    uint8_t p[52] = {0};
+
+    put32(p, iTow);
+    put32(p + 4, (uint32_t) 115166666);     // lon
+    put32(p + 8, (uint32_t) -338520575);    // lat
+    put32(p + 12, 592300);                  // height above ellipsoid, mm
+    put32(p + 16, 545400);                  // hMSL, mm
+    auto f = frame(UBX_CLASS_NAV, UBX_NAV_POSLLH, p, 28);
+    out.insert(out.end(), f.begin(), f.end());
+
+    uint8_t v[36] = {0};
+    put32(v, iTow);
+    put32(v + 12, (uint32_t) 812);          // velD, cm/s
+    put32(v + 20, 1152);                    // gSpeed, cm/s
+    put32(v + 24, 8440000);                 // heading, 1e-5 deg
+    f = frame(UBX_CLASS_NAV, UBX_NAV_VELNED, v, 36);
+    out.insert(out.end(), f.begin(), f.end());
+
+    uint8_t s[52] = {0};
+    put32(s, iTow);
+    s[10] = 3;                              // 3D fix
+    s[11] = 0x0D;                           // gpsFixOK, week and time of week valid
+    put16(s + 44, 162);                     // pDOP 1.62
+    s[47] = 9;
+    f = frame(UBX_CLASS_NAV, UBX_NAV_SOL, s, 52);
+    out.insert(out.end(), f.begin(), f.end());
+
+    if (withTime)
+    {
+        // 2024-03-23 12:35:01.000 UTC, 18 leap seconds behind GPS time
+        uint8_t t[20] = {0};
+        put32(t, iTow);
+        put16(t + 12, 2024);
+        t[14] = 3;
+        t[15] = 23;
+        t[16] = 12;
+        t[17] = 35;
+        t[18] = 1;
+        t[19] = 0x07;
+        f = frame(UBX_CLASS_NAV, UBX_NAV_TIMEUTC, t, 20);
+        out.insert(out.end(), f.begin(), f.end());
+    }
+
+    return out;
+}
+
+int main()
+{
+    UbxParser parser;
+    const gps_fix& fix = parser.getFix();
+
+    // Saturday 12:35:19 GPS time
+    uint32_t iTow = 6 * 86400000u + (12 * 3600 + 35 * 60 + 19) * 1000u;
+
+    check(feed(parser, epoch(iTow, true)) == 4, "epoch accepted");
+    check(fix.latitude == -338520575 && fix.longitude == 115166666, "position");
+    check(std::fabs(fix.altitude - 545.4f) < 1e-3f, "altitude");
+    check(std::fabs(fix.speed - 11.52f) < 1e-4f && std::fabs(fix.course - 84.4f) < 1e-3f, "velocity");
+    check(fix.quality == 1 && fix.valid && fix.satellites == 9 && std::fabs(fix.hdop - 1.62f) < 1e-4f, "solution");
+    check(fix.date == 230324 && fix.utc_ms == (12 * 3600 + 35 * 60 + 1) * 1000u, "UTC time and date");
+
+    // the next epoch has no NAV-TIMEUTC, its UTC time comes from the learned offset
+    check(feed(parser, epoch(iTow + 200, false)) == 3, "epoch without time accepted");
+    check(fix.utc_ms == (12 * 3600 + 35 * 60 + 1) * 1000u + 200, "UTC time from the offset");
+
+    // acknowledgements
+    uint8_t acked[2] = {UBX_CLASS_CFG, UBX_CFG_RATE};
+    parser.clearAck();
+    check(parser.getAck(UBX_CLASS_CFG, UBX_CFG_RATE) == -1, "no answer yet");
+    feed(parser, frame(UBX_CLASS_ACK, UBX_ACK_ACK, acked, 2));
+    check(parser.getAck(UBX_CLASS_CFG, UBX_CFG_RATE) == 1, "ACK-ACK");
+    check(parser.getAck(UBX_CLASS_CFG, UBX_CFG_MSG) == -1, "ACK of another message");
+    feed(parser, frame(UBX_CLASS_ACK, UBX_ACK_NAK, acked, 2));
+    check(parser.getAck(UBX_CLASS_CFG, UBX_CFG_RATE) == 0, "ACK-NAK");
+
+    // a flipped bit, garbage, NMEA in between and a message longer than the buffer
+    std::vector<uint8_t> corrupted = epoch(iTow + 400, false);
+    corrupted[10] ^= 0x01;
+    uint32_t errors = parser.getErrors();
+    check(feed(parser, corrupted) == 2 && parser.getErrors() == errors + 1, "corrupted message rejected");
+
+    std::vector<uint8_t> noise = {0xB5, 0xB5, 0x62, 0x01};
+    const char* nmea = "$GPGGA,123519,4807.038,N,01131.000,E,1,08,0.9,545.4,M,46.9,M,,*47\r\n";
+    for (const char* c = nmea; *c; c++) noise.push_back(*c);
+    check(feed(parser, noise) == 0, "noise ignored");
+
+    uint8_t large[100] = {0};
+    feed(parser, frame(UBX_CLASS_NAV, 0x30, large, sizeof(large)));
+    check(feed(parser, epoch(iTow + 600, false)) == 3, "in sync after a long message");
+
+    std::printf("%s, %lu messages, %lu errors\n", failures ? "FAILED" : "all checks passed",
+        (unsigned long) parser.getMessages(), (unsigned long) parser.getErrors());
+
+    // UART load: UBX at 5 Hz against the default NMEA output at 1 Hz, 10 bits per byte
+    size_t ubxSecond = epoch(iTow, false).size() * 5 + epoch(iTow, true).size() - epoch(iTow, false).size();
+    size_t nmeaSecond = 286; // RMC, VTG, GGA, GSA, GLL, see host/nmea_bench.cpp (the GSV sentences come on top)
+    std::printf("UART load: UBX 5 Hz %zu bytes/s (%.0f%% of %d baud), NMEA 1 Hz %zu bytes/s (%.0f%% of %d baud)\n",
+        ubxSecond, ubxSecond * 1000.0 / 38400, 38400, nmeaSecond, nmeaSecond * 1000.0 / 9600, 9600);
+
+    // host timing per byte
+    std::vector<uint8_t> second;
+    for (int i = 0; i < 5; i++)
+    {
+        std::vector<uint8_t> e = epoch(iTow + i * 200, i == 0);
+        second.insert(second.end(), e.begin(), e.end());
+    }
+
+    const int runs = 10000;
+    volatile int updates = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int n = 0; n < runs; n++) updates = updates + feed(parser, second);
+    auto end = std::chrono::steady_clock::now();
+
+    std::printf("host ns/byte: %.1f\n", std::chrono::duration<double, std::nano>(end - start).count() / runs / second.size());
+
+    return failures ? 1 : 0;
+}
@@ -1,4 +1,6 @@
 #include "LoRa-RP2040.h"
+#include "trace.hpp"
+#include <stdlib.h>
 
 // registers
 #define REG_FIFO                 0x00
@@ -54,13 +56,12 @@
 #define IRQ_TX_DONE_MASK           0x08
 #define IRQ_PAYLOAD_CRC_ERROR_MASK 0x20
 #define IRQ_RX_DONE_MASK           0x40
+#define IRQ_CAD_MASK               (IRQ_CAD_DONE_MASK | IRQ_CAD_DETECTED_MASK)
 
 #define RF_MID_BAND_THRESHOLD    525E6
 #define RSSI_OFFSET_HF_PORT      157
 #define RSSI_OFFSET_LF_PORT      164
 
-#define MAX_PKT_LENGTH           255
-
 #if (ESP8266 || ESP32)
 #define ISR_PREFIX ICACHE_RAM_ATTR
 #else
@@ -75,7 +76,19 @@ LoRaClass::LoRaClass() :
       _implicitHeaderMode(0), 
       _onReceive(NULL), 
       _onCadDone(NULL),
-      _onTxDone(NULL) 
+      _onTxDone(NULL),
+      _dutyCycle(NULL),
+      _lbtAttempts(0),
+      _lbtBusy(0),
+      _lbtBackoffUntil(0),
+      _cadInterval(0),
+      _cadSize(0),
+      _cadRxTimeout(0),
+      _cadAlarm(0),
+      _alarmPool(NULL),
+      _rxDoneUs(0),
+      _txDoneUs(0),
+      _txLength(-1)
 {}
 
 int LoRaClass::begin(long frequency) 
@@ -100,7 +113,7 @@ int LoRaClass::begin(long frequency)
 
 
   // start SPI
-  printf("set baudrate: %u\n", spi_init(SPI_PORT, 4E6));
+  trace(TRACE_LORA_SPI, spi_init(SPI_PORT, 4E6));
   gpio_set_function(PIN_SCK, GPIO_FUNC_SPI);
   gpio_set_function(PIN_MISO, GPIO_FUNC_SPI);
   gpio_set_function(PIN_MOSI, GPIO_FUNC_SPI);
@@ -120,7 +133,7 @@ int LoRaClass::begin(long frequency)
 
   // check version
   uint8_t version = readRegister(REG_VERSION);
-  printf("version: %u\n", version);
+  trace(TRACE_LORA_VERSION, version);
   if (version != 0x12) {
     return 0;
   }
@@ -161,6 +174,9 @@ void LoRaClass::end()
 
 int LoRaClass::beginPacket(int implicitHeader) 
 {
+  // the radio can't be shared with the receive cycle
+  stopDutyCycledReceive();
+
   if (isTransmitting()) {
     return 0;
   }
@@ -177,12 +193,49 @@ int LoRaClass::beginPacket(int implicitHeader)
   // reset FIFO address and paload length
   writeRegister(REG_FIFO_ADDR_PTR, 0);
   writeRegister(REG_PAYLOAD_LENGTH, 0);
+  _txLength = 0;
 
   return 1;
 }
 
 int LoRaClass::endPacket(bool async) 
 {
+  if (_dutyCycle) {
+    uint64_t now = time_us_64();
+    uint32_t airtime = timeOnAir(_txLength > 0 ? _txLength : 0);
+
+    // over the budget, the packet stays in the FIFO, so endPacket can be retried later
+    if (!_dutyCycle->allow(now, airtime)) {
+      return 0;
+    }
+  }
+
+  if (_lbtAttempts > 0) {
+    // still backing off, nothing waits here, the packet stays in the FIFO, so endPacket can be retried later
+    if (time_us_64() < _lbtBackoffUntil) {
+      return 0;
+    }
+
+    if (isChannelBusy()) {
+      // a CAD takes about 2 symbols, the backoff is measured in these slots
+      LoRaModem modem = getModem();
+      uint32_t slot = 2 * symbol_time_us(modem);
+      int window = LBT_MIN_WINDOW << (_lbtBusy < _lbtAttempts ? _lbtBusy : _lbtAttempts);
+
+      _lbtBackoffUntil = time_us_64() + (uint64_t)(rand() % window) * slot + time_on_air_us(modem, 0);
+      _lbtBusy++;
+      return 0;
+    }
+
+    _lbtBusy = 0;
+  }
+
+  if (_dutyCycle) {
+    _dutyCycle->record(time_us_64(), timeOnAir(_txLength > 0 ? _txLength : 0));
+  }
+
+  // sent, the length in the register now belongs to the packet on air
+  _txLength = -1;
 
   if ((async) && (_onTxDone))
     writeRegister(REG_DIO_MAPPING_1, 0x40); // DIO0 => TXDONE
@@ -195,6 +248,7 @@ int LoRaClass::endPacket(bool async)
     while ((readRegister(REG_IRQ_FLAGS) & IRQ_TX_DONE_MASK) == 0) {
       sleep_ms(0);
     }
+    _txDoneUs = time_us_64();
     // clear IRQ's
     writeRegister(REG_IRQ_FLAGS, IRQ_TX_DONE_MASK);
   }
@@ -303,24 +357,43 @@ size_t LoRaClass::write(uint8_t byte)
 
 size_t LoRaClass::write(const uint8_t *buffer, size_t size) 
 {
-  int currentLength = readRegister(REG_PAYLOAD_LENGTH);
+  // only between beginPacket() and endPacket()
+  if (_txLength < 0) {
+    return 0;
+  }
+
+  int currentLength = _txLength;
 
   // check size
   if ((currentLength + size) > MAX_PKT_LENGTH) {
     size = MAX_PKT_LENGTH - currentLength;
   }
 
-  // write data
-  for (size_t i = 0; i < size; i++) {
-    writeRegister(REG_FIFO, buffer[i]);
-  }
+  // write data, in one SPI transaction
+  burstWrite(REG_FIFO, buffer, size);
 
   // update length
-  writeRegister(REG_PAYLOAD_LENGTH, currentLength + size);
+  _txLength = currentLength + size;
+  writeRegister(REG_PAYLOAD_LENGTH, _txLength);
 
   return size;
 }
 
+int LoRaClass::availableForWrite()
+{
+  // outside of a packet the register still holds the length of the last packet sent or received, which takes no room
+  int currentLength = _txLength > 0 ? _txLength : 0;
+
+  if (!_dutyCycle) {
+    return MAX_PKT_LENGTH - currentLength;
+  }
+
+  // largest packet the duty cycle budget allows right now, minus what has already been written
+  int size = max_payload(getModem(), _dutyCycle->available(time_us_64())) - currentLength;
+
+  return size > 0 ? size : 0;
+}
+
 int LoRaClass::available() 
 {
   return (readRegister(REG_RX_NB_BYTES) - _packetIndex);
@@ -395,6 +468,10 @@ void LoRaClass::onTxDone(void (*callback)())
 
 void LoRaClass::receive(int size) 
 {
+  stopDutyCycledReceive();
+
+  // a packet that wasn't sent is gone, received packets use the same part of the FIFO
+  _txLength = -1;
 
   writeRegister(REG_DIO_MAPPING_1, 0x00); // DIO0 => RXDONE
 
@@ -415,6 +492,112 @@ void LoRaClass::channelActivityDetection(void)
   writeRegister(REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_CAD);
 }
 
+bool LoRaClass::isChannelBusy()
+{
+  idle();
+
+  // DIO0 => RXDONE, so the interrupt handler doesn't clear the CAD flags
+  writeRegister(REG_DIO_MAPPING_1, 0x00);
+  writeRegister(REG_IRQ_FLAGS, IRQ_CAD_MASK);
+  writeRegister(REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_CAD);
+
+  // CAD takes about 2 symbols
+  LoRaModem modem = getModem();
+  uint64_t timeout = time_us_64() + 4 * symbol_time_us(modem) + 1000;
+
+  int irqFlags;
+  while (((irqFlags = readRegister(REG_IRQ_FLAGS)) & IRQ_CAD_DONE_MASK) == 0) {
+    if (time_us_64() > timeout) {
+      break;
+    }
+  }
+
+  writeRegister(REG_IRQ_FLAGS, IRQ_CAD_MASK);
+  idle();
+
+  return (irqFlags & IRQ_CAD_DETECTED_MASK) != 0;
+}
+
+void LoRaClass::setListenBeforeTalk(int attempts)
+{
+  _lbtAttempts = attempts;
+
+  if (attempts > 0) {
+    // seed the backoff from the wideband RSSI, which is only random while receiving
+    // (every team's radio ends up with a different sequence)
+    writeRegister(REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_RX_CONTINUOUS);
+
+    unsigned int seed = 0;
+    for (int i = 0; i < 32; i++) {
+      seed = (seed << 1) | (random() & 0x01);
+      sleep_us(10);
+    }
+    srand(seed);
+
+    idle();
+  }
+}
+
+void LoRaClass::receiveDutyCycled(long intervalUs, int size)
+{
+  stopDutyCycledReceive();
+  _txLength = -1;
+
+  _cadSize = size;
+
+  // after a detection, wait until a packet with the longest possible preamble could have arrived
+  LoRaModem modem = getModem();
+  modem.implicitHeader = size > 0;
+  _cadRxTimeout = intervalUs + time_on_air_us(modem, MAX_PKT_LENGTH);
+
+  gpio_set_irq_enabled_with_callback(_dio0, GPIO_IRQ_EDGE_RISE, true, &LoRaClass::onDio0Rise);
+
+  _cadInterval = intervalUs;
+  startCad();
+}
+
+void LoRaClass::startCad()
+{
+  _cadAlarm = 0;
+
+  idle();
+  writeRegister(REG_DIO_MAPPING_1, 0x80); // DIO0 => CADDONE
+  writeRegister(REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_CAD);
+}
+
+void LoRaClass::scheduleCad(uint64_t us)
+{
+  _cadAlarm = alarm_pool_add_alarm_in_us(alarmPool(), us, &LoRaClass::onCadAlarm, NULL, true);
+}
+
+void LoRaClass::stopDutyCycledReceive()
+{
+  if (_cadInterval == 0) {
+    return;
+  }
+
+  _cadInterval = 0;
+
+  if (_cadAlarm > 0) {
+    alarm_pool_cancel_alarm(alarmPool(), _cadAlarm);
+    _cadAlarm = 0;
+  }
+
+  // abort a running CAD, so its interrupt doesn't arrive in the middle of the next operation
+  idle();
+  writeRegister(REG_IRQ_FLAGS, IRQ_CAD_MASK);
+}
+
+int64_t LoRaClass::onCadAlarm(alarm_id_t, void*)
+{
+  // a new CAD after sleeping, or the receive window has ended without a packet
+  if (LoRa._cadInterval > 0) {
+    LoRa.startCad();
+  }
+
+  return 0;
+}
+
 void LoRaClass::idle() 
 {
   writeRegister(REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_STDBY);
@@ -620,6 +803,36 @@ void LoRaClass::setOCP(uint8_t mA)
   writeRegister(REG_OCP, 0x20 | (0x1F & ocpTrim));
 }
 
+LoRaModem LoRaClass::getModem()
+{
+  LoRaModem modem;
+
+  modem.sf = getSpreadingFactor();
+  modem.bw = getSignalBandwidth();
+  modem.cr = ((readRegister(REG_MODEM_CONFIG_1) >> 1) & 0x07) + 4;
+  modem.preamble = (readRegister(REG_PREAMBLE_MSB) << 8) | readRegister(REG_PREAMBLE_LSB);
+  modem.implicitHeader = _implicitHeaderMode;
+  modem.crc = (readRegister(REG_MODEM_CONFIG_2) & 0x04) != 0;
+  modem.ldro = (readRegister(REG_MODEM_CONFIG_3) & 0x08) != 0;
+
+  return modem;
+}
+
+void LoRaClass::setDutyCycle(DutyCycle* dutyCycle)
+{
+  _dutyCycle = dutyCycle;
+}
+
+void LoRaClass::setAlarmPool(alarm_pool_t* pool)
+{
+  _alarmPool = pool;
+}
+
+alarm_pool_t* LoRaClass::alarmPool()
+{
+  return _alarmPool ? _alarmPool : alarm_pool_get_default();
+}
+
 void LoRaClass::setGain(uint8_t gain) 
 {
   // check allowed range
@@ -689,7 +902,7 @@ void LoRaClass::implicitHeaderMode()
   writeRegister(REG_MODEM_CONFIG_1, readRegister(REG_MODEM_CONFIG_1) | 0x01);
 }
 
-void LoRaClass::handleDio0Rise() 
+void LoRaClass::handleDio0Rise(uint64_t timeUs) 
 {
   int irqFlags = readRegister(REG_IRQ_FLAGS);
 
@@ -701,11 +914,33 @@ void LoRaClass::handleDio0Rise()
     if (_onCadDone) {
       _onCadDone((irqFlags & IRQ_CAD_DETECTED_MASK) != 0);
     }
+
+    if (_cadInterval > 0) {
+      if ((irqFlags & IRQ_CAD_DETECTED_MASK) != 0) {
+        // a preamble is on the air, receive the packet
+        writeRegister(REG_DIO_MAPPING_1, 0x00); // DIO0 => RXDONE
+
+        if (_cadSize > 0) {
+          implicitHeaderMode();
+          writeRegister(REG_PAYLOAD_LENGTH, _cadSize & 0xff);
+        } else {
+          explicitHeaderMode();
+        }
+
+        writeRegister(REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_RX_CONTINUOUS);
+        scheduleCad(_cadRxTimeout);
+      } else {
+        // nothing on the air, sleep until the next CAD
+        sleep();
+        scheduleCad(_cadInterval);
+      }
+    }
   } else if ((irqFlags & IRQ_PAYLOAD_CRC_ERROR_MASK) == 0) {
 
     if ((irqFlags & IRQ_RX_DONE_MASK) != 0) {
       // received a packet
       _packetIndex = 0;
+      _rxDoneUs = timeUs;
 
       // read packet length
       int packetLength = _implicitHeaderMode ? readRegister(REG_PAYLOAD_LENGTH) : readRegister(REG_RX_NB_BYTES);
@@ -716,7 +951,19 @@ void LoRaClass::handleDio0Rise()
       if (_onReceive) {
         _onReceive(packetLength);
       }
+
+      // packet received, go back to sleeping between CADs
+      if (_cadInterval > 0) {
+        if (_cadAlarm > 0) {
+          alarm_pool_cancel_alarm(alarmPool(), _cadAlarm);
+        }
+
+        sleep();
+        scheduleCad(_cadInterval);
+      }
     } else if ((irqFlags & IRQ_TX_DONE_MASK) != 0) {
+      _txDoneUs = timeUs;
+
       if (_onTxDone) {
         _onTxDone();
       }
@@ -724,6 +971,16 @@ void LoRaClass::handleDio0Rise()
   }
 }
 
+uint64_t LoRaClass::packetTime()
+{
+  return _rxDoneUs;
+}
+
+uint64_t LoRaClass::txDoneTime()
+{
+  return _txDoneUs;
+}
+
 uint8_t LoRaClass::readRegister(uint8_t address) 
 {
   return singleTransfer(address & 0x7f, 0x00);
@@ -734,24 +991,50 @@ void LoRaClass::writeRegister(uint8_t address, uint8_t value)
   singleTransfer(address | 0x80, value);
 }
 
+void LoRaClass::burstWrite(uint8_t address, const uint8_t *buffer, size_t size)
+{
+  if (size == 0) {
+    return;
+  }
+
+  // the FIFO address pointer advances with every byte, as long as NSS stays low
+  address |= 0x80;
+
+  // the DIO0 interrupt and the CAD alarms use the SPI as well
+  uint32_t status = save_and_disable_interrupts();
+  gpio_put(_ss, 0);
+
+  spi_write_blocking(SPI_PORT, &address, 1);
+  spi_write_blocking(SPI_PORT, buffer, size);
+
+  gpio_put(_ss, 1);
+  restore_interrupts(status);
+}
+
 uint8_t LoRaClass::singleTransfer(uint8_t address, uint8_t value) 
 {
   uint8_t response;
 
+  // the DIO0 interrupt and the CAD alarms use the SPI as well
+  uint32_t status = save_and_disable_interrupts();
   gpio_put(_ss, 0);
 
   spi_write_blocking(SPI_PORT, &address, 1);
   spi_write_read_blocking(SPI_PORT, &value, &response, 1);
 
   gpio_put(_ss, 1);
+  restore_interrupts(status);
 
   return response;
 }
 
 void LoRaClass::onDio0Rise(uint gpio, uint32_t events) 
 {
+  // before the SPI transfers, which take a few tens of us
+  uint64_t now = time_us_64();
+
   gpio_acknowledge_irq(gpio, events);
-  LoRa.handleDio0Rise();
+  LoRa.handleDio0Rise(now);
 }
 
 LoRaClass LoRa;
@@ -8,8 +8,11 @@
 #include "pico/binary_info.h"
 #include "hardware/gpio.h"
 #include "hardware/spi.h"
+#include "hardware/sync.h"
 #include "string.h"
 #include "Print.h"
+#include "radio.hpp"
+#include "duty_cycle.hpp"
 
 #define PIN_MISO 4
 #define PIN_CS   5
@@ -29,10 +32,13 @@
 #define PA_OUTPUT_RFO_PIN          0
 #define PA_OUTPUT_PA_BOOST_PIN     1
 
+// listen before talk: the first backoff window in CAD slots, it doubles after every busy channel in a row
+#define LBT_MIN_WINDOW             4
+
 static void __empty();
 
 //class LoRaClass : public Stream {
-class LoRaClass : public Print {
+class LoRaClass : public Radio {
 public:
   LoRaClass();
 
@@ -52,6 +58,7 @@ public:
   // from Print
   virtual size_t write(uint8_t byte);
   virtual size_t write(const uint8_t *buffer, size_t size);
+  virtual int availableForWrite();
 
   // from Stream
   virtual int available();
@@ -65,6 +72,15 @@ public:
 
   void receive(int size = 0);
   void channelActivityDetection(void);
+  bool isChannelBusy(); // blocking CAD, returns true if a LoRa preamble was detected
+
+  // endPacket() refuses to transmit while the channel is busy, and for a random backoff after that. The backoff window
+  // doubles with every busy channel in a row, at most `attempts` times, 0 turns it off
+  void setListenBeforeTalk(int attempts);
+  // sleeps, and only receives when a CAD detects a preamble every intervalUs, for receivers on a battery.
+  // The sender needs a preamble of setPreambleLength(cad_preamble(modem, intervalUs)), or most packets are missed
+  void receiveDutyCycled(long intervalUs, int size = 0);
+  void stopDutyCycledReceive(); // should be called before reconfiguring the radio, beginPacket() and receive() do it automatically
 
   void idle();
   void sleep();
@@ -85,8 +101,17 @@ public:
 
   void setOCP(uint8_t mA); // Over Current Protection control
 
+  LoRaModem getModem(); // current modem settings, read back from the radio
+  void setDutyCycle(DutyCycle* dutyCycle); // endPacket() refuses to transmit when the budget is used up
+  // the CAD alarms run on the core of this pool, the default pool is on core 0.
+  // The radio has to be used from that core only, an SPI transfer is atomic only against the interrupts of its own core
+  void setAlarmPool(alarm_pool_t* pool);
+
   void setGain(uint8_t gain); // Set LNA gain
 
+  uint64_t packetTime(); // when the last packet was received, time_us_64() at the RX done interrupt, 0 if none was
+  uint64_t txDoneTime(); // when the last packet was sent, time_us_64() at TX done, 0 if none was
+
   // deprecated
   void crc() { enableCrc(); }
   void noCrc() { disableCrc(); }
@@ -103,7 +128,7 @@ private:
   void explicitHeaderMode();
   void implicitHeaderMode();
 
-  void handleDio0Rise();
+  void handleDio0Rise(uint64_t timeUs);
   bool isTransmitting();
 
   int getSpreadingFactor();
@@ -114,9 +139,15 @@ private:
   uint8_t readRegister(uint8_t address);
   void writeRegister(uint8_t address, uint8_t value);
   uint8_t singleTransfer(uint8_t address, uint8_t value);
+  void burstWrite(uint8_t address, const uint8_t *buffer, size_t size);
 
   static void onDio0Rise(uint, uint32_t);
 
+  void startCad();
+  void scheduleCad(uint64_t us);
+  alarm_pool_t* alarmPool();
+  static int64_t onCadAlarm(alarm_id_t, void*);
+
 private:
   // SPISettings _spiSettings;
   spi_inst_t *_spi;
@@ -129,6 +160,18 @@ private:
   void (*_onReceive)(int);
   void (*_onCadDone)(bool);
   void (*_onTxDone)();
+  DutyCycle* _dutyCycle;
+  int _lbtAttempts;
+  int _lbtBusy; // busy channels in a row
+  uint64_t _lbtBackoffUntil;
+  long _cadInterval;
+  int _cadSize;
+  uint32_t _cadRxTimeout;
+  alarm_id_t _cadAlarm;
+  alarm_pool_t* _alarmPool;
+  volatile uint64_t _rxDoneUs;
+  volatile uint64_t _txDoneUs;
+  int _txLength; // bytes written since beginPacket(), -1 when no packet is open
 };
 
 extern LoRaClass LoRa;
\ No newline at end of file
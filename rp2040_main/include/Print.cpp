@@ -78,11 +78,7 @@ size_t Print::print(long n, int base)
   if (base == 0) {
     return write(n);
   } else if (base == 10) {
-    if (n < 0) {
-      int t = print('-');
-      n = -n;
-      return printNumber(n, 10) + t;
-    }
+    if (n < 0) return printNumber(0UL - (unsigned long) n, 10, true);
     return printNumber(n, 10);
   } else {
     return printNumber(n, base);
@@ -100,11 +96,7 @@ size_t Print::print(long long n, int base)
   if (base == 0) {
     return write(n);
   } else if (base == 10) {
-    if (n < 0) {
-      int t = print('-');
-      n = -n;
-      return printULLNumber(n, 10) + t;
-    }
+    if (n < 0) return printULLNumber(0ULL - (unsigned long long) n, 10, true);
     return printULLNumber(n, 10);
   } else {
     return printULLNumber(n, base);
@@ -200,99 +192,138 @@ size_t Print::println(double num, int digits)
 
 // Private Methods /////////////////////////////////////////////////////////////
 
-size_t Print::printNumber(unsigned long n, uint8_t base)
-{
-  char buf[8 * sizeof(long) + 1]; // Assumes 8-bit chars plus zero byte.
-  char *str = &buf[sizeof(buf) - 1];
-
-  *str = '\0';
+// two decimal digits per division
+static const char digitPairs[201] =
+  "0001020304050607080910111213141516171819"
+  "2021222324252627282930313233343536373839"
+  "4041424344454647484950515253545556575859"
+  "6061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
 
-  // prevent crash if called with base == 1
-  if (base < 2) base = 10;
+static const char digitChars[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
 
-  do {
-    char c = n % base;
-    n /= base;
+static const uint32_t powersOf10[10] = {
+  1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
 
-    *--str = c < 10 ? c + '0' : c + 'A' - 10;
-  } while(n);
-
-  return write(str);
+// bits per digit of the bases that are powers of two, 0 for the others
+static uint8_t digitBits(uint8_t base)
+{
+  switch (base) {
+    case 2: return 1;
+    case 4: return 2;
+    case 8: return 3;
+    case 16: return 4;
+    case 32: return 5;
+    default: return 0;
+  }
 }
 
-// REFERENCE IMPLEMENTATION FOR ULL
-// size_t Print::printULLNumber(unsigned long long n, uint8_t base)
-// {
-  // // if limited to base 10 and 16 the bufsize can be smaller
-  // char buf[65];
-  // char *str = &buf[64];
+// writes exactly `digits` decimal digits of n, with leading zeros
+static char *formatDecimal(char *end, uint32_t n, int digits)
+{
+  char *str = end;
+  while (digits >= 2) {
+    uint32_t q = n / 100;
+    str -= 2;
+    memcpy(str, &digitPairs[2 * (n - q * 100)], 2);
+    n = q;
+    digits -= 2;
+  }
+  if (digits) *--str = '0' + n % 10;
+  return str;
+}
 
-  // *str = '\0';
+char *Print::formatNumber(char *end, unsigned long n, uint8_t base)
+{
+  char *str = end;
 
-  // // prevent crash if called with base == 1
-  // if (base < 2) base = 10;
+  // prevent crash if called with base == 1
+  if (base < 2 || base > 36) base = 10;
+
+  if (base == 10) {
+    while (n >= 100) {
+      unsigned long q = n / 100;
+      str -= 2;
+      memcpy(str, &digitPairs[2 * (n - q * 100)], 2);
+      n = q;
+    }
+    if (n >= 10) {
+      str -= 2;
+      memcpy(str, &digitPairs[2 * n], 2);
+    }
+    else *--str = '0' + n;
+    return str;
+  }
 
-    // do {
-      // unsigned long long t = n / base;
-      // char c = n - t * base;  // faster than c = n%base;
-      // n = t;
-      // *--str = c < 10 ? c + '0' : c + 'A' - 10;
-  // } while(n);
+  uint8_t bits = digitBits(base);
+  do {
+    if (bits) {
+      *--str = digitChars[n & (base - 1)];
+      n >>= bits;
+    } else {
+      unsigned long q = n / base;
+      *--str = digitChars[n - q * base];
+      n = q;
+    }
+  } while (n);
 
-  // return write(str);
-// }
+  return str;
+}
 
-// FAST IMPLEMENTATION FOR ULL
-size_t Print::printULLNumber(unsigned long long n64, uint8_t base)
+char *Print::formatULLNumber(char *end, unsigned long long n, uint8_t base)
 {
-  // if limited to base 10 and 16 the bufsize can be 20
-  char buf[64];
-  uint8_t i = 0;
-  uint8_t innerLoops = 0;
+  char *str = end;
 
-  // prevent crash if called with base == 1
-  if (base < 2) base = 10;
+  if (base < 2 || base > 36) base = 10;
 
-  // process chunks that fit in "16 bit math".
-  uint16_t top = 0xFFFF / base;
-  uint16_t th16 = 1;
-  while (th16 < top)
-  {
-    th16 *= base;
-    innerLoops++;
+  // the 64 bit divisions are slow on the M0+, so there are only as many as 32 bit chunks, 8 decimal digits each
+  if (base == 10) {
+    while (n > 0xFFFFFFFFULL) {
+      unsigned long long q = n / 100000000;
+      str = formatDecimal(str, (uint32_t) (n - q * 100000000), 8);
+      n = q;
+    }
+    return formatNumber(str, (unsigned long) n, 10);
   }
 
-  while (n64 > th16)
-  {
-    // 64 bit math part
-    uint64_t q = n64 / th16;
-    uint16_t r = n64 - q*th16;
-    n64 = q;
-
-    // 16 bit math loop to do remainder. (note buffer is filled reverse)
-    for (uint8_t j=0; j < innerLoops; j++)
-    {
-      uint16_t qq = r/base;
-      buf[i++] = r - qq*base;
-      r = qq;
-    }
+  uint8_t bits = digitBits(base);
+  if (bits) {
+    do {
+      *--str = digitChars[n & (base - 1)];
+      n >>= bits;
+    } while (n);
+    return str;
   }
 
-  uint16_t n16 = n64;
-  while (n16 > 0)
-  {
-    uint16_t qq = n16/base;
-    buf[i++] = n16 - qq*base;
-    n16 = qq;
+  while (n > 0xFFFFFFFFULL) {
+    unsigned long long q = n / base;
+    *--str = digitChars[n - q * base];
+    n = q;
   }
+  return formatNumber(str, (unsigned long) n, base);
+}
+
+size_t Print::printNumber(unsigned long n, uint8_t base, bool negative)
+{
+  char buf[8 * sizeof(long) + 1]; // base 2, or a sign and base 10
+  char *end = buf + sizeof(buf);
+  char *str = formatNumber(end, n, base);
+
+  if (negative) *--str = '-';
+
+  return write(str, end - str);
+}
+
+size_t Print::printULLNumber(unsigned long long n, uint8_t base, bool negative)
+{
+  char buf[8 * sizeof(long long) + 1];
+  char *end = buf + sizeof(buf);
+  char *str = formatULLNumber(end, n, base);
 
-  size_t bytes = i;
-  for (; i > 0; i--)
-    write((char) (buf[i - 1] < 10 ?
-    '0' + buf[i - 1] :
-    'A' + buf[i - 1] - 10));
+  if (negative) *--str = '-';
 
-  return bytes;
+  return write(str, end - str);
 }
 
 size_t Print::printFloat(double number, int digits)
@@ -300,17 +331,20 @@ size_t Print::printFloat(double number, int digits)
   if (digits < 0)
     digits = 2;
 
-  size_t n = 0;
-
   if (isnan(number)) return print("nan");
   if (isinf(number)) return print("inf");
   if (number > 4294967040.0) return print ("ovf");  // constant determined empirically
   if (number <-4294967040.0) return print ("ovf");  // constant determined empirically
 
+  // sign, integer part, point and up to 9 decimals at a time, longer fractions are written in pieces
+  char buf[32];
+  char *str = buf;
+  size_t n = 0;
+
   // Handle negative numbers
   if (number < 0.0)
   {
-     n += print('-');
+     *str++ = '-';
      number = -number;
   }
 
@@ -324,21 +358,35 @@ size_t Print::printFloat(double number, int digits)
   // Extract the integer part of the number and print it
   unsigned long int_part = (unsigned long)number;
   double remainder = number - (double)int_part;
-  n += print(int_part);
+
+  char digitsBuf[8 * sizeof(long)];
+  char *end = digitsBuf + sizeof(digitsBuf);
+  char *intStr = formatNumber(end, int_part, 10);
+  memcpy(str, intStr, end - intStr);
+  str += end - intStr;
 
   // Print the decimal point, but only if there are digits beyond
   if (digits > 0) {
-    n += print(".");
+    *str++ = '.';
   }
 
-  // Extract digits from the remainder one at a time
-  while (digits-- > 0)
+  // the decimals as integers, 9 at a time
+  while (digits > 0)
   {
-    remainder *= 10.0;
-    unsigned int toPrint = (unsigned int)remainder;
-    n += print(toPrint);
+    int chunk = digits < 9 ? digits : 9;
+    remainder *= powersOf10[chunk];
+    uint32_t toPrint = (uint32_t)remainder;
+    if (toPrint >= powersOf10[chunk]) toPrint = powersOf10[chunk] - 1;
     remainder -= toPrint;
+    digits -= chunk;
+
+    if (str + chunk > buf + sizeof(buf)) {
+      n += write(buf, str - buf);
+      str = buf;
+    }
+    formatDecimal(str + chunk, toPrint, chunk);
+    str += chunk;
   }
 
-  return n;
+  return n + write(buf, str - buf);
 }
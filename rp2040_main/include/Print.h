@@ -20,6 +20,7 @@
 
 #include <inttypes.h>
 #include <stdio.h> // for size_t
+#include <string.h> // for strlen
 #include <string>
 
 
@@ -35,8 +36,11 @@ class Print
 {
   private:
     int write_error;
-    size_t printNumber(unsigned long, uint8_t);
-    size_t printULLNumber(unsigned long long, uint8_t);
+    // numbers are formatted backwards into a buffer ending at `end`, and written with a single write()
+    static char *formatNumber(char *end, unsigned long, uint8_t);
+    static char *formatULLNumber(char *end, unsigned long long, uint8_t);
+    size_t printNumber(unsigned long, uint8_t, bool negative = false);
+    size_t printULLNumber(unsigned long long, uint8_t, bool negative = false);
     size_t printFloat(double, int);
   protected:
     void setWriteError(int err = 1) { write_error = err; }
@@ -51,6 +55,7 @@ class Print
       if (str == NULL) return 0;
       return write((const uint8_t *)str, strlen(str));
     }
+    // everything printed ends up here in whole spans, sinks where a byte costs a transfer should override it
     virtual size_t write(const uint8_t *buffer, size_t size);
     size_t write(const char *buffer, size_t size) {
       return write((const uint8_t *)buffer, size);
@@ -0,0 +1,131 @@
+#include "adr.hpp"
+#include "duty_cycle.hpp"
+#include "flight_phase.hpp"
+
+// SNR floors are the demodulation limits from the SX1276 datasheet (SF7: -7.5 dB ... SF12: -20 dB)
+const RadioProfile adrProfiles[ADR_PROFILE_COUNT] = {
+    {12, 125000, 5, -20.0f, 0.0f},
+    {11, 125000, 5, -17.5f, 0.0f},
+    {10, 125000, 5, -15.0f, 0.0f},
+    { 9, 125000, 5, -12.5f, 0.0f},
+    { 8, 125000, 5, -10.0f, 0.0f},
+    { 7, 125000, 5,  -7.5f, 0.0f},
+    { 7, 250000, 5,  -7.5f, 3.01f},
+};
+
+LoRaModem adr_modem(int profile)
+{
+    const RadioProfile& p = adrProfiles[profile];
+
+    // 8 symbol preamble, explicit header, no CRC, like both ends after begin()
+    LoRaModem modem = {p.sf, p.bw, p.cr, 8, false, false, false};
+    modem.ldro = symbol_time_us(modem) > 16000;
+    return modem;
+}
+
+uint32_t adr_keepalive_ms(int profile)
+{
+    // a PROFILE_CONF and the acknowledgement of the report frame size (FRAME_CONF), both the 4 byte header and a byte
+    uint32_t airtime = 2 * time_on_air_us(adr_modem(profile), 5);
+    uint32_t period = airtime / (ADR_KEEPALIVE_SHARE * DUTY_CYCLE_RATIO * 1000);
+
+    return period > ADR_KEEPALIVE_MIN_MS ? period : ADR_KEEPALIVE_MIN_MS;
+}
+
+uint32_t adr_link_timeout_ms(int profile)
+{
+    return ADR_KEEPALIVE_MISSES * adr_keepalive_ms(profile);
+}
+
+bool adr_pinned(int phase, uint32_t flightMs)
+{
+    // if the apogee isn't detected, the profile is given back to the controller anyway
+    bool flight = phase == PHASE_BOOST || phase == PHASE_COAST || phase == PHASE_APOGEE;
+    return flight && flightMs < ADR_FLIGHT_MS;
+}
+
+AdaptiveRate::AdaptiveRate(int startProfile) : profile(startProfile) {}
+
+void AdaptiveRate::addPacket(float snr)
+{
+    snrSum += snr;
+    packets++;
+}
+
+void AdaptiveRate::addLoss(int received, int lost)
+{
+    this->received += received;
+    this->lost += lost;
+}
+
+float AdaptiveRate::getMargin(int p)
+{
+    if (packets == 0) return 0;
+
+    // Fading is noticed through the loss ratio, a single bad packet shouldn't make the whole window look weak
+    float snr = snrSum / packets;
+
+    // The noise floor moves with the bandwidth, so the SNR measured on the current profile
+    // is shifted by the bandwidth difference before it is compared to the other profile's floor
+    return snr + adrProfiles[profile].bwDb - adrProfiles[p].bwDb - adrProfiles[p].snrFloor;
+}
+
+int AdaptiveRate::decide()
+{
+    int total = received + lost;
+    float loss = total > 0 ? (float) lost / total : 0;
+
+    // Heavy loss over ADR_WINDOW packets sent, step down even if too few arrived for an SNR window
+    // (lost packets do not report their SNR, so the margin can look fine while the link dies)
+    if (total >= ADR_WINDOW && loss > ADR_MAX_LOSS)
+    {
+        resetWindow();
+        return profile > 0 ? profile - 1 : -1;
+    }
+
+    int window = ADR_WINDOW >> (adrProfiles[profile].sf - 7);
+    if (packets < (window > ADR_MIN_WINDOW ? window : ADR_MIN_WINDOW)) return -1;
+
+    int next = -1;
+
+    if (getMargin(profile) < ADR_TARGET_MARGIN)
+    {
+        // Step down to the fastest profile that still has enough margin
+        for (next = profile - 1; next > 0; next--)
+        {
+            if (getMargin(next) >= ADR_TARGET_MARGIN) break;
+        }
+    }
+    else if (loss == 0)
+    {
+        // Step up to the fastest profile that has some headroom above the target
+        for (int p = profile + 1; p < ADR_PROFILE_COUNT; p++)
+        {
+            if (getMargin(p) >= ADR_TARGET_MARGIN + ADR_HYSTERESIS) next = p;
+        }
+    }
+
+    resetWindow();
+    return next;
+}
+
+void AdaptiveRate::setProfile(int p)
+{
+    if (p < 0 || p >= ADR_PROFILE_COUNT || p == profile) return;
+
+    profile = p;
+    resetWindow();
+}
+
+int AdaptiveRate::getProfile()
+{
+    return profile;
+}
+
+void AdaptiveRate::resetWindow()
+{
+    snrSum = 0;
+    packets = 0;
+    received = 0;
+    lost = 0;
+}
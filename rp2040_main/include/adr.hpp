@@ -0,0 +1,152 @@
+#pragma once
+#include <cstdint>
+#include "airtime.hpp"
+
+// Number of radio profiles the adaptive data rate controller can choose from
+#define ADR_PROFILE_COUNT 7
+
+// Profile used at boot, and after the link has been lost (the most robust one)
+#define ADR_DEFAULT_PROFILE 0
+
+// How many packets are averaged before a decision is made on SF7. Every step of the spreading factor doubles
+// the time on air, so the window halves with it, down to ADR_MIN_WINDOW: a window takes about as long on every profile
+#define ADR_WINDOW 12
+#define ADR_MIN_WINDOW 1
+
+// Required SNR margin above the demodulation floor, in dB
+#define ADR_TARGET_MARGIN 2.0f
+
+// Extra margin needed before stepping to a faster profile, in dB. Stops the controller from oscillating
+#define ADR_HYSTERESIS 1.0f
+
+// Loss ratio (lost / (lost + received)) above which the controller steps to a more robust profile
+#define ADR_MAX_LOSS 0.2f
+
+// The ground station re-sends the current profile as a keep-alive, with at most this share of its duty cycle,
+// but not more often than every ADR_KEEPALIVE_MIN_MS
+#define ADR_KEEPALIVE_SHARE 0.25f
+#define ADR_KEEPALIVE_MIN_MS 5000
+
+// If nothing has been heard from the other end for this many keep-alive periods, both ends fall back to `ADR_DEFAULT_PROFILE`
+#define ADR_KEEPALIVE_MISSES 3
+
+// Profile for the fast part of the flight (boost, coast and apogee): the link changes faster than the controller can
+// follow it. Both ends keep it for at most ADR_FLIGHT_MS from the launch, see adr_pinned()
+#define ADR_FLIGHT_PROFILE 3
+#define ADR_FLIGHT_MS 60000
+
+/*
+    A set of modem settings that both ends of the link have to agree on.
+    Profiles are ordered from the most robust (slowest) to the fastest
+*/
+struct RadioProfile {
+    uint8_t sf;        // spreading factor
+    long bw;           // signal bandwidth in Hz
+    uint8_t cr;        // coding rate denominator (4/cr)
+    float snrFloor;    // lowest SNR the modem can still demodulate at, in dB (SX127x datasheet)
+    float bwDb;        // noise bandwidth relative to 125 kHz, in dB
+};
+
+extern const RadioProfile adrProfiles[ADR_PROFILE_COUNT];
+
+/*
+    @brief Modem settings of a profile, as both ends configure them
+
+    @param profile index into `adrProfiles`
+*/
+LoRaModem adr_modem(int profile);
+
+/*
+    @brief How often the ground station sends a keep-alive (a single `PROFILE_CONF` and `Comm::acknowledgeFrame()`) on a profile.
+    Slow profiles take longer to send one, so they are sent less often, to stay within the duty cycle
+
+    @param profile index into `adrProfiles`
+
+    @returns period in milliseconds
+*/
+uint32_t adr_keepalive_ms(int profile);
+
+/*
+    @brief How long nothing may be heard from the other end on a profile before falling back to `ADR_DEFAULT_PROFILE`.
+    Both ends compute it the same way, so they fall back together
+
+    @param profile index into `adrProfiles`
+
+    @returns timeout in milliseconds
+*/
+uint32_t adr_link_timeout_ms(int profile);
+
+/*
+    @brief Whether both ends keep `ADR_FLIGHT_PROFILE`: the controller makes no decisions, neither end falls back
+    after the link timeout, and the satellite ignores profile changes from the ground station
+
+    @param phase flight_phase_t, on the ground station the "phase" field of the last report
+    @param flightMs time since the first phase that keeps the profile, on the ground station since its first report
+
+    @returns true while the profile is kept
+*/
+bool adr_pinned(int phase, uint32_t flightMs);
+
+/*
+    Adaptive data rate controller. It runs on the end that receives the reports (the ground station),
+    because that is where the SNR of the reports can be measured.
+    Decisions are sent to the other end with `Comm::sendProfile()`, which then applies them on both ends.
+    The current profile should be re-sent every `adr_keepalive_ms()`, so the other end knows that the link is still up.
+*/
+class AdaptiveRate {
+public:
+    /* Constructor, the starting profile should be the one both ends were configured with */
+    AdaptiveRate(int startProfile = ADR_DEFAULT_PROFILE);
+
+    /*
+        @brief Feeds the link quality of a received packet into the controller
+
+        @param snr value of `packetSnr()`
+    */
+    void addPacket(float snr);
+
+    /*
+        @brief Feeds loss statistics into the controller, usually from `Comm::getLostPackets()`
+
+        @param received number of packets received since the last call
+        @param lost number of packets lost since the last call
+    */
+    void addLoss(int received, int lost);
+
+    /*
+        @brief Decides whether the profile should be changed
+
+        @returns the index of the new profile, or -1 if the current one should be kept
+    */
+    int decide();
+
+    /*
+        @brief Sets the current profile, should be called once the change has been applied on both ends
+
+        @param profile index into `adrProfiles`
+    */
+    void setProfile(int profile);
+
+    /*
+        @brief Returns the index of the current profile
+    */
+    int getProfile();
+
+    /*
+        @brief Estimated SNR margin of a profile based on the packets of the current window, in dB
+
+        @param profile index into `adrProfiles`
+    */
+    float getMargin(int profile);
+
+private:
+    int profile;
+
+    float snrSum = 0;
+    int packets = 0;
+
+    int received = 0;
+    int lost = 0;
+
+    void resetWindow();
+};
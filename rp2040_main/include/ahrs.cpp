@@ -0,0 +1,180 @@
+#include "ahrs.hpp"
+#include <cmath>
+
+// the three smaller components of a unit quaternion are within +-1/sqrt(2)
+#define PACK_RANGE 0.70710678f
+#define PACK_MAX 511
+
+uint32_t pack_quaternion(const float* q)
+{
+    int largest = 0;
+    for (int i = 1; i < 4; i++)
+        if (fabsf(q[i]) > fabsf(q[largest])) largest = i;
+
+    float sign = q[largest] < 0 ? -1.0f : 1.0f;
+
+    uint32_t packed = largest;
+    for (int i = 0; i < 4; i++)
+    {
+        if (i == largest) continue;
+
+        int value = (int) lroundf(sign * q[i] / PACK_RANGE * PACK_MAX);
+        if (value > PACK_MAX) value = PACK_MAX;
+        if (value < -PACK_MAX) value = -PACK_MAX;
+        packed = (packed << 10) | (value & 0x3FF);
+    }
+
+    return packed;
+}
+
+void unpack_quaternion(uint32_t packed, float* q)
+{
+    int largest = packed >> 30;
+    float sum = 0;
+
+    for (int i = 3; i >= 0; i--)
+    {
+        if (i == largest) continue;
+
+        // sign extend the 10 bit value
+        int value = (int) (packed & 0x3FF);
+        if (value & 0x200) value -= 0x400;
+        packed >>= 10;
+
+        q[i] = value * PACK_RANGE / PACK_MAX;
+        sum += q[i] * q[i];
+    }
+
+    q[largest] = sum < 1 ? sqrtf(1 - sum) : 0;
+}
+
+Mahony::Mahony(float kp, float ki, float accelGate)
+{
+    this->kp = kp;
+    this->ki = ki;
+    gateLow = (1 - accelGate) * (1 - accelGate);
+    gateHigh = (1 + accelGate) * (1 + accelGate);
+
+    const float up[3] = {0, 0, 1};
+    reset(up);
+}
+
+void Mahony::reset(const float* accel)
+{
+    float norm = sqrtf(accel[0] * accel[0] + accel[1] * accel[1] + accel[2] * accel[2]);
+    float ax = accel[0] / norm;
+    float ay = accel[1] / norm;
+    float az = accel[2] / norm;
+
+    // shortest rotation from the measured gravity to z: (1 + a.z, a x z), normalized
+    if (az < -0.9999f)
+    {
+        // upside down, any half turn around a horizontal axis
+        q[0] = 0; q[1] = 1; q[2] = 0; q[3] = 0;
+    }
+    else
+    {
+        float w = 1 + az;
+        float n = 1 / sqrtf(w * w + ay * ay + ax * ax);
+        q[0] = w * n;
+        q[1] = ay * n;
+        q[2] = -ax * n;
+        q[3] = 0;
+    }
+
+    integral[0] = integral[1] = integral[2] = 0;
+    uncorrected = 0;
+}
+
+void Mahony::setQuaternion(const float* q)
+{
+    for (int i = 0; i < 4; i++) this->q[i] = q[i];
+
+    integral[0] = integral[1] = integral[2] = 0;
+    uncorrected = 0;
+}
+
+void Mahony::update(const float* gyro, const float* accel, float dt)
+{
+    float gx = gyro[0];
+    float gy = gyro[1];
+    float gz = gyro[2];
+
+    float q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+
+    float norm = accel[0] * accel[0] + accel[1] * accel[1] + accel[2] * accel[2];
+
+    // while accelerating the accelerometer doesn't point at gravity, so only the gyro is integrated
+    if (norm > gateLow && norm < gateHigh)
+    {
+        float recip = 1 / sqrtf(norm);
+        float ax = accel[0] * recip;
+        float ay = accel[1] * recip;
+        float az = accel[2] * recip;
+
+        // direction of gravity in the sensor frame, according to the quaternion
+        float vx = 2 * (q1 * q3 - q0 * q2);
+        float vy = 2 * (q0 * q1 + q2 * q3);
+        float vz = q0 * q0 - q1 * q1 - q2 * q2 + q3 * q3;
+
+        // error between the measured and the estimated gravity
+        float ex = ay * vz - az * vy;
+        float ey = az * vx - ax * vz;
+        float ez = ax * vy - ay * vx;
+
+        if (ki > 0)
+        {
+            integral[0] += ki * ex * dt;
+            integral[1] += ki * ey * dt;
+            integral[2] += ki * ez * dt;
+        }
+
+        gx += kp * ex + integral[0];
+        gy += kp * ey + integral[1];
+        gz += kp * ez + integral[2];
+    }
+    else
+    {
+        uncorrected++;
+        gx += integral[0];
+        gy += integral[1];
+        gz += integral[2];
+    }
+
+    // q' = q + q * (0, g) * dt / 2
+    float h = 0.5f * dt;
+    gx *= h;
+    gy *= h;
+    gz *= h;
+
+    float w = q0 + (-q1 * gx - q2 * gy - q3 * gz);
+    float x = q1 + (q0 * gx + q2 * gz - q3 * gy);
+    float y = q2 + (q0 * gy - q1 * gz + q3 * gx);
+    float z = q3 + (q0 * gz + q1 * gy - q2 * gx);
+
+    float n = 1 / sqrtf(w * w + x * x + y * y + z * z);
+    q[0] = w * n;
+    q[1] = x * n;
+    q[2] = y * n;
+    q[3] = z * n;
+}
+
+void Mahony::getQuaternion(float* q)
+{
+    for (int i = 0; i < 4; i++) q[i] = this->q[i];
+}
+
+float Mahony::vertical(const float* v)
+{
+    // last row of the rotation matrix
+    float rx = 2 * (q[1] * q[3] - q[0] * q[2]);
+    float ry = 2 * (q[0] * q[1] + q[2] * q[3]);
+    float rz = q[0] * q[0] - q[1] * q[1] - q[2] * q[2] + q[3] * q[3];
+
+    return rx * v[0] + ry * v[1] + rz * v[2];
+}
+
+uint32_t Mahony::getUncorrected()
+{
+    return uncorrected;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <cstdint>
+
+#define DEG_TO_RAD 0.017453293f
+
+// Default gains, tuned with host/ahrs_bench.cpp
+#define AHRS_KP 1.0f           // proportional gain of the accelerometer correction, 1/s
+#define AHRS_KI 0.02f          // integral gain, estimates what is left of the gyro bias, 1/s^2
+#define AHRS_ACCEL_GATE 0.1f   // the accelerometer only corrects when its magnitude is this close to 1 g
+
+/*
+    @brief Packs a unit quaternion into 32 bits: the index of the largest component (2 bits), and the other
+    three in 10 bits each. The largest one is made positive, since q and -q are the same rotation
+
+    @param q w, x, y, z
+
+    @returns the packed quaternion, about 0.1 degree resolution
+*/
+uint32_t pack_quaternion(const float* q);
+
+/*
+    @brief Reverses `pack_quaternion()`
+
+    @param packed the packed quaternion
+    @param q w, x, y, z
+*/
+void unpack_quaternion(uint32_t packed, float* q);
+
+/*
+    Attitude from the gyro and the accelerometer, with the Mahony complementary filter.
+    The gyro is integrated into a quaternion, and the accelerometer pulls its tilt towards gravity while
+    the satellite isn't accelerating. There is no magnetometer, so the heading drifts with the gyro.
+    Single precision, one update is about 60 float operations and two square roots (one for the accelerometer,
+    one to normalize the quaternion), only the second while accelerating
+*/
+class Mahony {
+    public:
+        Mahony(float kp = AHRS_KP, float ki = AHRS_KI, float accelGate = AHRS_ACCEL_GATE);
+
+        /*
+            @brief Starts over level with the given accelerometer reading, heading 0
+
+            @param accel measured acceleration at rest, in any unit
+        */
+        void reset(const float* accel);
+
+        /*
+            @brief Continues from a known attitude, like the one from before a reset
+
+            @param q w, x, y, z, see `getQuaternion()`
+        */
+        void setQuaternion(const float* q);
+
+        /*
+            @brief Integrates the gyro and corrects with the accelerometer
+
+            @param gyro angular rate in rad/s, bias removed
+            @param accel acceleration in g
+            @param dt time since the last update in s
+        */
+        void update(const float* gyro, const float* accel, float dt);
+
+        /* @param q w, x, y, z, rotates from the sensor frame into the earth frame (z up) */
+        void getQuaternion(float* q);
+
+        /*
+            @brief Projects a vector in the sensor frame onto the earth z axis
+
+            @param v vector in the sensor frame
+
+            @returns the vertical component, positive up
+        */
+        float vertical(const float* v);
+
+        /* @returns how many updates were not corrected by the accelerometer */
+        uint32_t getUncorrected();
+
+    private:
+        float q[4];
+        float integral[3];
+
+        float kp;
+        float ki;
+        float gateLow;    // accepted range of |accel|^2
+        float gateHigh;
+
+        uint32_t uncorrected;
+};
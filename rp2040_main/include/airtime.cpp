@@ -0,0 +1,57 @@
+#include "airtime.hpp"
+
+// Time of `quarterSymbols` / 4 symbols in microseconds, computed with integers so nothing is rounded until the end
+static uint32_t quarter_symbols_us(const LoRaModem& modem, uint32_t quarterSymbols)
+{
+    return (uint32_t) (((uint64_t) quarterSymbols * (1UL << modem.sf) * 1000000 + 2 * modem.bw) / (4 * (uint64_t) modem.bw));
+}
+
+uint32_t symbol_time_us(const LoRaModem& modem)
+{
+    return quarter_symbols_us(modem, 4);
+}
+
+uint32_t time_on_air_us(const LoRaModem& modem, int payloadLength)
+{
+    int de = modem.ldro ? 1 : 0;
+    int ih = modem.implicitHeader ? 1 : 0;
+    int crc = modem.crc ? 1 : 0;
+
+    // number of payload symbols: 8 + max(ceil((8PL - 4SF + 28 + 16CRC - 20IH) / (4(SF - 2DE))) * CR, 0)
+    int num = 8 * payloadLength - 4 * modem.sf + 28 + 16 * crc - 20 * ih;
+    int den = 4 * (modem.sf - 2 * de);
+    int blocks = num > 0 ? (num + den - 1) / den : 0;
+    uint32_t payloadSymbols = 8 + blocks * modem.cr;
+
+    // the preamble is the programmed length + 4.25 symbols
+    uint32_t quarterSymbols = 4 * (modem.preamble + payloadSymbols) + 17;
+
+    return quarter_symbols_us(modem, quarterSymbols);
+}
+
+int max_payload(const LoRaModem& modem, uint32_t airtimeUs)
+{
+    if (time_on_air_us(modem, 0) > airtimeUs) return -1;
+
+    // time on air grows with the payload, so the largest fitting one can be found with a binary search
+    int low = 0;
+    int high = MAX_PKT_LENGTH;
+    while (low < high)
+    {
+        int mid = (low + high + 1) / 2;
+        if (time_on_air_us(modem, mid) <= airtimeUs) low = mid;
+        else high = mid - 1;
+    }
+
+    return low;
+}
+
+long cad_preamble(const LoRaModem& modem, uint32_t intervalUs)
+{
+    uint32_t symbol = symbol_time_us(modem);
+
+    // the preamble has to last a whole interval, plus the CAD itself (about 2 symbols) and some margin
+    long symbols = (intervalUs + symbol - 1) / symbol + 4;
+
+    return symbols > 0xFFFF ? 0xFFFF : symbols;
+}
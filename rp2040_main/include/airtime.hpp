@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+
+// Largest payload of a LoRa packet, in bytes
+#define MAX_PKT_LENGTH 255
+
+/*
+    Modem settings that determine how long a packet is on air
+*/
+struct LoRaModem {
+    int sf;               // spreading factor (6-12)
+    long bw;              // signal bandwidth in Hz
+    int cr;               // coding rate denominator (4/cr, 5-8)
+    long preamble;        // programmed preamble length in symbols (the modem adds 4.25 symbols)
+    bool implicitHeader;  // no PHY header is sent
+    bool crc;             // payload CRC is sent
+    bool ldro;            // low data rate optimization
+};
+
+/*
+    @brief Returns the symbol duration of the given settings in microseconds
+*/
+uint32_t symbol_time_us(const LoRaModem& modem);
+
+/*
+    @brief Exact time on air of a packet, using the formula from the SX1276 datasheet (4.1.1.7)
+
+    @param modem the modem settings
+    @param payloadLength the length of the payload in bytes
+
+    @returns time on air in microseconds
+*/
+uint32_t time_on_air_us(const LoRaModem& modem, int payloadLength);
+
+/*
+    @brief Returns the largest payload that fits into the given time on air
+
+    @param modem the modem settings
+    @param airtimeUs the available time on air in microseconds
+
+    @returns payload length in bytes (0-255), or -1 if not even an empty packet fits
+*/
+int max_payload(const LoRaModem& modem, uint32_t airtimeUs);
+
+/*
+    @brief Preamble length needed to reach a receiver that only wakes up for a CAD every `intervalUs`
+
+    @param modem the modem settings
+    @param intervalUs time between two CADs of the receiver in microseconds
+
+    @returns preamble length in symbols, to be used with `setPreambleLength()`
+*/
+long cad_preamble(const LoRaModem& modem, uint32_t intervalUs);
@@ -0,0 +1,156 @@
+#include "altitude_kf.hpp"
+#include <cmath>
+
+// covariance of the starting state
+#define INITIAL_VARIANCE 100.0f
+
+float pressure_altitude(float pressure, float reference)
+{
+    return 44330.0f * (1.0f - powf(pressure / reference, 1.0f / 5.255f));
+}
+
+AltitudeFilter::AltitudeFilter(float jerkNoise, float baroNoise, float accelNoise)
+{
+    this->jerkNoise = jerkNoise;
+    baroVar = baroNoise * baroNoise;
+    accelVar = accelNoise * accelNoise;
+
+    reset();
+}
+
+void AltitudeFilter::reset(float altitude, float velocity)
+{
+    x[0] = altitude;
+    x[1] = velocity;
+    x[2] = 0;
+
+    p[0] = INITIAL_VARIANCE; p[1] = 0; p[2] = 0;
+    p[3] = INITIAL_VARIANCE; p[4] = 0;
+    p[5] = INITIAL_VARIANCE;
+
+    lastDt = -1;
+    rejected = 0;
+    rejectedInRow = 0;
+}
+
+void AltitudeFilter::predict(float dt)
+{
+    float hdt = 0.5f * dt * dt;
+
+    // process noise of white jerk, integrated over dt
+    if (dt != lastDt)
+    {
+        float dt2 = dt * dt;
+        float dt3 = dt2 * dt;
+        q[0] = jerkNoise * dt3 * dt2 / 20;
+        q[1] = jerkNoise * dt2 * dt2 / 8;
+        q[2] = jerkNoise * dt3 / 6;
+        q[3] = jerkNoise * dt3 / 3;
+        q[4] = jerkNoise * dt2 / 2;
+        q[5] = jerkNoise * dt;
+        lastDt = dt;
+    }
+
+    x[0] += dt * x[1] + hdt * x[2];
+    x[1] += dt * x[2];
+
+    // P = F P F^T + Q, with F = [1 dt dt^2/2; 0 1 dt; 0 0 1]
+    float r00 = p[0] + dt * p[1] + hdt * p[2];
+    float r01 = p[1] + dt * p[3] + hdt * p[4];
+    float r02 = p[2] + dt * p[4] + hdt * p[5];
+    float r11 = p[3] + dt * p[4];
+    float r12 = p[4] + dt * p[5];
+
+    p[0] = r00 + dt * r01 + hdt * r02 + q[0];
+    p[1] = r01 + dt * r02 + q[1];
+    p[2] = r02 + q[2];
+    p[3] = r11 + dt * r12 + q[3];
+    p[4] = r12 + q[4];
+    p[5] = p[5] + q[5];
+}
+
+void AltitudeFilter::updateAccel(float accel)
+{
+    static const float h[3] = {0, 0, 1};
+    update(h, accel, accelVar, 0);
+}
+
+bool AltitudeFilter::updateBaro(float altitude, float age)
+{
+    // the altitude `age` seconds ago, going back along the current velocity and acceleration
+    float h[3] = {1, -age, 0.5f * age * age};
+
+    // pressure spikes at ejection or in the wake of the rocket are ignored
+    if (update(h, altitude, baroVar, KF_BARO_GATE))
+    {
+        rejectedInRow = 0;
+        return true;
+    }
+
+    rejected++;
+    if (++rejectedInRow < KF_MAX_REJECTS) return false;
+
+    // an acceleration the IMU didn't see (clipping, impact) pushed the state off, so the state is trusted no more
+    p[0] = INITIAL_VARIANCE; p[1] = 0; p[2] = 0;
+    p[3] = INITIAL_VARIANCE; p[4] = 0;
+    p[5] = INITIAL_VARIANCE;
+    update(h, altitude, baroVar, 0);
+    rejectedInRow = 0;
+
+    return true;
+}
+
+float AltitudeFilter::getAltitude()
+{
+    return x[0];
+}
+
+float AltitudeFilter::getVelocity()
+{
+    return x[1];
+}
+
+float AltitudeFilter::getAcceleration()
+{
+    return x[2];
+}
+
+uint32_t AltitudeFilter::getRejected()
+{
+    return rejected;
+}
+
+// Scalar measurement z = h x + noise with variance r, so no matrix has to be inverted.
+// Measurements more than `gate` standard deviations off are rejected, unless `gate` is 0
+bool AltitudeFilter::update(const float* h, float z, float r, float gate)
+{
+    // P h
+    float ph0 = p[0] * h[0] + p[1] * h[1] + p[2] * h[2];
+    float ph1 = p[1] * h[0] + p[3] * h[1] + p[4] * h[2];
+    float ph2 = p[2] * h[0] + p[4] * h[1] + p[5] * h[2];
+
+    float s = h[0] * ph0 + h[1] * ph1 + h[2] * ph2 + r;
+    float innovation = z - (h[0] * x[0] + h[1] * x[1] + h[2] * x[2]);
+    if (gate > 0 && innovation * innovation > gate * gate * s) return false;
+
+    float inv = 1.0f / s;
+    innovation *= inv;
+
+    x[0] += ph0 * innovation;
+    x[1] += ph1 * innovation;
+    x[2] += ph2 * innovation;
+
+    // P -= P h h^T P / s
+    float k0 = ph0 * inv;
+    float k1 = ph1 * inv;
+    float k2 = ph2 * inv;
+
+    p[0] -= k0 * ph0;
+    p[1] -= k0 * ph1;
+    p[2] -= k0 * ph2;
+    p[3] -= k1 * ph1;
+    p[4] -= k1 * ph2;
+    p[5] -= k2 * ph2;
+
+    return true;
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <cstdint>
+
+#define STANDARD_GRAVITY 9.80665f
+
+// Default noise, tuned with host/kf_bench.cpp
+#define KF_JERK_NOISE 50.0f      // spectral density of the jerk, (m/s^3)^2/Hz
+#define KF_BARO_NOISE 0.5f       // standard deviation of the pressure altitude, m
+#define KF_ACCEL_NOISE 3.0f      // standard deviation of the vertical acceleration, m/s^2, covers vibration and bias as well
+#define KF_BARO_GATE 5.0f        // pressure altitudes further than this many standard deviations off are ignored
+#define KF_MAX_REJECTS 25        // after this many rejected in a row the filter is the one that is off, and starts over from the barometer
+
+/*
+    @brief Altitude from pressure, with the international barometric formula
+
+    @param pressure in Pa
+    @param reference pressure at altitude 0, in Pa
+
+    @returns altitude above the reference in m
+*/
+float pressure_altitude(float pressure, float reference);
+
+/*
+    Kalman filter of the vertical motion, with altitude, vertical velocity and acceleration as the state.
+    Accelerometer samples update it at the IMU rate and pressure altitudes at the barometer rate.
+    Single precision and written out for the 3x3 case, so one IMU step only takes a few dozen float operations
+*/
+class AltitudeFilter {
+    public:
+        AltitudeFilter(float jerkNoise = KF_JERK_NOISE, float baroNoise = KF_BARO_NOISE, float accelNoise = KF_ACCEL_NOISE);
+
+        /* @brief Starts over at the given altitude and vertical velocity (m/s), at rest unless it is given */
+        void reset(float altitude = 0, float velocity = 0);
+
+        /*
+            @brief Moves the state forward in time, with constant acceleration
+
+            @param dt time step in s
+        */
+        void predict(float dt);
+
+        /*
+            @brief Updates with a vertical acceleration (gravity removed, positive up)
+
+            @param accel in m/s^2
+        */
+        void updateAccel(float accel);
+
+        /*
+            @brief Updates with a pressure altitude that was measured some time ago, since the barometer is read in batches
+
+            @param altitude in m
+            @param age how long ago it was measured, in s
+
+            @returns false if the measurement was rejected as an outlier
+        */
+        bool updateBaro(float altitude, float age = 0);
+
+        float getAltitude();
+        float getVelocity();
+        float getAcceleration();
+
+        /* @returns how many pressure altitudes were rejected */
+        uint32_t getRejected();
+
+    private:
+        bool update(const float* h, float z, float r, float gate);
+
+        float x[3];     // altitude, velocity, acceleration
+        float p[6];     // upper triangle of the covariance: 00 01 02 11 12 22
+
+        float jerkNoise;
+        float baroVar;
+        float accelVar;
+
+        // process noise for the last dt, which is usually the same every step
+        float lastDt;
+        float q[6];
+
+        uint32_t rejected;
+        int rejectedInRow;
+};
@@ -0,0 +1,187 @@
+#include "bmp390.hpp"
+
+calib_data _calib_data;
+calib_data_int _calib_data_int;
+
+void parse_calib_data(const uint8_t* reg_data) {
+    auto u16 = [](uint8_t msb, uint8_t lsb) { return (uint16_t)(((uint16_t)msb << 8) | lsb); };
+
+    uint16_t par_t1_u = u16(reg_data[1], reg_data[0]);
+    uint16_t par_t2_u = u16(reg_data[3], reg_data[2]);
+    int8_t   par_t3_s = (int8_t)reg_data[4];
+
+    int16_t  par_p1_s = (int16_t)u16(reg_data[6], reg_data[5]);
+    int16_t  par_p2_s = (int16_t)u16(reg_data[8], reg_data[7]);
+    int8_t   par_p3_s = (int8_t)reg_data[9];
+    int8_t   par_p4_s = (int8_t)reg_data[10];
+    uint16_t par_p5_u = u16(reg_data[12], reg_data[11]);
+    uint16_t par_p6_u = u16(reg_data[14], reg_data[13]);
+    int8_t   par_p7_s = (int8_t)reg_data[15];
+    int8_t   par_p8_s = (int8_t)reg_data[16];
+    int16_t  par_p9_s = (int16_t)u16(reg_data[18], reg_data[17]);
+    int8_t   par_p10_s = (int8_t)reg_data[19];
+    int8_t   par_p11_s = (int8_t)reg_data[20];
+
+    _calib_data.par_t1 = (double)par_t1_u / 0.00390625f;
+    _calib_data.par_t2 = (double)par_t2_u / 1073741824.0f;
+    _calib_data.par_t3 = (double)par_t3_s / 281474976710656.0f;
+
+    _calib_data.par_p1 = ((double)par_p1_s - 16384.0) / 1048576.0f;
+    _calib_data.par_p2 = ((double)par_p2_s - 16384.0) / 536870912.0f;
+    _calib_data.par_p3 = (double)par_p3_s / 4294967296.0f;
+    _calib_data.par_p4 = (double)par_p4_s / 137438953472.0f;
+    _calib_data.par_p5 = (double)par_p5_u / 0.125f;
+    _calib_data.par_p6 = (double)par_p6_u / 64.0f;
+    _calib_data.par_p7 = (double)par_p7_s / 256.0f;
+    _calib_data.par_p8 = (double)par_p8_s / 32768.0f;
+    _calib_data.par_p9 = (double)par_p9_s / 281474976710656.0f;
+    _calib_data.par_p10 = (double)par_p10_s / 281474976710656.0f;
+    _calib_data.par_p11 = (double)par_p11_s / 36893488147419103232.0f;
+
+    _calib_data_int.par_t1 = par_t1_u;
+    _calib_data_int.par_t2 = par_t2_u;
+    _calib_data_int.par_t3 = par_t3_s;
+    _calib_data_int.par_p1 = par_p1_s;
+    _calib_data_int.par_p2 = par_p2_s;
+    _calib_data_int.par_p3 = par_p3_s;
+    _calib_data_int.par_p4 = par_p4_s;
+    _calib_data_int.par_p5 = par_p5_u;
+    _calib_data_int.par_p6 = par_p6_u;
+    _calib_data_int.par_p7 = par_p7_s;
+    _calib_data_int.par_p8 = par_p8_s;
+    _calib_data_int.par_p9 = par_p9_s;
+    _calib_data_int.par_p10 = par_p10_s;
+    _calib_data_int.par_p11 = par_p11_s;
+    _calib_data_int.t_lin = 0;
+    _calib_data_int.uncomp_temp = UINT32_MAX; // nothing compensated yet
+    _calib_data_int.temperature = 0;
+}
+
+double compensate_temperature(uint32_t uncomp_temp) {
+    double partial_data1 = (double)(uncomp_temp - _calib_data.par_t1);
+    double partial_data2 = (double)(partial_data1 * _calib_data.par_t2);
+    _calib_data.t_lin = partial_data2 + (partial_data1 * partial_data1) * _calib_data.par_t3;
+    return _calib_data.t_lin;
+}
+
+double compensate_pressure(uint32_t uncomp_press) {
+    double partial_data1 = _calib_data.par_p6 * _calib_data.t_lin;
+    double partial_data2 = _calib_data.par_p7 * (_calib_data.t_lin * _calib_data.t_lin);
+    double partial_data3 = _calib_data.par_p8 * (_calib_data.t_lin * _calib_data.t_lin * _calib_data.t_lin);
+    double partial_out1 = _calib_data.par_p5 + partial_data1 + partial_data2 + partial_data3;
+
+    partial_data1 = _calib_data.par_p2 * _calib_data.t_lin;
+    partial_data2 = _calib_data.par_p3 * (_calib_data.t_lin * _calib_data.t_lin);
+    partial_data3 = _calib_data.par_p4 * (_calib_data.t_lin * _calib_data.t_lin * _calib_data.t_lin);
+    double partial_out2 = (double)uncomp_press * (_calib_data.par_p1 + partial_data1 + partial_data2 + partial_data3);
+    
+    partial_data1 = (double)uncomp_press * (double)uncomp_press;
+    double partial_data_p9_p10 = _calib_data.par_p9 + _calib_data.par_p10 * _calib_data.t_lin;
+    double partial_data3_calc = partial_data1 * partial_data_p9_p10;
+    double partial_data4 = partial_data3_calc + ((double)uncomp_press * (double)uncomp_press * (double)uncomp_press) * _calib_data.par_p11;
+
+    return partial_out1 + partial_out2 + partial_data4;
+}
+
+// Integer compensation from the Bosch BMP3 API. Every division but one is by a power of 2, so they compile to shifts.
+// The 64 bit multiplications and the division by 10 are the only library calls left (the latter uses the hardware divider)
+int32_t compensate_temperature_int(uint32_t uncomp_temp) {
+    const calib_data_int& c = _calib_data_int;
+
+    int64_t partial_data1 = (int64_t)uncomp_temp - (int64_t)256 * c.par_t1;
+    int64_t partial_data2 = (int64_t)c.par_t2 * partial_data1;
+    int64_t partial_data3 = partial_data1 * partial_data1;
+    int64_t partial_data4 = partial_data3 * c.par_t3;
+    int64_t partial_data5 = partial_data2 * 262144 + partial_data4;
+
+    _calib_data_int.t_lin = partial_data5 / 4294967296;
+    _calib_data_int.uncomp_temp = uncomp_temp;
+    _calib_data_int.temperature = (int32_t)((_calib_data_int.t_lin * 25) / 16384);
+
+    return _calib_data_int.temperature;
+}
+
+uint32_t compensate_pressure_int(uint32_t uncomp_press) {
+    const calib_data_int& c = _calib_data_int;
+    int64_t t_lin = c.t_lin;
+    int64_t press = uncomp_press;
+
+    int64_t partial_data1 = t_lin * t_lin;
+    int64_t partial_data2 = partial_data1 / 64;
+    int64_t partial_data3 = (partial_data2 * t_lin) / 256;
+    int64_t partial_data4 = (c.par_p8 * partial_data3) / 32;
+    int64_t partial_data5 = (c.par_p7 * partial_data1) * 16;
+    int64_t partial_data6 = (c.par_p6 * t_lin) * 4194304;
+    int64_t offset = (int64_t)c.par_p5 * 140737488355328 + partial_data4 + partial_data5 + partial_data6;
+
+    partial_data2 = (c.par_p4 * partial_data3) / 32;
+    partial_data4 = (c.par_p3 * partial_data1) * 4;
+    partial_data5 = ((int64_t)c.par_p2 - 16384) * t_lin * 2097152;
+    int64_t sensitivity = ((int64_t)c.par_p1 - 16384) * 70368744177664 + partial_data2 + partial_data4 + partial_data5;
+
+    partial_data1 = (sensitivity / 16777216) * press;
+    partial_data2 = (int64_t)c.par_p10 * t_lin;
+    partial_data3 = partial_data2 + 65536 * (int64_t)c.par_p9;
+    partial_data4 = (partial_data3 * press) / 8192;
+
+    // split up, so the intermediate values don't overflow
+    partial_data5 = (press * (partial_data4 / 10)) / 512;
+    partial_data5 = partial_data5 * 10;
+    partial_data6 = press * press;
+    partial_data2 = ((int64_t)c.par_p11 * partial_data6) / 65536;
+    partial_data3 = (partial_data2 * press) / 128;
+    partial_data4 = offset / 4 + partial_data1 + partial_data5 + partial_data3;
+
+    return (uint32_t)(((uint64_t)partial_data4 * 25) / 1099511627776);
+}
+
+int parse_fifo_frames(const uint8_t* data, int length, baro_frame* frames, int max) {
+    auto u24 = [](const uint8_t* d) { return (uint32_t)d[2] << 16 | (uint32_t)d[1] << 8 | d[0]; };
+
+    int count = 0;
+    int i = 0;
+    while (i < length && count < max) {
+        uint8_t header = data[i++];
+
+        int size;
+        switch (header) {
+            case BMP_FIFO_TEMP_PRESS_FRAME:
+                if (i + 6 > length) return count;
+                frames[count].uncomp_temp = u24(data + i);
+                frames[count].uncomp_press = u24(data + i + 3);
+                count++;
+                size = 6;
+                break;
+            case BMP_FIFO_TEMP_FRAME:
+            case BMP_FIFO_PRESS_FRAME:
+            case BMP_FIFO_TIME_FRAME:
+                size = 3;
+                break;
+            case BMP_FIFO_EMPTY_FRAME:
+            case BMP_FIFO_CONFIG_CHANGE:
+            case BMP_FIFO_CONFIG_ERROR:
+                size = 1;
+                break;
+            default:
+                // unknown header, the rest can't be parsed
+                return count;
+        }
+
+        i += size;
+    }
+
+    return count;
+}
+
+void compensate_batch(const baro_frame* frames, baro_sample* samples, int n) {
+    const calib_data_int& c = _calib_data_int;
+
+    // t_lin of the last compensated temperature is still in _calib_data_int, it only has to be updated on a change
+    for (int i = 0; i < n; i++) {
+        if (frames[i].uncomp_temp != c.uncomp_temp) compensate_temperature_int(frames[i].uncomp_temp);
+
+        samples[i].time_us = frames[i].time_us;
+        samples[i].temperature = c.temperature;
+        samples[i].pressure = compensate_pressure_int(frames[i].uncomp_press);
+    }
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include <cstdint>
+
+// Pressure/temperature compensation of the BMP390, without any I/O, so it can be used on the host as well.
+// The double path is the reference from the datasheet, the integer path is the one used on the RP2040,
+// which has no FPU. The integer path stays within 0.02 Pa and 0.01 C of the reference (see host/bmp_bench.cpp)
+
+struct calib_data {
+    double par_t1;
+    double par_t2;
+    double par_t3;
+    double par_p1;
+    double par_p2;
+    double par_p3;
+    double par_p4;
+    double par_p5;
+    double par_p6;
+    double par_p7;
+    double par_p8;
+    double par_p9;
+    double par_p10;
+    double par_p11;
+    double t_lin;
+};
+
+// Calibration coefficients as stored in the NVM, for the integer path
+struct calib_data_int {
+    uint16_t par_t1;
+    uint16_t par_t2;
+    int8_t par_t3;
+    int16_t par_p1;
+    int16_t par_p2;
+    int8_t par_p3;
+    int8_t par_p4;
+    uint16_t par_p5;
+    uint16_t par_p6;
+    int8_t par_p7;
+    int8_t par_p8;
+    int16_t par_p9;
+    int8_t par_p10;
+    int8_t par_p11;
+    int64_t t_lin;
+    uint32_t uncomp_temp; // the raw temperature t_lin belongs to
+    int32_t temperature;
+};
+
+extern calib_data _calib_data;
+extern calib_data_int _calib_data_int;
+
+// parses the 21 bytes read from BMP3_REG_CALIB_DATA into both calibration structs
+void parse_calib_data(const uint8_t* reg_data);
+
+// reference path, temperature in C, pressure in Pa
+double compensate_temperature(uint32_t uncomp_temp);
+double compensate_pressure(uint32_t uncomp_press);
+
+// integer path, temperature in 0.01 C, pressure in 0.01 Pa. Temperature has to be compensated first
+int32_t compensate_temperature_int(uint32_t uncomp_temp);
+uint32_t compensate_pressure_int(uint32_t uncomp_press);
+
+// FIFO frame headers
+#define BMP_FIFO_TEMP_PRESS_FRAME 0x94
+#define BMP_FIFO_TEMP_FRAME 0x90
+#define BMP_FIFO_PRESS_FRAME 0x84
+#define BMP_FIFO_TIME_FRAME 0xA0
+#define BMP_FIFO_EMPTY_FRAME 0x80
+#define BMP_FIFO_CONFIG_CHANGE 0x48
+#define BMP_FIFO_CONFIG_ERROR 0x44
+
+#define BMP_FIFO_SIZE 512
+#define BMP_FIFO_FRAME_SIZE 7 // header + 3 bytes temperature + 3 bytes pressure
+#define BMP_FIFO_MAX_FRAMES (BMP_FIFO_SIZE / BMP_FIFO_FRAME_SIZE)
+
+// raw values of one FIFO frame
+struct baro_frame {
+    uint64_t time_us;
+    uint32_t uncomp_temp;
+    uint32_t uncomp_press;
+};
+
+struct baro_sample {
+    uint64_t time_us;
+    int32_t temperature; // 0.01 C
+    uint32_t pressure; // 0.01 Pa
+};
+
+// Splits the FIFO contents into raw temperature/pressure frames, skipping the other frame types.
+// Returns the number of frames, at most `max`. `time_us` is left alone
+int parse_fifo_frames(const uint8_t* data, int length, baro_frame* frames, int max);
+
+// Integer compensation of `n` frames at once. The temperature only changes slowly,
+// so it is only compensated again when the raw value changes
+void compensate_batch(const baro_frame* frames, baro_sample* samples, int n);
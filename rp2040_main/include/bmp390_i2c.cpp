@@ -0,0 +1,187 @@
+#include "bmp390_i2c.hpp"
+#include "pico/stdlib.h"
+#include <cstring>
+
+BMP390::BMP390(i2c_inst_t* i2c, uint8_t addr) : i2c(i2c), addr(addr)
+{
+    samplePeriodUs = 5000;
+    overflows = 0;
+
+    queue = nullptr;
+    callback = nullptr;
+    draining = false;
+}
+
+bool BMP390::begin(const uint8_t* calibration)
+{
+    uint8_t id = 0;
+    if (!readRegs(BMP_CHIP_ID, &id, 1) || id != BMP_CHIP_ID_VALUE) return false;
+
+    if (calibration) std::memcpy(calib, calibration, BMP_CALIB_SIZE);
+    else
+    {
+        if (!writeReg(BMP_CMD, BMP_RST)) return false;
+        sleep_ms(10);
+
+        if (!readRegs(BMP_CALIB_DATA, calib, BMP_CALIB_SIZE)) return false;
+    }
+
+    bool allZeros = true;
+    for (int i = 0; i < BMP_CALIB_SIZE; i++)
+    {
+        if (calib[i] != 0)
+        {
+            allZeros = false;
+            break;
+        }
+    }
+    if (allZeros) return false;
+
+    parse_calib_data(calib);
+    return true;
+}
+
+const uint8_t* BMP390::getCalibration()
+{
+    return calib;
+}
+
+bool BMP390::configure(uint8_t osrPress, uint8_t osrTemp, uint8_t iir, uint8_t odr)
+{
+    // conversion time from the datasheet (3.9.2), it has to fit into one output period
+    uint32_t conversionUs = 234 + 392 + (2020u << osrPress) + 163 + (2020u << osrTemp);
+    uint32_t periodUs = 5000u << odr;
+    if (conversionUs > periodUs) return false;
+
+    // the settings can only be changed in sleep mode
+    if (!writeReg(BMP_PWR_CTRL, 0x00)) return false;
+    if (!writeReg(BMP_OSR, (osrTemp & 0x7) << 3 | (osrPress & 0x7))) return false;
+    if (!writeReg(BMP_ODR, odr & 0x1F)) return false;
+    if (!writeReg(BMP_CONF, (iir & 0x7) << 1)) return false;
+
+    samplePeriodUs = periodUs;
+    return true;
+}
+
+bool BMP390::beginFifo()
+{
+    // filtered data, no subsampling
+    if (!writeReg(BMP_FIFO_CONFIG_2, 0x01 << 3)) return false;
+    // FIFO on, pressure and temperature, no sensor time frames, overwrite when full
+    if (!writeReg(BMP_FIFO_CONFIG_1, 1 << 4 | 1 << 3 | 0x01)) return false;
+    if (!writeReg(BMP_CMD, BMP_FIFO_FLUSH)) return false;
+
+    // pressure and temperature on, normal mode
+    if (!writeReg(BMP_PWR_CTRL, 0x3 << 4 | 0x3)) return false;
+
+    uint8_t err = 0;
+    if (!readRegs(BMP_ERR_REG, &err, 1)) return false;
+    return (err & 0x07) == 0;
+}
+
+int BMP390::drainFifo(baro_sample* samples, int max)
+{
+    uint8_t lengthData[2];
+    if (!readRegs(BMP_FIFO_LENGTH, lengthData, 2)) return -1;
+    uint64_t now = time_us_64();
+
+    int length = fifoLength(lengthData);
+    if (length == 0) return 0;
+
+    // everything in one burst, the FIFO data register doesn't auto increment
+    uint8_t data[BMP_FIFO_SIZE];
+    if (!readRegs(BMP_FIFO_DATA, data, length)) return -1;
+
+    baro_frame frames[BMP_FIFO_MAX_FRAMES];
+    int n = unpackFifo(data, length, now, frames, max < BMP_FIFO_MAX_FRAMES ? max : BMP_FIFO_MAX_FRAMES);
+
+    compensate_batch(frames, samples, n);
+    return n;
+}
+
+void BMP390::drainAsync(I2CQueue* queue, baro_callback_t callback)
+{
+    this->callback = callback;
+    this->queue = queue;
+}
+
+bool BMP390::startDrain()
+{
+    if (!queue || draining) return false;
+
+    draining = true;
+    if (!queue->read(addr, BMP_FIFO_LENGTH, drainLengthData, 2, onLength, this))
+    {
+        draining = false;
+        return false;
+    }
+
+    return true;
+}
+
+int BMP390::fifoLength(const uint8_t* lengthData)
+{
+    int length = (lengthData[1] & 0x01) << 8 | lengthData[0];
+    if (length > BMP_FIFO_SIZE - BMP_FIFO_FRAME_SIZE) overflows++;
+
+    return length;
+}
+
+int BMP390::unpackFifo(const uint8_t* data, int length, uint64_t readUs, baro_frame* frames, int max)
+{
+    baro_frame all[BMP_FIFO_MAX_FRAMES];
+    int n = parse_fifo_frames(data, length, all, BMP_FIFO_MAX_FRAMES);
+
+    // only the newest frames are kept if they don't all fit
+    int skip = n > max ? n - max : 0;
+    n -= skip;
+
+    for (int i = 0; i < n; i++)
+    {
+        frames[i] = all[skip + i];
+        frames[i].time_us = readUs - (uint64_t) (n - 1 - i) * samplePeriodUs;
+    }
+
+    return n;
+}
+
+void BMP390::onLength(int result, void* ctx)
+{
+    BMP390* baro = (BMP390*) ctx;
+    baro->drainReadUs = time_us_64();
+
+    int length = result < 0 ? 0 : baro->fifoLength(baro->drainLengthData);
+    if (length == 0 || !baro->queue->read(baro->addr, BMP_FIFO_DATA, baro->drainData, length, onData, baro)) baro->draining = false;
+}
+
+void BMP390::onData(int result, void* ctx)
+{
+    BMP390* baro = (BMP390*) ctx;
+
+    int n = result < 0 ? 0 : baro->unpackFifo(baro->drainData, result, baro->drainReadUs, baro->drainFrames, BMP_FIFO_MAX_FRAMES);
+    baro->draining = false;
+
+    if (n > 0 && baro->callback) baro->callback(baro->drainFrames, n);
+}
+
+uint32_t BMP390::getSamplePeriod()
+{
+    return samplePeriodUs;
+}
+
+uint32_t BMP390::getOverflows()
+{
+    return overflows;
+}
+
+bool BMP390::writeReg(uint8_t reg, uint8_t val)
+{
+    uint8_t buff[] = {reg, val};
+    return i2c_write_blocking(i2c, addr, buff, 2, false) == 2;
+}
+
+bool BMP390::readRegs(uint8_t reg, uint8_t* data, int length)
+{
+    if (i2c_write_blocking(i2c, addr, &reg, 1, true) != 1) return false;
+    return i2c_read_blocking(i2c, addr, data, length, false) == length;
+}
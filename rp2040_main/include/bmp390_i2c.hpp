@@ -0,0 +1,147 @@
+#pragma once
+#include <cstdint>
+#include "hardware/i2c.h"
+#include "bmp390.hpp"
+#include "i2c_queue.hpp"
+
+#define BMP_CHIP_ID 0x00
+#define BMP_ERR_REG 0x02
+#define BMP_FIFO_LENGTH 0x12
+#define BMP_FIFO_DATA 0x14
+#define BMP_FIFO_CONFIG_1 0x17
+#define BMP_FIFO_CONFIG_2 0x18
+#define BMP_PWR_CTRL 0x1B
+#define BMP_OSR 0x1C
+#define BMP_ODR 0x1D
+#define BMP_CONF 0x1F
+#define BMP_CALIB_DATA 0x31
+#define BMP_CALIB_SIZE 21
+#define BMP_CMD 0x7E
+
+#define BMP_CHIP_ID_VALUE 0x60
+#define BMP_RST 0xB6
+#define BMP_FIFO_FLUSH 0xB0
+
+// oversampling: x1 << osr, 0-5
+#define BMP_OSR_X1 0
+#define BMP_OSR_X2 1
+#define BMP_OSR_X4 2
+#define BMP_OSR_X8 3
+#define BMP_OSR_X16 4
+#define BMP_OSR_X32 5
+
+// IIR filter coefficient: 0 (off), 1, 3, 7, 15, 31, 63, 127
+#define BMP_IIR_OFF 0
+#define BMP_IIR_1 1
+#define BMP_IIR_3 2
+#define BMP_IIR_7 3
+#define BMP_IIR_15 4
+
+// output data rate: 200 Hz >> odr, 0-17
+#define BMP_ODR_200_HZ 0
+#define BMP_ODR_100_HZ 1
+#define BMP_ODR_50_HZ 2
+#define BMP_ODR_25_HZ 3
+#define BMP_ODR_12_5_HZ 4
+
+// Receives the frames drained in the background, oldest first, to be compensated with `compensate_batch()`.
+// Called from the I2C interrupt
+typedef void (*baro_callback_t)(const baro_frame* frames, int n);
+
+/*
+    Driver of the BMP390 on the I2C bus, reading it through its FIFO
+*/
+class BMP390 {
+    public:
+        BMP390(i2c_inst_t* i2c, uint8_t addr);
+
+        /*
+            @brief Resets the sensor and reads its calibration data. With the calibration data of an earlier `begin()`
+            only the chip id is checked, which saves the 10 ms of the reset
+
+            @param calibration BMP_CALIB_SIZE bytes from `getCalibration()`, or nullptr
+
+            @returns true if the sensor answered with the right chip id and the calibration data is valid
+        */
+        bool begin(const uint8_t* calibration = nullptr);
+
+        /* @returns the BMP_CALIB_SIZE bytes of calibration data read by `begin()`, see `parse_calib_data()` */
+        const uint8_t* getCalibration();
+
+        /*
+            @brief Sets oversampling, IIR filter and output data rate. Puts the sensor to sleep, call `beginFifo()` after it
+
+            @param osrPress pressure oversampling, BMP_OSR_*
+            @param osrTemp temperature oversampling, BMP_OSR_*
+            @param iir IIR filter coefficient, BMP_IIR_*
+            @param odr output data rate, BMP_ODR_*
+
+            @returns false if the conversion doesn't fit into the output data rate, or on I2C errors
+        */
+        bool configure(uint8_t osrPress, uint8_t osrTemp, uint8_t iir, uint8_t odr);
+
+        /*
+            @brief Starts measuring continuously into the FIFO. When it is full the oldest frames are overwritten
+
+            @returns true if the sensor accepted the configuration
+        */
+        bool beginFifo();
+
+        /*
+            @brief Reads the whole FIFO in one burst and compensates the frames in it.
+            The newest frame is timestamped with the time of the read, the others one output period apart
+
+            @param samples where the samples are stored, oldest first
+            @param max the size of `samples`, if there are more frames only the newest ones are kept
+
+            @returns number of samples, or -1 on error
+        */
+        int drainFifo(baro_sample* samples, int max);
+
+        /*
+            @brief From now on the FIFO is read in the background through `queue`, every time `startDrain()` is called.
+            `drainFifo()` must not be used anymore
+
+            @param queue the queue of the bus the sensor is on, it has to be started already
+            @param callback called from the I2C interrupt with the raw frames
+        */
+        void drainAsync(I2CQueue* queue, baro_callback_t callback);
+
+        /*
+            @brief Queues the reads of the FIFO, returns immediately
+
+            @returns false if the previous drain isn't done yet or the queue is full
+        */
+        bool startDrain();
+
+        /* @returns the time between two samples, in microseconds */
+        uint32_t getSamplePeriod();
+
+        /* @returns how many times the FIFO was found full, frames were lost each time */
+        uint32_t getOverflows();
+
+    private:
+        bool writeReg(uint8_t reg, uint8_t val);
+        bool readRegs(uint8_t reg, uint8_t* data, int length);
+        int fifoLength(const uint8_t* lengthData);
+        int unpackFifo(const uint8_t* data, int length, uint64_t readUs, baro_frame* frames, int max);
+
+        static void onLength(int result, void* ctx);
+        static void onData(int result, void* ctx);
+
+        i2c_inst_t* i2c;
+        uint8_t addr;
+
+        uint8_t calib[BMP_CALIB_SIZE];
+        uint32_t samplePeriodUs;
+        uint32_t overflows;
+
+        // background draining
+        I2CQueue* queue;
+        baro_callback_t callback;
+        volatile bool draining;
+        uint8_t drainLengthData[2];
+        uint64_t drainReadUs;
+        uint8_t drainData[BMP_FIFO_SIZE];
+        baro_frame drainFrames[BMP_FIFO_MAX_FRAMES];
+};
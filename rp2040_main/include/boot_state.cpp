@@ -0,0 +1,52 @@
+#include "boot_state.hpp"
+#include "log_dump.hpp"
+#include "pico/stdlib.h"
+#include <cstddef>
+#include <cstring>
+
+// not zeroed by the startup code, survives everything but a power loss
+static warm_state __uninitialized_ram(saved_state);
+
+bool warm_state_load(warm_state& state)
+{
+    state = saved_state;
+    return state.magic == WARM_STATE_MAGIC && state.crc == crc32((const uint8_t*) &state, offsetof(warm_state, crc));
+}
+
+void warm_state_save(const warm_state& state)
+{
+    saved_state = state;
+    saved_state.magic = WARM_STATE_MAGIC;
+    saved_state.crc = crc32((const uint8_t*) &saved_state, offsetof(warm_state, crc));
+}
+
+void warm_state_clear()
+{
+    saved_state.magic = 0;
+}
+
+bool boot_cache_load(FlashMemory* flash, boot_cache& cache)
+{
+    std::memcpy(&cache, flash->read(0), sizeof(cache));
+    return cache.magic == BOOT_CACHE_MAGIC && cache.crc == crc32((const uint8_t*) &cache, offsetof(boot_cache, crc));
+}
+
+bool boot_cache_save(FlashMemory* flash, const boot_cache& cache)
+{
+    static_assert(sizeof(boot_cache) <= FLASH_PAGE_BYTES, "the boot cache has to fit into a page");
+
+    uint8_t page[FLASH_PAGE_BYTES];
+    std::memset(page, 0xFF, sizeof(page));
+    std::memcpy(page, &cache, sizeof(cache));
+
+    boot_cache* stored = (boot_cache*) page;
+    stored->magic = BOOT_CACHE_MAGIC;
+    stored->crc = crc32(page, offsetof(boot_cache, crc));
+
+    // every write wears the sector, and the calibration is the same on most startups
+    if (std::memcmp(flash->read(0), page, sizeof(cache)) == 0) return false;
+
+    flash->erase(0);
+    flash->program(0, page);
+    return true;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <cstdint>
+#include "flash.hpp"
+#include "bmp390_i2c.hpp"
+
+#define WARM_STATE_MAGIC 0x4D524157 // "WARM"
+#define BOOT_CACHE_MAGIC 0x48434342 // "BCCH"
+
+/*
+    What is needed to carry on with a flight after a reset that kept the RAM powered: the watchdog, a crash, or a
+    brown-out that was short enough. Kept in RAM the startup code doesn't clear, so after a power-on it is garbage,
+    which the CRC tells apart from a saved state
+*/
+struct warm_state {
+    uint32_t magic;
+    uint8_t phase;          // flight_phase_t
+    uint8_t profile;        // radio profile in use
+    uint8_t frameSize;      // report frame size the ground station expects, see Comm::getAnnouncedFrameSize()
+    uint8_t gpsBinary;      // the GPS was switched to UBX
+    uint32_t phaseAgeUs;    // how long the phase had lasted
+    uint32_t reportGroups;  // groups of report fields the ground station knows the structure of
+    float altitude;         // m above the launch site
+    float velocity;         // vertical, m/s
+    float attitude[4];      // w, x, y, z
+    uint32_t crc;           // CRC-32 of everything before
+};
+
+/*
+    What is measured at startup, kept in flash so it doesn't have to be measured again after a warm reset,
+    when the satellite isn't at rest. Only valid for the measurement ranges it was taken with
+*/
+struct boot_cache {
+    uint32_t magic;
+    float gyroBias[3];          // dps
+    float padAccel[3];          // g
+    float gravity;              // g
+    float referencePressure;    // hPa
+    uint8_t afsSel;
+    uint8_t fsSel;
+    uint8_t bmpCalib[BMP_CALIB_SIZE];
+    uint8_t reserved;
+    uint32_t crc;               // CRC-32 of everything before
+};
+
+/*
+    @brief Reads the state saved before the last reset
+
+    @param state where the state is stored
+
+    @returns false after a power-on, or if nothing was saved since
+*/
+bool warm_state_load(warm_state& state);
+
+/*
+    @brief Saves the state for the next reset, a few microseconds. Not interrupt safe, the caller has to disable them
+
+    @param state `magic` and `crc` are filled in
+*/
+void warm_state_save(const warm_state& state);
+
+/* @brief Forgets the saved state, the next reset starts over */
+void warm_state_clear();
+
+/*
+    @brief Reads the cache from the start of `flash`
+
+    @returns false if the flash doesn't hold a valid cache
+*/
+bool boot_cache_load(FlashMemory* flash, boot_cache& cache);
+
+/*
+    @brief Writes the cache to the start of `flash`, unless it is there already. Erases a sector,
+    so it stops both cores for about 45 ms
+
+    @param cache `magic` and `crc` are filled in
+
+    @returns true if the flash was written
+*/
+bool boot_cache_save(FlashMemory* flash, const boot_cache& cache);
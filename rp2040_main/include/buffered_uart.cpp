@@ -0,0 +1,130 @@
+#include "buffered_uart.hpp"
+#include "hardware/gpio.h"
+#include "hardware/irq.h"
+#include "pico/stdlib.h"
+
+BufferedUart* BufferedUart::instances[2] = {nullptr, nullptr};
+
+BufferedUart::BufferedUart(uart_inst_t* uart)
+{
+    this->uart = uart;
+    errors = 0;
+    byteUs = 0;
+    lastRxUs = 0;
+    received = 0;
+    burstCount = 0;
+    consumed = 0;
+}
+
+void BufferedUart::begin(uint baud, uint txPin, uint rxPin)
+{
+    uart_init(uart, baud);
+    byteUs = 10000000 / baud; // start, 8 data and stop bit
+    gpio_set_function(txPin, GPIO_FUNC_UART);
+    gpio_set_function(rxPin, GPIO_FUNC_UART);
+
+    // the FIFO interrupts at half full, the timeout picks up what is left after a sentence
+    uart_set_fifo_enabled(uart, true);
+
+    int index = uart_get_index(uart);
+    instances[index] = this;
+
+    int irq = index == 0 ? UART0_IRQ : UART1_IRQ;
+    irq_set_exclusive_handler(irq, index == 0 ? onIrq0 : onIrq1);
+    irq_set_enabled(irq, true);
+    uart_set_irq_enables(uart, true, false);
+}
+
+void BufferedUart::setBaudrate(uint baud)
+{
+    uart_set_baudrate(uart, baud);
+    byteUs = 10000000 / baud;
+
+    // anything in the buffer was received at the old rate
+    while (read() >= 0);
+}
+
+int BufferedUart::available()
+{
+    return rx.size();
+}
+
+int BufferedUart::read()
+{
+    uint8_t byte;
+    if (!rx.pop(byte)) return -1;
+
+    consumed++;
+    return byte;
+}
+
+uint64_t BufferedUart::getBurstTime()
+{
+    uint32_t last = consumed - 1;
+    uint32_t count = burstCount;
+
+    // the newest burst that started at or before the byte
+    for (uint32_t i = 0; i < UART_BURSTS && i < count; i++)
+    {
+        const Burst& burst = bursts[(count - 1 - i) % UART_BURSTS];
+        if ((int32_t) (last - burst.first) >= 0) return burst.timeUs;
+    }
+
+    return 0;
+}
+
+void BufferedUart::write(const uint8_t* data, int length)
+{
+    uart_write_blocking(uart, data, length);
+}
+
+void BufferedUart::flush()
+{
+    uart_tx_wait_blocking(uart);
+}
+
+uint32_t BufferedUart::getOverflows()
+{
+    return rx.getDropped();
+}
+
+uint32_t BufferedUart::getErrors()
+{
+    return errors;
+}
+
+void BufferedUart::handleIrq()
+{
+    uart_hw_t* hw = uart_get_hw(uart);
+    uint64_t now = time_us_64();
+    uint32_t first = received;
+
+    // reading the data register clears both the RX and the timeout interrupt
+    while (!(hw->fr & UART_UARTFR_RXFE_BITS))
+    {
+        uint32_t dr = hw->dr;
+        if (dr & (UART_UARTDR_FE_BITS | UART_UARTDR_PE_BITS | UART_UARTDR_BE_BITS | UART_UARTDR_OE_BITS)) errors++;
+
+        rx.push(dr & UART_UARTDR_DATA_BITS);
+        received++;
+    }
+
+    // the bytes in the FIFO came in back to back before the interrupt, the first one that long ago
+    uint64_t arrival = now - (uint64_t) (received - first) * byteUs;
+    if (arrival - lastRxUs > UART_BURST_GAP_US)
+    {
+        bursts[burstCount % UART_BURSTS] = {first, arrival};
+        burstCount++;
+    }
+    lastRxUs = now;
+}
+
+void BufferedUart::onIrq0()
+{
+    instances[0]->handleIrq();
+}
+
+void BufferedUart::onIrq1()
+{
+    instances[1]->handleIrq();
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <cstdint>
+#include "hardware/uart.h"
+#include "spsc_queue.hpp"
+
+#define UART_RX_BUFFER 512 // bytes, half a second of NMEA at 9600 baud
+#define UART_BURST_GAP_US 5000 // a pause this long starts a new burst, the GPS sends each solution in one
+#define UART_BURSTS 4 // bursts that are remembered, the reader can be this many behind
+
+/*
+    UART with an interrupt driven receive buffer. The RX FIFO interrupt (and its timeout, for the last bytes of a burst)
+    moves the received bytes into a ring buffer, so nothing polls the UART and a slow reader only loses bytes
+    once the buffer is full. The interrupt also notes when each burst of bytes started, so the reader knows when
+    what it reads arrived. Sending is blocking, it is only meant for configuration
+*/
+class BufferedUart {
+    public:
+        BufferedUart(uart_inst_t* uart);
+
+        /*
+            @brief Initializes the UART and installs the interrupt handler on the calling core
+
+            @param baud baud rate
+            @param txPin GPIO of TX
+            @param rxPin GPIO of RX
+        */
+        void begin(uint baud, uint txPin, uint rxPin);
+
+        /* @brief Changes the baud rate, the receive buffer is cleared */
+        void setBaudrate(uint baud);
+
+        /* @returns number of bytes waiting in the buffer */
+        int available();
+
+        /*
+            @brief Takes the oldest byte from the buffer
+
+            @returns the byte, or -1 if the buffer is empty
+        */
+        int read();
+
+        /*
+            @brief When the burst started that the last byte returned by `read()` came in, estimated from the
+            time of the interrupt and the bytes in the FIFO, to within a few byte times
+
+            @returns time_us_64(), 0 if it is unknown
+        */
+        uint64_t getBurstTime();
+
+        /* @brief Sends `length` bytes, and waits until they are in the TX FIFO */
+        void write(const uint8_t* data, int length);
+
+        /* @brief Waits until everything has been sent, e.g. before changing the baud rate */
+        void flush();
+
+        /* @returns how many bytes were dropped because the buffer was full */
+        uint32_t getOverflows();
+
+        /* @returns how many bytes had a framing, parity or overrun error */
+        uint32_t getErrors();
+
+    private:
+        static void onIrq0();
+        static void onIrq1();
+        void handleIrq();
+        static BufferedUart* instances[2];
+
+        struct Burst {
+            uint32_t first;     // number of the first byte
+            uint64_t timeUs;
+        };
+
+        uart_inst_t* uart;
+        SpscQueue<uint8_t, UART_RX_BUFFER> rx;
+        volatile uint32_t errors;
+
+        // interrupt
+        uint32_t byteUs;
+        uint64_t lastRxUs;
+        uint32_t received;
+        Burst bursts[UART_BURSTS];
+        volatile uint32_t burstCount;
+
+        // reader
+        uint32_t consumed;
+};
@@ -1,6 +1,7 @@
 #include <string>
 #include <cstdint>
 #include <cstring>
+#include <algorithm>
 #include <iostream>
 #include <type_traits>
 #include "comm.hpp"
@@ -36,13 +37,19 @@ int Comm::addField(std::string field, int maxLength)
     }
 }
 
+void Comm::clearFields()
+{
+    structure.clear();
+    std::memset(outBuff, 0, buffSize);
+}
+
 template <typename T>
 int Comm::setField(std::string field, T value)
 {
     // handle strings
     if constexpr (std::is_same_v<T, std::string>)
     {
-        for (int i = 0; i < PACKET_SIZE; i++)
+        for (int i = 0; i < (int) structure.size(); i++)
         {
             if (field == structure[i])
             {
@@ -57,7 +64,7 @@ int Comm::setField(std::string field, T value)
     }
     else // every other datatype
     {
-        for (int i = 0; i < PACKET_SIZE; i++)
+        for (int i = 0; i < (int) structure.size(); i++)
         {
             if (field == structure[i])
             {
@@ -101,9 +108,50 @@ T Comm::getField(std::string field)
 }
 
 int Comm::sendReport() {
+    if (implicitHAL && getReportFrameSize() > 0)
+    {
+        // announce the frame size first, the receiver can only switch to implicit headers after this
+        if (implicitSize != getReportFrameSize())
+        {
+            uint8_t size = getReportFrameSize();
+            if (sendRepeated(&size, 1, FRAME_CONF, false) < 0) return -3;
+            implicitSize = getReportFrameSize();
+            frameAcked = false;
+            unackedReports = 0;
+        }
+        // the receiver missed the announcement, or its acknowledgement was lost
+        else if (!frameAcked && ++unackedReports % FRAME_ANNOUNCE_REPORTS == 0)
+        {
+            uint8_t size = implicitSize;
+            if (fits(1, false)) sendData(&size, 1, FRAME_CONF);
+        }
+
+        if (frameAcked)
+        {
+            if (!fits(structure.size(), true)) return -3;
+            return sendImplicit(outBuff, structure.size(), REPORT);
+        }
+    }
+
+    if (!fits(structure.size(), false)) return -3;
     return sendData(outBuff, structure.size(), REPORT);
 }
 
+int Comm::sendImplicit(uint8_t* data, int dataLength, uint8_t packetType)
+{
+    if (dataLength + 4 > implicitSize) return -1;
+
+    // same header as a single transfer packet, zero padded to the frame size
+    uint8_t sendBuff[255] = { 0 };
+    sendBuff[0] = outSeqNum++ % 256;
+    sendBuff[1] = packetType;
+    sendBuff[2] = dataLength;
+    sendBuff[3] = 0;
+
+    std::memcpy(sendBuff + 4, data, dataLength);
+    return implicitHAL(sendBuff, implicitSize) < 0 ? -3 : 0;
+}
+
 int Comm::sendData(uint8_t* data, int dataLength, uint8_t packetType) {
 
     // increase buffer size, if it is needed
@@ -130,9 +178,9 @@ int Comm::sendData(uint8_t* data, int dataLength, uint8_t packetType) {
         // which packet is this a continuation of, high byte of packet size in the leading transfer packet
         sendBuff[3] = i == 0 ? ((uint16_t) dataLength & 0xFF00) >> 8 : (outSeqNum - i - 1) % 256;
 
-        // send data
+        // send data, the rest of the packet is useless without this part
         std::memcpy(sendBuff + 4, data + (i * 251), 251);
-        writeHAL(sendBuff, 255);
+        if (writeHAL(sendBuff, 255) < 0) return -3;
     }
     // Deals with remaining data
     if (dataLength < 251) {
@@ -142,8 +190,8 @@ int Comm::sendData(uint8_t* data, int dataLength, uint8_t packetType) {
         sendBuff[2] = dataLength;
         sendBuff[3] = 0;
 
-        std::memcpy(sendBuff + 4, data, dataLength + 4);
-        writeHAL(sendBuff, dataLength + 4);
+        std::memcpy(sendBuff + 4, data, dataLength);
+        if (writeHAL(sendBuff, dataLength + 4) < 0) return -3;
     }
     else if (dataLength % 251 != 0)
     {
@@ -154,12 +202,46 @@ int Comm::sendData(uint8_t* data, int dataLength, uint8_t packetType) {
 
         // Sends data
         std::memcpy(sendBuff + 4, data + dataLength - (dataLength % 251), dataLength % 251);
-        writeHAL(sendBuff, 4 + (dataLength % 251));
+        if (writeHAL(sendBuff, 4 + (dataLength % 251)) < 0) return -3;
     }
 
     return 0;
 }
 
+int Comm::sendRepeated(uint8_t* data, int dataLength, uint8_t packetType, bool implicit, int copies)
+{
+    // every copy has the same sequence number, so the receiver can drop the duplicates
+    int seqNum = outSeqNum;
+    int sent = 0;
+    for (int i = 0; i < copies && fits(dataLength, implicit); i++)
+    {
+        outSeqNum = seqNum;
+        if (implicit) sent += sendImplicit(data, dataLength, packetType) == 0;
+        else sent += sendData(data, dataLength, packetType) == 0;
+    }
+
+    if (sent == 0) return -3;
+    return sent;
+}
+
+bool Comm::fits(int dataLength, bool implicit)
+{
+    if (!budgetHAL) return true;
+
+    // the same transfer packets as sendData() and sendImplicit() make
+    std::vector<int> sizes;
+
+    if (implicit) sizes.push_back(implicitSize);
+    else
+    {
+        for (int i = 0; i < dataLength / 251; i++) sizes.push_back(255);
+        if (dataLength < 251) sizes.push_back(dataLength + 4);
+        else if (dataLength % 251 != 0) sizes.push_back(dataLength % 251 + 4);
+    }
+
+    return budgetHAL(sizes.data(), sizes.size());
+}
+
 int Comm::processRawData(uint8_t* data, int dataLength)
 {
     uint8_t header[4];
@@ -167,6 +249,30 @@ int Comm::processRawData(uint8_t* data, int dataLength)
 
     bool continuation = header[1] & 0x10;
 
+    // repeated announcement, it has already been handled. Copies are the same packet, the same sequence number alone
+    // can be the first packet of the other end after a reset
+    if (seqStarted && header[0] == lastSeqNum && lastRaw.size() == (size_t) dataLength &&
+        std::equal(lastRaw.begin(), lastRaw.end(), data)) return 0;
+
+    // keep track of lost packets, the first packet can't tell anything about losses
+    uint8_t gap = header[0] - lastSeqNum;
+    bool late = seqStarted && gap >= 128 && (uint8_t) -gap <= COMM_REORDER_WINDOW;
+    receivedPackets++;
+
+    // it was counted as lost when the packets after it arrived
+    if (late)
+    {
+        if (lostPackets > 0) lostPackets--;
+        if (continuation) return -1;
+    }
+    else
+    {
+        if (seqStarted && gap > 0 && gap < 128) lostPackets += gap - 1;
+        seqStarted = true;
+        lastSeqNum = header[0];
+        lastRaw.assign(data, data + dataLength);
+    }
+
     // Only process packet if sequence number is correct
     // And also when tranfer packets have been lost, but the current first part of a data packet, in which case the data can be parsed
     if (header[0] == inSeqNum % 256 || !continuation)
@@ -187,7 +293,7 @@ int Comm::processRawData(uint8_t* data, int dataLength)
             std::memcpy(inBuff, data + 4, std::min<uint16_t>(packetSize, 251));
             
             // packets with no continuation
-            if (packetSize < 251) handlePacket(inBuff, packetSize, header[1] & 0x0F);
+            if (packetSize < 251) handlePacket(inBuff, packetSize, header[1] & 0x0F, header[0]);
         }
         else
         {
@@ -198,30 +304,38 @@ int Comm::processRawData(uint8_t* data, int dataLength)
             dataReceived += dataLength - 4; // Keep track of how much data has been received in this larger data packet. Used to calculate how much more data to expect
 
             // packet is over, now it can be processed further
-            if (packetSize == dataReceived) handlePacket(inBuff, packetSize, header[1] & 0x0F);
+            if (packetSize == dataReceived) handlePacket(inBuff, packetSize, header[1] & 0x0F, header[3]);
 
         }
         // update sequence number, uses the packet's seqNum to correct itself if packets have been lost, but data becomes parsable again
-        inSeqNum = header[0] + 1;
+        if (!late) inSeqNum = header[0] + 1;
 
         return 0;
     }
     return -1;
 }
 
-int Comm::handlePacket(uint8_t* data, int size, int type)
+int Comm::handlePacket(uint8_t* data, int size, int type, uint8_t seqNum)
 {
     switch (type)
     {
         case REPORT:
+        {
             /*
-                Store received data
+                Store received data, unless it arrived late and a newer report is there already
             */
+            uint8_t behind = reportSeqNum - seqNum;
+            if (reportStarted && behind > 0 && behind <= COMM_REORDER_WINDOW) break;
+
             std::memcpy(lastPacket, data, size);
+            reportStarted = true;
+            reportSeqNum = seqNum;
             updated = true;
             break;
+        }
 
         case STRUCT_CONF:
+        {
             /*
                 Update the structure
             */
@@ -235,7 +349,43 @@ int Comm::handlePacket(uint8_t* data, int size, int type)
 
             synced = true;
             break;
+        }
 
+        case FRAME_CONF:
+            /*
+                On the sender of the reports this is the receiver's acknowledgement
+            */
+            if (!frameHAL)
+            {
+                frameAcked = data[0] == implicitSize;
+                break;
+            }
+
+            /*
+                Report frame size changed, the announcement is repeated, so it is only applied once
+            */
+            if (data[0] != implicitSize)
+            {
+                implicitSize = data[0];
+                frameHAL(implicitSize);
+            }
+            acknowledgeFrame();
+            break;
+
+        case PROFILE_CONF:
+            /*
+                Switch to the new radio profile, the announcement is repeated, so it is only applied once
+            */
+            if (data[0] != profile && !profileLocked)
+            {
+                profile = data[0];
+                if (profileHAL) profileHAL(profile);
+            }
+            break;
+
+        case DIAG:
+            if (diagHAL) diagHAL(data, size);
+            break;
     };
 
     return 0;
@@ -247,6 +397,15 @@ void Comm::receiverCallback(uint8_t* data, int size)
 
 int Comm::sendStructure()
 {   
+    // the receiver only decodes frames of the old size, so switching back to explicit headers
+    // is announced in a padded implicit frame, unless it never acknowledged that size
+    if (implicitSize > 0)
+    {
+        uint8_t size = 0;
+        if (sendRepeated(&size, 1, FRAME_CONF, frameAcked) < 0) return -3;
+        implicitSize = 0;
+    }
+
     int dataSize = 0;
     // Calculate the size of the buffer (+1 is for null)
     for (std::string field : structure) dataSize += field.length() + 1;
@@ -266,11 +425,11 @@ int Comm::sendStructure()
         i += field.length() + 1;
     }
 
-    // send
-    sendData((uint8_t*) data, dataSize, STRUCT_CONF);
+    // send, all of it, or nothing
+    int result = fits(dataSize, false) ? sendData((uint8_t*) data, dataSize, STRUCT_CONF) : -3;
     std::free(data);
 
-    return 0;
+    return result;
 }
 
 bool Comm::getSynced()
@@ -285,6 +444,145 @@ bool Comm::isUpdated()
     return true;
 }
 
+int Comm::sendProfile(uint8_t profile, int copies)
+{
+    // the other end can't have switched, so this end doesn't either
+    if (sendRepeated(&profile, 1, PROFILE_CONF, false, copies) < 0) return -3;
+
+    // the other end switches as soon as it receives the announcement, so it is safe to switch now
+    setProfile(profile);
+
+    return 0;
+}
+
+void Comm::setProfile(uint8_t profile)
+{
+    if (profile == this->profile) return;
+
+    this->profile = profile;
+    if (profileHAL) profileHAL(profile);
+}
+
+uint8_t Comm::getProfile()
+{
+    return profile;
+}
+
+void Comm::lockProfile(bool locked)
+{
+    profileLocked = locked;
+}
+
+void Comm::onProfileChange(void (*callback)(uint8_t))
+{
+    profileHAL = callback;
+}
+
+int Comm::getReceivedPackets()
+{
+    return receivedPackets;
+}
+
+int Comm::getLostPackets()
+{
+    return lostPackets;
+}
+
+void Comm::resetLinkStats()
+{
+    receivedPackets = 0;
+    lostPackets = 0;
+}
+
+void Comm::setBudget(bool (*budgetHAL)(const int*, int))
+{
+    this->budgetHAL = budgetHAL;
+}
+
+int Comm::sendableBytes()
+{
+    if (!budgetHAL) return -1;
+
+    // the largest single transfer packet the budget allows, 4 bytes are used by the header
+    int low = 0, high = 251;
+    while (low < high)
+    {
+        int size = (low + high + 1) / 2 + 4;
+        if (budgetHAL(&size, 1)) low = size - 4;
+        else high = size - 5;
+    }
+
+    return low;
+}
+
+int Comm::setImplicitReports(int (*implicitHAL)(uint8_t*, int))
+{
+    // going back to explicit headers has to be announced while the receiver still expects implicit frames
+    if (!implicitHAL && implicitSize > 0)
+    {
+        uint8_t size = 0;
+        if (sendRepeated(&size, 1, FRAME_CONF, frameAcked) < 0) return -3;
+        implicitSize = 0;
+    }
+
+    this->implicitHAL = implicitHAL;
+    return 0;
+}
+
+void Comm::onFrameChange(void (*callback)(int))
+{
+    frameHAL = callback;
+}
+
+int Comm::acknowledgeFrame()
+{
+    if (!writeHAL || !fits(1, false)) return -3;
+
+    uint8_t size = implicitSize;
+    return sendData(&size, 1, FRAME_CONF);
+}
+
+int Comm::getReportFrameSize()
+{
+    if (structure.size() >= 251) return -1;
+    return structure.size() + 4;
+}
+
+int Comm::getAnnouncedFrameSize()
+{
+    return implicitSize;
+}
+
+void Comm::resumeFrameSize(int size)
+{
+    // the receiver's next acknowledgement corrects this if it was lost
+    implicitSize = size;
+    frameAcked = size > 0;
+}
+
+int Comm::sendDiagnostics(uint8_t* data, int length)
+{
+    if (length > getDiagnosticsSize()) return -1;
+
+    // the receiver only decodes frames of the acknowledged size
+    bool implicit = implicitHAL && implicitSize > 0 && frameAcked;
+    if (!fits(length, implicit)) return -3;
+
+    if (implicit) return sendImplicit(data, length, DIAG);
+    return sendData(data, length, DIAG);
+}
+
+int Comm::getDiagnosticsSize()
+{
+    if (implicitHAL && implicitSize > 0 && frameAcked) return implicitSize - 4;
+    return 250;
+}
+
+void Comm::onDiagnostics(void (*callback)(uint8_t*, int))
+{
+    diagHAL = callback;
+}
+
 Comm::Comm(int (*writeHAL)(uint8_t*, int)) : writeHAL(writeHAL) {}
 
 Comm::~Comm()
@@ -13,10 +13,23 @@
 
 #define REPORT 0
 #define STRUCT_CONF 1
+#define PROFILE_CONF 2
+#define FRAME_CONF 3
+#define DIAG 4
+
+// How many times a profile change is transmitted before the sender switches over
+#define PROFILE_REPEAT 3
+
+// Until the receiver acknowledges the report frame size, reports keep their PHY header, and the size is announced again after this many of them
+#define FRAME_ANNOUNCE_REPORTS 16
+
+// A packet at most this many sequence numbers behind the newest one arrived late, further back the sender was restarted
+#define COMM_REORDER_WINDOW 16
 
 class Comm {
 public:
-    /* Constructor, a hardware transmit function should be supplied that has 2 arguments: `uin8_t* buffer`, and `int size`*/
+    /* Constructor, a hardware transmit function should be supplied that has 2 arguments: `uin8_t* buffer`, and `int size`.
+    It returns a negative number if the packet couldn't be sent, the sending function then returns -3 */
     Comm(int (*f)(uint8_t* data, int size));
 
     /* Destructor */
@@ -33,6 +46,12 @@ public:
     template <typename T>
     int addField(std::string field, int maxLength = 0);
 
+
+    /*
+        @brief Removes every field, so a different set can be added. `sendStructure()` has to be called again afterwards
+    */
+    void clearFields();
+
     
     /*
         @brief Sets the given field's value.
@@ -60,12 +79,16 @@ public:
     
     /*
         @brief Transmits all the fields' values.
+
+        @returns 0, -3 if the budget or the hardware didn't allow it right now
     */
     int sendReport();
 
 
     /*
         @brief send packet metadata based on currently existing fields. if fields have been added should be ran again
+
+        @returns 0, -3 if it couldn't be sent right now, then it has to be called again before the reports can be decoded
     */
     int sendStructure();
 
@@ -85,15 +108,184 @@ public:
 
 
     /*
-        @brief checks if new report packets have arrived since the last call of this function
+        @brief checks if new report packets have arrived since the last call of this function.
+        A report that arrives after a newer one is dropped
 
         @return bool
     */
    bool isUpdated();
+
+
+    /*
+        @brief Announces a radio profile change to the other end.
+        The announcement is sent `copies` times (with the same sequence number) on the current settings, after that the callback set with `onProfileChange()` is called locally as well.
+        Sending the current profile again works as a keep-alive
+
+        @param profile index of the new profile
+        @param copies how many times it is sent, a single copy is enough for a keep-alive
+
+        @returns 0, -3 if not a single copy could be sent, then the profile stays as it was
+    */
+    int sendProfile(uint8_t profile, int copies = PROFILE_REPEAT);
+
+
+    /*
+        @brief Switches to a radio profile without telling the other end, for example when both ends fall back
+        after the link was lost. The callback set with `onProfileChange()` is called if it is a change
+
+        @param profile index of the profile
+    */
+    void setProfile(uint8_t profile);
+
+
+    /*
+        @brief Returns the radio profile this end is on
+    */
+    uint8_t getProfile();
+
+
+    /*
+        @brief Ignores profile changes from the other end while locked, `sendProfile()` and `setProfile()` still work
+
+        @param locked true to ignore them
+    */
+    void lockProfile(bool locked);
+
+
+    /*
+        @brief Sets the function that applies a radio profile. It is called when a profile change arrives, or after `sendProfile()`
+
+        @param callback function that takes the index of the new profile
+    */
+    void onProfileChange(void (*callback)(uint8_t profile));
+
+
+    /*
+        @brief Returns the number of packets received since the last `resetLinkStats()`
+    */
+    int getReceivedPackets();
+
+
+    /*
+        @brief Returns the number of packets lost since the last `resetLinkStats()`, based on gaps in the sequence numbers.
+        A packet that arrives late is taken off again
+    */
+    int getLostPackets();
+
+
+    /*
+        @brief Resets the link statistics
+    */
+    void resetLinkStats();
+
+
+    /*
+        @brief Sets the function that tells whether the hardware may send some packets right now (for example because of duty-cycle limits).
+        Every transfer is checked as a whole before its first packet is sent, the sending functions return -3 if it doesn't fit
+
+        @param budgetHAL function that takes the sizes of the packets, headers included, and their number
+    */
+    void setBudget(bool (*budgetHAL)(const int* sizes, int count));
+
+
+    /*
+        @brief Returns how many bytes of data can be sent right now in a single transfer packet, not counting the header
+
+        @returns number of bytes, or -1 if there is no limit
+    */
+    int sendableBytes();
+
+
+    /*
+        @brief Sends reports as fixed size frames without a PHY header.
+        Before the first such report, the frame size is announced to the receiver with an explicit header.
+        Reports keep their PHY header until the receiver acknowledges the size, see `acknowledgeFrame()`.
+        Only works if the report fits into a single transfer packet (see `getReportFrameSize()`)
+
+        @param implicitHAL transmit function that sends the packet with an implicit header, `nullptr` turns it off
+
+        @returns 0, -3 if turning it off couldn't be announced right now, then nothing changes
+    */
+    int setImplicitReports(int (*implicitHAL)(uint8_t* data, int size));
+
+
+    /*
+        @brief Sets the function that is called when the other end announces a change of the report frame size.
+        The radio should receive with an implicit header of that size, or with an explicit header when the size is 0.
+        It makes this end the receiver of report frames, every announcement is acknowledged with `acknowledgeFrame()`
+
+        @param callback function that takes the size of a report frame in bytes
+    */
+    void onFrameChange(void (*callback)(int size));
+
+
+    /*
+        @brief Tells the sender which report frame size this end receives with. Sent after every announcement,
+        and should be sent periodically as well, so the sender notices a lost acknowledgement or a restart of this end
+
+        @returns 0, -3 if it couldn't be sent right now, or there is no transmit function
+    */
+    int acknowledgeFrame();
+
+
+    /*
+        @brief Returns the size of a report frame including the header, based on the current structure
+
+        @returns size in bytes, or -1 if a report does not fit into a single transfer packet
+    */
+    int getReportFrameSize();
+
+
+    /*
+        @brief Returns the report frame size that was announced to the receiver
+
+        @returns size in bytes, or 0 if reports are sent with an explicit header
+    */
+    int getAnnouncedFrameSize();
+
+
+    /*
+        @brief Continues with the report frame size the receiver was told about before a reset of this side,
+        so it doesn't have to be announced again. Only valid if the structure is the same as before the reset
+
+        @param size as returned by `getAnnouncedFrameSize()` before the reset
+    */
+    void resumeFrameSize(int size);
+
+
+    /*
+        @brief Sends a block of data that isn't part of the reports, like diagnostics, without changing the structure.
+        With implicit reports it goes out as a report frame, so it has to fit into one
+
+        @param data the block
+        @param length at most `getDiagnosticsSize()` bytes
+
+        @returns 0, -1 if the block is too long, -3 if the budget or the hardware doesn't allow it right now
+    */
+    int sendDiagnostics(uint8_t* data, int length);
+
+
+    /*
+        @brief Returns the longest block that `sendDiagnostics()` can send right now
+
+        @returns size in bytes
+    */
+    int getDiagnosticsSize();
+
+
+    /*
+        @brief Sets the function that is called with every block sent by `sendDiagnostics()` on the other end
+
+        @param callback function that takes the block and its size
+    */
+    void onDiagnostics(void (*callback)(uint8_t* data, int size));
 private:
     int send(uint8_t* data, int dataLength);
     int sendData(uint8_t* data, int dataLength, uint8_t packetType); // sends dataLength bytes of data, handles headers
-    int handlePacket(uint8_t* data, int size, int type); // handles packets, that have already been preprocessed, and stripped of headers
+    int sendImplicit(uint8_t* data, int dataLength, uint8_t packetType); // sends a single frame padded to the announced implicit frame size
+    int sendRepeated(uint8_t* data, int dataLength, uint8_t packetType, bool implicit, int copies = PROFILE_REPEAT); // sends copies with the same sequence number, returns how many went out
+    bool fits(int dataLength, bool implicit); // checks the budget for every transfer packet of dataLength bytes
+    int handlePacket(uint8_t* data, int size, int type, uint8_t seqNum); // handles packets, that have already been preprocessed, and stripped of headers, seqNum is the first transfer packet's
     int processRawData(uint8_t* data, int dataLength); // Processes the data that was received
     int (*writeHAL)(uint8_t*, int); /* communication transmit hardware abstraction layer, set by constructor
     it is only required to deal with a maximum packet size of 255 bytes*/
@@ -115,6 +307,25 @@ private:
 
     bool synced = false;
     bool updated = false;
+
+    bool seqStarted = false;
+    uint8_t lastSeqNum = 0;
+    std::vector<uint8_t> lastRaw; // the packet with lastSeqNum, as it arrived
+    bool reportStarted = false;
+    uint8_t reportSeqNum = 0; // of the report in lastPacket
+    int receivedPackets = 0;
+    int lostPackets = 0;
+    uint8_t profile = 0;
+    bool profileLocked = false;
+    void (*profileHAL)(uint8_t) = nullptr;
+    bool (*budgetHAL)(const int*, int) = nullptr;
+
+    int (*implicitHAL)(uint8_t*, int) = nullptr;
+    void (*frameHAL)(int) = nullptr;
+    void (*diagHAL)(uint8_t*, int) = nullptr;
+    int implicitSize = 0; // announced size of implicit report frames, 0 if reports use explicit headers
+    bool frameAcked = false; // the receiver acknowledged implicitSize
+    int unackedReports = 0; // reports sent since the frame size was announced, without an acknowledgement
 };
 
 #include "comm.cpp"
\ No newline at end of file
@@ -0,0 +1,183 @@
+#include "decimator.hpp"
+#include <cmath>
+
+#define Q14 16384
+
+CicDecimator::CicDecimator(int channels, int ratio)
+{
+    this->channels = channels;
+    this->ratio = ratio;
+
+    int bits = 0;
+    while ((1 << bits) < ratio) bits++;
+    shift = bits * CIC_ORDER;
+
+    reset();
+}
+
+void CicDecimator::reset()
+{
+    phase = 0;
+    for (int c = 0; c < DECIMATOR_CHANNELS; c++)
+    {
+        for (int k = 0; k < CIC_ORDER; k++)
+        {
+            integrators[c][k] = 0;
+            combs[c][k] = 0;
+        }
+    }
+}
+
+bool CicDecimator::push(const int16_t* in, int16_t* out)
+{
+    // the integrators overflow, but wrap around the same way in the combs, so the output is exact
+    for (int c = 0; c < channels; c++)
+    {
+        uint32_t value = (uint32_t) (int32_t) in[c];
+        for (int k = 0; k < CIC_ORDER; k++)
+        {
+            integrators[c][k] += value;
+            value = integrators[c][k];
+        }
+    }
+
+    if (++phase < ratio) return false;
+    phase = 0;
+
+    for (int c = 0; c < channels; c++)
+    {
+        uint32_t value = integrators[c][CIC_ORDER - 1];
+        for (int k = 0; k < CIC_ORDER; k++)
+        {
+            uint32_t previous = combs[c][k];
+            combs[c][k] = value;
+            value -= previous;
+        }
+        out[c] = (int16_t) ((int32_t) value >> shift);
+    }
+
+    return true;
+}
+
+FirDecimator::FirDecimator(int channels, float cutoff, int ratio)
+{
+    this->channels = channels;
+    this->ratio = ratio;
+
+    // windowed sinc with a Hamming window, computed once in floating point
+    float taps[FIR_TAPS];
+    float sum = 0;
+    for (int n = 0; n < FIR_TAPS; n++)
+    {
+        float m = n - (FIR_TAPS - 1) / 2.0f;
+        float sinc = m == 0 ? 2 * cutoff : sinf(2 * (float) M_PI * cutoff * m) / ((float) M_PI * m);
+        float window = 0.54f - 0.46f * cosf(2 * (float) M_PI * n / (FIR_TAPS - 1));
+        taps[n] = sinc * window;
+        sum += taps[n];
+    }
+
+    // unity gain at DC, the rounding error goes into the center tap
+    int total = 0;
+    for (int n = 0; n < FIR_TAPS; n++)
+    {
+        coefficients[n] = (int16_t) lroundf(taps[n] / sum * Q14);
+        total += coefficients[n];
+    }
+    coefficients[FIR_TAPS / 2] += Q14 - total;
+
+    reset();
+}
+
+void FirDecimator::reset()
+{
+    phase = 0;
+    index = 0;
+    for (int c = 0; c < DECIMATOR_CHANNELS; c++)
+        for (int n = 0; n < FIR_TAPS; n++) history[c][n] = 0;
+}
+
+bool FirDecimator::push(const int16_t* in, int16_t* out)
+{
+    for (int c = 0; c < channels; c++) history[c][index] = in[c];
+    if (++index == FIR_TAPS) index = 0;
+
+    if (++phase < ratio) return false;
+    phase = 0;
+
+    // `index` is the oldest value now, the coefficients are symmetric so the order doesn't matter
+    for (int c = 0; c < channels; c++)
+    {
+        const int16_t* h = history[c];
+        int32_t sum = 0;
+        int n = 0;
+        for (int i = index; i < FIR_TAPS; i++) sum += h[i] * coefficients[n++];
+        for (int i = 0; i < index; i++) sum += h[i] * coefficients[n++];
+
+        sum = (sum + Q14 / 2) >> 14;
+        if (sum > INT16_MAX) sum = INT16_MAX;
+        if (sum < INT16_MIN) sum = INT16_MIN;
+        out[c] = (int16_t) sum;
+    }
+
+    return true;
+}
+
+const int16_t* FirDecimator::getCoefficients()
+{
+    return coefficients;
+}
+
+WindowStats::WindowStats()
+{
+    reset();
+}
+
+void WindowStats::reset()
+{
+    count = 0;
+    min = INFINITY;
+    max = -INFINITY;
+    mean = 0;
+    m2 = 0;
+}
+
+void WindowStats::add(float value)
+{
+    count++;
+    if (value < min) min = value;
+    if (value > max) max = value;
+
+    float delta = value - mean;
+    mean += delta / count;
+    m2 += delta * (value - mean);
+}
+
+uint32_t WindowStats::getCount()
+{
+    return count;
+}
+
+float WindowStats::getMin()
+{
+    return count ? min : NAN;
+}
+
+float WindowStats::getMax()
+{
+    return count ? max : NAN;
+}
+
+float WindowStats::getMean()
+{
+    return count ? mean : NAN;
+}
+
+float WindowStats::getVariance()
+{
+    return count > 1 ? m2 / count : 0;
+}
+
+float WindowStats::getStd()
+{
+    return sqrtf(getVariance());
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include <cstdint>
+
+// Default chain, tuned with host/decimate_bench.cpp: 1 kHz -> 125 Hz (CIC) -> 62.5 Hz (FIR)
+#define CIC_ORDER 3
+#define CIC_RATIO 8             // power of 2, so the gain of the CIC is removed with a shift
+#define FIR_TAPS 31
+#define FIR_RATIO 2
+#define FIR_CUTOFF 0.2f         // relative to the input rate of the FIR, the output Nyquist frequency is 0.25
+#define DECIMATOR_CHANNELS 6    // e.g. accel and gyro of the IMU
+
+/*
+    Cascaded integrator-comb decimator: CIC_ORDER integrators at the input rate and as many combs at the output rate.
+    Only additions, in wrapping 32 bit integers, so it is cheap enough for every IMU sample.
+    Its response droops towards the output Nyquist frequency, so it is followed by a `FirDecimator`
+*/
+class CicDecimator {
+    public:
+        /*
+            @param channels number of values per sample, up to DECIMATOR_CHANNELS
+            @param ratio decimation ratio, a power of 2
+        */
+        CicDecimator(int channels, int ratio = CIC_RATIO);
+
+        /*
+            @brief Adds a sample
+
+            @param in `channels` values
+            @param out where the decimated sample is stored, when there is one
+
+            @returns true every `ratio` samples, when `out` was written
+        */
+        bool push(const int16_t* in, int16_t* out);
+
+        /* @brief Clears the filter state */
+        void reset();
+
+    private:
+        int channels;
+        int ratio;
+        int shift;      // log2 of the gain, ratio ^ CIC_ORDER
+        int phase;
+
+        uint32_t integrators[DECIMATOR_CHANNELS][CIC_ORDER];
+        uint32_t combs[DECIMATOR_CHANNELS][CIC_ORDER];   // previous input of each comb
+};
+
+/*
+    Low-pass FIR decimator with Q14 coefficients (windowed sinc), the anti-alias filter in front of the lower rate.
+    Only every `ratio`-th output is computed
+*/
+class FirDecimator {
+    public:
+        /*
+            @param channels number of values per sample, up to DECIMATOR_CHANNELS
+            @param cutoff cutoff frequency relative to the input rate, below 0.5 / ratio
+            @param ratio decimation ratio
+        */
+        FirDecimator(int channels, float cutoff = FIR_CUTOFF, int ratio = FIR_RATIO);
+
+        /* same as `CicDecimator::push()` */
+        bool push(const int16_t* in, int16_t* out);
+
+        /* @brief Clears the filter state */
+        void reset();
+
+        /* @returns the FIR_TAPS coefficients, in Q14 */
+        const int16_t* getCoefficients();
+
+    private:
+        int channels;
+        int ratio;
+        int phase;
+        int index;      // next slot of the history
+
+        int16_t coefficients[FIR_TAPS];
+        int16_t history[DECIMATOR_CHANNELS][FIR_TAPS];
+};
+
+/*
+    Running statistics of a value over a window, updated with every value so nothing has to be stored.
+    The variance uses Welford's method, which doesn't lose precision in single precision like a sum of squares
+*/
+class WindowStats {
+    public:
+        WindowStats();
+
+        void add(float value);
+
+        /* @brief Starts a new window */
+        void reset();
+
+        uint32_t getCount();
+        float getMin();
+        float getMax();
+        float getMean();
+
+        /* @returns the population variance, 0 for less than 2 values */
+        float getVariance();
+
+        /* @returns the standard deviation */
+        float getStd();
+
+    private:
+        uint32_t count;
+        float min;
+        float max;
+        float mean;
+        float m2;   // sum of squared differences from the mean
+};
@@ -0,0 +1,69 @@
+#include "duty_cycle.hpp"
+
+DutyCycle::DutyCycle(float ratio, uint32_t windowMs) :
+    budget((uint64_t) (ratio * windowMs * 1000.0f)),
+    window((uint64_t) windowMs * 1000)
+{}
+
+void DutyCycle::expire(uint64_t nowUs)
+{
+    // a transmission counts fully until its end has left the window
+    while (count > 0 && history[first].end + window <= nowUs)
+    {
+        used -= history[first].airtime;
+        first = (first + 1) % DUTY_CYCLE_HISTORY;
+        count--;
+    }
+}
+
+uint32_t DutyCycle::available(uint64_t nowUs)
+{
+    expire(nowUs);
+
+    if (used >= budget) return 0;
+    uint64_t left = budget - used;
+    return left > UINT32_MAX ? UINT32_MAX : (uint32_t) left;
+}
+
+bool DutyCycle::allow(uint64_t nowUs, uint32_t airtimeUs)
+{
+    return airtimeUs <= available(nowUs);
+}
+
+void DutyCycle::record(uint64_t nowUs, uint32_t airtimeUs)
+{
+    expire(nowUs);
+
+    if (count == DUTY_CYCLE_HISTORY)
+    {
+        // merge the oldest transmission into the next one, it then expires later than it should, never earlier
+        int second = (first + 1) % DUTY_CYCLE_HISTORY;
+        history[second].airtime += history[first].airtime;
+        first = second;
+        count--;
+    }
+
+    int last = (first + count) % DUTY_CYCLE_HISTORY;
+    history[last].end = nowUs + airtimeUs;
+    history[last].airtime = airtimeUs;
+    count++;
+    used += airtimeUs;
+}
+
+uint64_t DutyCycle::waitTime(uint64_t nowUs, uint32_t airtimeUs)
+{
+    if (allow(nowUs, airtimeUs)) return 0;
+
+    // walk the history from the oldest, until enough airtime has been freed
+    uint64_t freed = 0;
+    for (int i = 0; i < count; i++)
+    {
+        const Transmission& t = history[(first + i) % DUTY_CYCLE_HISTORY];
+        freed += t.airtime;
+
+        if (budget + freed >= used + airtimeUs) return t.end + window - nowUs;
+    }
+
+    // longer than the whole budget, it will never be allowed
+    return UINT64_MAX;
+}
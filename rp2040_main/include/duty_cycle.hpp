@@ -0,0 +1,62 @@
+#pragma once
+#include <cstdint>
+
+// EU868 g1 sub-band: 1% of every hour
+#define DUTY_CYCLE_RATIO 0.01f
+#define DUTY_CYCLE_WINDOW_MS 3600000
+
+// Number of transmissions remembered in the sliding window.
+// When there are more, the oldest ones are merged, which only makes the accounting more conservative
+#define DUTY_CYCLE_HISTORY 128
+
+/*
+    Sliding window duty-cycle accountant. It remembers every transmission of the last window,
+    so the budget comes back exactly when an old transmission leaves the window
+*/
+class DutyCycle {
+public:
+    /*
+        @param ratio allowed fraction of the window that can be spent transmitting
+        @param windowMs length of the observation window in milliseconds
+    */
+    DutyCycle(float ratio = DUTY_CYCLE_RATIO, uint32_t windowMs = DUTY_CYCLE_WINDOW_MS);
+
+    /*
+        @brief Returns how much time on air can be used right now
+
+        @param nowUs current time in microseconds
+        @returns airtime in microseconds
+    */
+    uint32_t available(uint64_t nowUs);
+
+    /*
+        @brief Checks whether a transmission of the given length is allowed right now
+    */
+    bool allow(uint64_t nowUs, uint32_t airtimeUs);
+
+    /*
+        @brief Records a transmission, should be called when it starts
+    */
+    void record(uint64_t nowUs, uint32_t airtimeUs);
+
+    /*
+        @brief Returns the time in microseconds until a transmission of the given length will be allowed
+    */
+    uint64_t waitTime(uint64_t nowUs, uint32_t airtimeUs);
+
+private:
+    struct Transmission {
+        uint64_t end;      // when the transmission ended, it leaves the window at end + window
+        uint32_t airtime;
+    };
+
+    Transmission history[DUTY_CYCLE_HISTORY];
+    int first = 0;
+    int count = 0;
+
+    uint64_t used = 0; // sum of the airtime in the history
+    uint64_t budget;
+    uint64_t window;
+
+    void expire(uint64_t nowUs);
+};
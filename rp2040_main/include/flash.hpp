@@ -0,0 +1,29 @@
+#pragma once
+#include <cstdint>
+
+// NOR flash: a page is the unit of programming, a sector the unit of erasing. Erased bytes read 0xFF
+#define FLASH_PAGE_BYTES 256
+#define FLASH_SECTOR_BYTES 4096
+#define FLASH_PAGES_PER_SECTOR (FLASH_SECTOR_BYTES / FLASH_PAGE_BYTES)
+
+/*
+    Hardware independent interface of a region of NOR flash.
+    `PicoFlash` implements it for the QSPI flash of the RP2040, and `SimFlash` (in `host`) simulates it on a PC,
+    so code written against this interface can run on both. Addresses are relative to the start of the region
+*/
+class FlashMemory {
+public:
+  virtual ~FlashMemory() {}
+
+  // size of the region in bytes, a multiple of FLASH_SECTOR_BYTES
+  virtual uint32_t size() = 0;
+
+  // the contents at `address`, readable directly
+  virtual const uint8_t* read(uint32_t address) = 0;
+
+  // programs one page, `address` has to be page aligned. Programming can only clear bits
+  virtual void program(uint32_t address, const uint8_t* page) = 0;
+
+  // erases one sector to 0xFF, `address` has to be sector aligned
+  virtual void erase(uint32_t address) = 0;
+};
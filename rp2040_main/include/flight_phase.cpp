@@ -0,0 +1,115 @@
+#include "flight_phase.hpp"
+#include <cmath>
+
+const char* phase_name(flight_phase_t phase)
+{
+    switch (phase)
+    {
+        case PHASE_PAD: return "pad";
+        case PHASE_BOOST: return "boost";
+        case PHASE_COAST: return "coast";
+        case PHASE_APOGEE: return "apogee";
+        case PHASE_DESCENT: return "descent";
+        case PHASE_LANDED: return "landed";
+        default: return "?";
+    }
+}
+
+FlightPhase::FlightPhase()
+{
+    reset();
+}
+
+void FlightPhase::reset()
+{
+    phase = PHASE_PAD;
+    phaseStart = 0;
+    conditionStart = 0;
+}
+
+void FlightPhase::resume(flight_phase_t phase, uint64_t phaseStart)
+{
+    enter(phase, phaseStart);
+}
+
+bool FlightPhase::update(uint64_t timeUs, float altitude, float velocity, float accel)
+{
+    switch (phase)
+    {
+        case PHASE_PAD:
+            // a missed boost still shows up in the altitude
+            if (confirmed(accel > PHASE_LAUNCH_ACCEL, timeUs, PHASE_CONFIRM_US) || altitude > PHASE_LAUNCH_ALTITUDE)
+            {
+                enter(PHASE_BOOST, timeUs);
+                return true;
+            }
+            break;
+
+        case PHASE_BOOST:
+            // after burnout gravity and drag decelerate
+            if (confirmed(accel < 0, timeUs, PHASE_CONFIRM_US))
+            {
+                enter(PHASE_COAST, timeUs);
+                return true;
+            }
+            break;
+
+        case PHASE_COAST:
+            if (confirmed(velocity < 0, timeUs, PHASE_CONFIRM_US))
+            {
+                enter(PHASE_APOGEE, timeUs);
+                return true;
+            }
+            break;
+
+        case PHASE_APOGEE:
+            if (timeUs - phaseStart >= PHASE_APOGEE_US)
+            {
+                enter(PHASE_DESCENT, timeUs);
+                return true;
+            }
+            break;
+
+        case PHASE_DESCENT:
+            if (confirmed(fabsf(velocity) < PHASE_LANDED_SPEED, timeUs, PHASE_LANDED_US))
+            {
+                enter(PHASE_LANDED, timeUs);
+                return true;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    return false;
+}
+
+flight_phase_t FlightPhase::getPhase()
+{
+    return phase;
+}
+
+uint64_t FlightPhase::getPhaseStart()
+{
+    return phaseStart;
+}
+
+bool FlightPhase::confirmed(bool condition, uint64_t timeUs, uint32_t durationUs)
+{
+    if (!condition)
+    {
+        conditionStart = 0;
+        return false;
+    }
+
+    if (conditionStart == 0) conditionStart = timeUs;
+    return timeUs - conditionStart >= durationUs;
+}
+
+void FlightPhase::enter(flight_phase_t next, uint64_t timeUs)
+{
+    phase = next;
+    phaseStart = timeUs;
+    conditionStart = 0;
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+
+// Thresholds of the phase detector, checked with host/kf_bench.cpp
+#define PHASE_LAUNCH_ACCEL 20.0f        // vertical acceleration that means launch, m/s^2 (about 2 g)
+#define PHASE_LAUNCH_ALTITUDE 50.0f     // launch is detected from the altitude as well, in case the boost was missed, m
+#define PHASE_CONFIRM_US 100000         // how long a condition has to hold before the phase changes
+#define PHASE_APOGEE_US 2000000         // time spent in the apogee phase, while the parachute opens
+#define PHASE_LANDED_SPEED 1.0f         // vertical speed below which the satellite is considered still, m/s
+#define PHASE_LANDED_US 10000000        // how long it has to be still to be landed
+
+enum flight_phase_t {
+    PHASE_PAD,
+    PHASE_BOOST,
+    PHASE_COAST,
+    PHASE_APOGEE,
+    PHASE_DESCENT,
+    PHASE_LANDED,
+    PHASE_COUNT
+};
+
+/* @returns the name of the phase, for printing */
+const char* phase_name(flight_phase_t phase);
+
+/*
+    Detects the phase of the flight from the output of the altitude filter.
+    Phases only go forward, every change has to hold for a while so a single spike can't trigger it
+*/
+class FlightPhase {
+    public:
+        FlightPhase();
+
+        /* @brief Starts over on the pad */
+        void reset();
+
+        /*
+            @brief Continues in a phase that was detected before a reset
+
+            @param phase the phase to continue in
+            @param phaseStart when it started, time_us_64(), may be before the reset
+        */
+        void resume(flight_phase_t phase, uint64_t phaseStart);
+
+        /*
+            @brief Feeds the current state of the vertical motion into the detector
+
+            @param timeUs time of the state, time_us_64()
+            @param altitude above the launch site, m
+            @param velocity vertical, m/s
+            @param accel vertical, gravity removed, m/s^2
+
+            @returns true if the phase changed
+        */
+        bool update(uint64_t timeUs, float altitude, float velocity, float accel);
+
+        flight_phase_t getPhase();
+
+        /* @returns when the current phase started, time_us_64() */
+        uint64_t getPhaseStart();
+
+    private:
+        bool confirmed(bool condition, uint64_t timeUs, uint32_t durationUs);
+        void enter(flight_phase_t next, uint64_t timeUs);
+
+        volatile flight_phase_t phase;
+        uint64_t phaseStart;
+        uint64_t conditionStart;    // since when the condition of the next phase holds, 0 if it doesn't
+};
@@ -0,0 +1,165 @@
+#include "gps.hpp"
+#include "pico/stdlib.h"
+#include <cstring>
+
+#define UBX_PORT_UART1 1
+#define UBX_MODE_8N1 0x000008D0
+#define UBX_PROTO_UBX 0x0001
+#define UBX_PROTO_NMEA 0x0002
+
+// navigation messages sent with every solution, and the UTC time once a second
+static const uint8_t nav_messages[][2] = {
+    {UBX_NAV_POSLLH, 1},
+    {UBX_NAV_VELNED, 1},
+    {UBX_NAV_SOL, 1},
+    {UBX_NAV_TIMEUTC, 1000 / GPS_RATE_MS},
+};
+
+Gps::Gps(BufferedUart* uart)
+{
+    this->uart = uart;
+    binary = false;
+    resumeDeadline = 0;
+    std::memset(&fix, 0, sizeof(fix));
+}
+
+bool Gps::begin(uint txPin, uint rxPin)
+{
+    uart->begin(GPS_DEFAULT_BAUD, txPin, rxPin);
+
+    binary = configure();
+    if (!binary)
+    {
+        // in case the receiver did switch the port, but the rest failed
+        setPort(GPS_DEFAULT_BAUD, UBX_PROTO_NMEA);
+        uart->setBaudrate(GPS_DEFAULT_BAUD);
+    }
+
+    return binary;
+}
+
+void Gps::resume(uint txPin, uint rxPin, bool binary)
+{
+    this->binary = binary;
+    uart->begin(binary ? GPS_UBX_BAUD : GPS_DEFAULT_BAUD, txPin, rxPin);
+    resumeDeadline = time_us_64() + GPS_RESUME_TIMEOUT_MS * 1000;
+}
+
+bool Gps::configure()
+{
+    // the port change can't be acknowledged at the old baud rate, so it is checked with the next message.
+    // A receiver that kept the configuration from before a reset already listens at the new rate, and ignores this
+    setPort(GPS_UBX_BAUD, UBX_PROTO_UBX);
+    uart->setBaudrate(GPS_UBX_BAUD);
+
+    uint8_t rate[6] = {GPS_RATE_MS & 0xFF, GPS_RATE_MS >> 8, 1, 0, 1, 0}; // measurement period, 1 measurement per solution, GPS time
+    if (!send(UBX_CLASS_CFG, UBX_CFG_RATE, rate, sizeof(rate), true)) return false;
+
+    for (const uint8_t* message : nav_messages)
+    {
+        uint8_t msg[3] = {UBX_CLASS_NAV, message[0], message[1]};
+        if (!send(UBX_CLASS_CFG, UBX_CFG_MSG, msg, sizeof(msg), true)) return false;
+    }
+
+    return true;
+}
+
+void Gps::setPort(uint32_t baud, uint16_t outProto)
+{
+    uint8_t prt[20] = {0};
+    prt[0] = UBX_PORT_UART1;
+    for (int i = 0; i < 4; i++)
+    {
+        prt[4 + i] = (UBX_MODE_8N1 >> (8 * i)) & 0xFF;
+        prt[8 + i] = (baud >> (8 * i)) & 0xFF;
+    }
+    // UBX is always accepted, so the port can be configured again
+    prt[12] = UBX_PROTO_UBX | UBX_PROTO_NMEA;
+    prt[14] = outProto & 0xFF;
+
+    send(UBX_CLASS_CFG, UBX_CFG_PRT, prt, sizeof(prt), false);
+
+    // the receiver switches once the message is through, a little later than that
+    uart->flush();
+    sleep_ms(50);
+}
+
+bool Gps::send(uint8_t cls, uint8_t id, const uint8_t* payload, int length, bool waitAck)
+{
+    uint8_t frame[UBX_MAX_PAYLOAD + UBX_OVERHEAD];
+    int size = ubx_frame(cls, id, payload, length, frame);
+
+    ubx.clearAck();
+    uart->write(frame, size);
+    if (!waitAck) return true;
+
+    absolute_time_t timeout = make_timeout_time_ms(GPS_ACK_TIMEOUT_MS);
+    while (absolute_time_diff_us(get_absolute_time(), timeout) > 0)
+    {
+        int c;
+        while ((c = uart->read()) >= 0) ubx.feed((uint8_t) c);
+
+        int ack = ubx.getAck(cls, id);
+        if (ack >= 0) return ack == 1;
+
+        sleep_ms(1);
+    }
+
+    return false;
+}
+
+bool Gps::update()
+{
+    bool updated = false;
+    uint64_t arrival = 0;
+    int c;
+
+    while ((c = uart->read()) >= 0)
+    {
+        if (binary ? ubx.feed((uint8_t) c) : nmea.feed((char) c))
+        {
+            updated = true;
+            arrival = uart->getBurstTime();
+        }
+    }
+
+    if (updated)
+    {
+        fix = binary ? ubx.getFix() : nmea.getFix();
+        fix.time_us = arrival ? arrival : time_us_64();
+    }
+
+    if (resumeDeadline)
+    {
+        if (getMessages() > 0) resumeDeadline = 0;
+        else if (time_us_64() > resumeDeadline)
+        {
+            // the receiver was reset as well, and starts without the configuration
+            binary = false;
+            uart->setBaudrate(GPS_DEFAULT_BAUD);
+            resumeDeadline = 0;
+        }
+    }
+
+    return updated;
+}
+
+const gps_fix& Gps::getFix()
+{
+    return fix;
+}
+
+bool Gps::isBinary()
+{
+    return binary;
+}
+
+uint32_t Gps::getMessages()
+{
+    return binary ? ubx.getMessages() : nmea.getSentences();
+}
+
+uint32_t Gps::getErrors()
+{
+    return binary ? ubx.getErrors() : nmea.getErrors();
+}
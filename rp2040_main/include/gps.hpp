@@ -0,0 +1,73 @@
+#pragma once
+#include <cstdint>
+#include "buffered_uart.hpp"
+#include "nmea.hpp"
+#include "ubx.hpp"
+
+#define GPS_DEFAULT_BAUD 9600   // NMEA at 1 Hz, how the NEO-6M starts without a saved configuration
+#define GPS_UBX_BAUD 38400      // 5 Hz of UBX navigation messages are about 800 bytes/s
+#define GPS_RATE_MS 200         // 5 Hz
+#define GPS_ACK_TIMEOUT_MS 300
+#define GPS_RESUME_TIMEOUT_MS 1500 // 7 solutions at 5 Hz, or the first NMEA sentence at 1 Hz
+
+/*
+    u-blox 6 receiver (NEO-6M) on a `BufferedUart`. At startup it is switched to binary UBX output at a higher baud rate
+    and fix rate. If the receiver doesn't acknowledge that, it stays on NMEA
+*/
+class Gps {
+    public:
+        Gps(BufferedUart* uart);
+
+        /*
+            @brief Starts the UART and configures the receiver, blocks for up to about a second.
+            The UART interrupt goes to the calling core
+
+            @param txPin GPIO of TX
+            @param rxPin GPIO of RX
+
+            @returns true if the receiver sends UBX, false if it fell back to NMEA
+        */
+        bool begin(uint txPin, uint rxPin);
+
+        /*
+            @brief Starts the UART for a receiver that kept its configuration while this side was reset, never blocks.
+            If nothing arrives within GPS_RESUME_TIMEOUT_MS, `update()` falls back to NMEA at the default baud rate,
+            which is how the receiver talks after it lost power as well
+
+            @param txPin GPIO of TX
+            @param rxPin GPIO of RX
+            @param binary what `begin()` returned before the reset
+        */
+        void resume(uint txPin, uint rxPin, bool binary);
+
+        /*
+            @brief Parses everything received since the last call, never blocks
+
+            @returns true if the fix was updated
+        */
+        bool update();
+
+        /* @returns the last fix, `time_us` is when the burst of its last message started arriving, see `BufferedUart::getBurstTime()` */
+        const gps_fix& getFix();
+
+        /* @returns true if the receiver sends UBX */
+        bool isBinary();
+
+        /* @returns number of valid messages (UBX) or sentences (NMEA) */
+        uint32_t getMessages();
+
+        /* @returns number of messages with a wrong checksum */
+        uint32_t getErrors();
+
+    private:
+        bool configure();
+        bool send(uint8_t cls, uint8_t id, const uint8_t* payload, int length, bool waitAck);
+        void setPort(uint32_t baud, uint16_t outProto);
+
+        BufferedUart* uart;
+        UbxParser ubx;
+        NmeaParser nmea;
+        bool binary;
+        gps_fix fix;
+        uint64_t resumeDeadline;    // time_us_64() at which `resume()` gives up, 0 if it didn't or succeeded
+};
@@ -0,0 +1,178 @@
+#include "i2c_queue.hpp"
+#include "pico/stdlib.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+
+I2CQueue* I2CQueue::instances[2] = {nullptr, nullptr};
+
+I2CQueue::I2CQueue(i2c_inst_t* i2c) : i2c(i2c)
+{
+    txChannel = -1;
+    rxChannel = -1;
+    head = 0;
+    tail = 0;
+    busy = false;
+    aborted = false;
+    errors = 0;
+}
+
+bool I2CQueue::begin()
+{
+    txChannel = dma_claim_unused_channel(false);
+    rxChannel = dma_claim_unused_channel(false);
+    if (txChannel < 0 || rxChannel < 0) return false;
+
+    unsigned index = i2c_hw_index(i2c);
+    instances[index] = this;
+
+    i2c_hw_t* hw = i2c_get_hw(i2c);
+    hw->intr_mask = I2C_IC_INTR_MASK_M_STOP_DET_BITS | I2C_IC_INTR_MASK_M_TX_ABRT_BITS;
+    hw->dma_cr = I2C_IC_DMA_CR_TDMAE_BITS | I2C_IC_DMA_CR_RDMAE_BITS;
+
+    unsigned irq = index == 0 ? I2C0_IRQ : I2C1_IRQ;
+    irq_set_exclusive_handler(irq, index == 0 ? &I2CQueue::onIrq0 : &I2CQueue::onIrq1);
+    irq_set_enabled(irq, true);
+
+    return true;
+}
+
+bool I2CQueue::read(uint8_t addr, uint8_t reg, uint8_t* dest, int length, i2c_callback_t callback, void* ctx)
+{
+    if (length <= 0 || length > I2C_MAX_TRANSFER) return false;
+    return submit({addr, reg, true, dest, (uint16_t) length, callback, ctx});
+}
+
+bool I2CQueue::write(uint8_t addr, uint8_t reg, const uint8_t* src, int length, i2c_callback_t callback, void* ctx)
+{
+    if (length < 0 || length > I2C_MAX_TRANSFER) return false;
+    return submit({addr, reg, false, (uint8_t*) src, (uint16_t) length, callback, ctx});
+}
+
+bool I2CQueue::isIdle()
+{
+    return !busy;
+}
+
+void I2CQueue::wait()
+{
+    while (busy) tight_loop_contents();
+}
+
+uint32_t I2CQueue::getErrors()
+{
+    return errors;
+}
+
+bool I2CQueue::submit(const i2c_job& job)
+{
+    // jobs are also queued from interrupts, e.g. from the callback of the previous one
+    uint32_t status = save_and_disable_interrupts();
+
+    uint8_t next = (tail + 1) % I2C_QUEUE_SIZE;
+    if (next == head)
+    {
+        restore_interrupts(status);
+        return false;
+    }
+
+    jobs[tail] = job;
+    tail = next;
+
+    if (!busy)
+    {
+        busy = true;
+        start();
+    }
+
+    restore_interrupts(status);
+    return true;
+}
+
+void I2CQueue::start()
+{
+    const i2c_job& job = jobs[head];
+    i2c_hw_t* hw = i2c_get_hw(i2c);
+
+    // the target address can only be changed while the controller is disabled
+    hw->enable = 0;
+    hw->tar = job.addr;
+    hw->enable = 1;
+
+    int n = 0;
+    commands[n++] = job.reg | (job.length == 0 ? I2C_IC_DATA_CMD_STOP_BITS : 0);
+
+    for (int i = 0; i < job.length; i++)
+    {
+        uint32_t command = job.read ? I2C_IC_DATA_CMD_CMD_BITS : job.data[i];
+        if (job.read && i == 0) command |= I2C_IC_DATA_CMD_RESTART_BITS;
+        if (i == job.length - 1) command |= I2C_IC_DATA_CMD_STOP_BITS;
+        commands[n++] = command;
+    }
+
+    aborted = false;
+
+    // the receiving channel has to be ready before the first read command goes out
+    if (job.read)
+    {
+        dma_channel_config rx = dma_channel_get_default_config(rxChannel);
+        channel_config_set_transfer_data_size(&rx, DMA_SIZE_8);
+        channel_config_set_read_increment(&rx, false);
+        channel_config_set_write_increment(&rx, true);
+        channel_config_set_dreq(&rx, i2c_get_dreq(i2c, false));
+        dma_channel_configure(rxChannel, &rx, job.data, &hw->data_cmd, job.length, true);
+    }
+
+    dma_channel_config tx = dma_channel_get_default_config(txChannel);
+    channel_config_set_transfer_data_size(&tx, DMA_SIZE_32);
+    channel_config_set_read_increment(&tx, true);
+    channel_config_set_write_increment(&tx, false);
+    channel_config_set_dreq(&tx, i2c_get_dreq(i2c, true));
+    dma_channel_configure(txChannel, &tx, &hw->data_cmd, commands, n, true);
+}
+
+void I2CQueue::handleIrq()
+{
+    i2c_hw_t* hw = i2c_get_hw(i2c);
+    uint32_t stat = hw->intr_stat;
+
+    // no ACK, the controller flushed its FIFO and sends a STOP
+    if (stat & I2C_IC_INTR_STAT_R_TX_ABRT_BITS)
+    {
+        dma_channel_abort(txChannel);
+        dma_channel_abort(rxChannel);
+        (void) hw->clr_tx_abrt;
+        aborted = true;
+    }
+
+    if (!(stat & I2C_IC_INTR_STAT_R_STOP_DET_BITS)) return;
+    (void) hw->clr_stop_det;
+
+    i2c_job job = jobs[head];
+
+    // the last received byte may still be on its way
+    if (job.read && !aborted) while (dma_channel_is_busy(rxChannel)) tight_loop_contents();
+
+    int result = job.length;
+    if (aborted)
+    {
+        result = -1;
+        errors = errors + 1;
+    }
+
+    // keep the bus busy before running the callback
+    head = (head + 1) % I2C_QUEUE_SIZE;
+    if (head != tail) start();
+    else busy = false;
+
+    if (job.callback) job.callback(result, job.ctx);
+}
+
+void I2CQueue::onIrq0()
+{
+    instances[0]->handleIrq();
+}
+
+void I2CQueue::onIrq1()
+{
+    instances[1]->handleIrq();
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <cstdint>
+#include "hardware/i2c.h"
+#include "hardware/dma.h"
+
+#define I2C_QUEUE_SIZE 16
+#define I2C_MAX_TRANSFER 512 // bytes of a single job, the BMP390 FIFO
+
+// Called from the I2C interrupt when a job is done. `result` is the number of bytes transferred, or -1 on error
+typedef void (*i2c_callback_t)(int result, void* ctx);
+
+struct i2c_job {
+    uint8_t addr;
+    uint8_t reg;
+    bool read;
+    uint8_t* data;
+    uint16_t length;
+    i2c_callback_t callback;
+    void* ctx;
+};
+
+/*
+    Queue of register reads and writes that are executed in the background with DMA.
+    The DMA feeds the commands into the I2C controller and copies the received bytes,
+    the CPU is only interrupted once per job, at the STOP condition.
+    While jobs are queued, the blocking i2c_* functions must not be used on the same bus
+*/
+class I2CQueue {
+    public:
+        I2CQueue(i2c_inst_t* i2c);
+
+        /*
+            @brief Claims two DMA channels and installs the interrupt handler. The bus has to be initialized with `i2c_init()` first
+
+            @returns false if there are no free DMA channels
+        */
+        bool begin();
+
+        /*
+            @brief Queues a read of `length` bytes, starting at register `reg`
+
+            @param addr 7 bit address of the device
+            @param reg the first register to read
+            @param dest where the bytes are written, has to stay valid until the callback
+            @param length number of bytes, at most I2C_MAX_TRANSFER
+            @param callback called when the job is done, can be NULL
+            @param ctx passed to the callback
+
+            @returns false if the queue is full
+        */
+        bool read(uint8_t addr, uint8_t reg, uint8_t* dest, int length, i2c_callback_t callback = nullptr, void* ctx = nullptr);
+
+        /*
+            @brief Queues a write of `length` bytes, starting at register `reg`. Same parameters as `read()`
+        */
+        bool write(uint8_t addr, uint8_t reg, const uint8_t* src, int length, i2c_callback_t callback = nullptr, void* ctx = nullptr);
+
+        /* @returns true if no job is queued or running */
+        bool isIdle();
+
+        /* @brief Blocks until all queued jobs are done */
+        void wait();
+
+        /* @returns number of jobs that failed (no ACK) since `begin()` */
+        uint32_t getErrors();
+
+    private:
+        bool submit(const i2c_job& job);
+        void start();
+        void handleIrq();
+
+        static void onIrq0();
+        static void onIrq1();
+        static I2CQueue* instances[2];
+
+        i2c_inst_t* i2c;
+        int txChannel;
+        int rxChannel;
+
+        i2c_job jobs[I2C_QUEUE_SIZE];
+        volatile uint8_t head;
+        volatile uint8_t tail;
+        volatile bool busy;
+        volatile bool aborted;
+
+        // register address + one command per byte, the DMA writes them into IC_DATA_CMD
+        uint32_t commands[I2C_MAX_TRANSFER + 1];
+
+        volatile uint32_t errors;
+};
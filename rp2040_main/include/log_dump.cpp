@@ -0,0 +1,39 @@
+#include "log_dump.hpp"
+#include <cstring>
+
+// reflected polynomial 0xEDB88320, a nibble at a time: 64 bytes of table instead of 1 kB
+static const uint32_t crc_nibble[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+};
+
+uint32_t crc32(const uint8_t* data, int length, uint32_t crc)
+{
+    crc = ~crc;
+    for (int i = 0; i < length; i++)
+    {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ crc_nibble[crc & 0x0F];
+        crc = (crc >> 4) ^ crc_nibble[crc & 0x0F];
+    }
+    return ~crc;
+}
+
+static void put32(uint8_t* p, uint32_t v)
+{
+    for (int i = 0; i < 4; i++) p[i] = (v >> (8 * i)) & 0xFF;
+}
+
+int dump_frame(uint8_t type, uint32_t first, const uint8_t* payload, int length, uint8_t* out)
+{
+    put32(out, DUMP_MAGIC);
+    out[4] = type;
+    out[5] = 0;
+    out[6] = length & 0xFF;
+    out[7] = length >> 8;
+    put32(out + 8, first);
+    if (length) std::memcpy(out + DUMP_HEADER, payload, length);
+    put32(out + DUMP_HEADER + length, crc32(out, DUMP_HEADER + length));
+
+    return DUMP_HEADER + length + DUMP_TRAILER;
+}
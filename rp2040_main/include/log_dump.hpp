@@ -0,0 +1,44 @@
+#pragma once
+#include <cstdint>
+#include "flash.hpp"
+
+/*
+    Frames of the flight log dump over USB, sent in between the text of stdio, which is skipped by the magic.
+    Frame: magic (4), type (1), 0 (1), payload length (2), first page (4), payload, CRC-32 of everything before (4).
+    All values little endian.
+    DUMP_INFO: pages in use (4), capacity in pages (4), session (2), page size (2), first page 0
+    DUMP_PAGES: up to DUMP_CHUNK_PAGES pages of the log, starting at the first page
+    DUMP_END: no payload, the first page is where the dump stopped
+    DUMP_TRACE: whole records of the binary trace (trace.hpp), the first page is the number of records dropped so far
+*/
+#define DUMP_MAGIC 0x474F4C42 // "BLOG"
+#define DUMP_HEADER 12
+#define DUMP_TRAILER 4
+#define DUMP_CHUNK_PAGES 16
+#define DUMP_MAX_PAYLOAD (DUMP_CHUNK_PAGES * FLASH_PAGE_BYTES)
+#define DUMP_MAX_FRAME (DUMP_HEADER + DUMP_MAX_PAYLOAD + DUMP_TRAILER)
+
+enum dump_frame_t {
+    DUMP_INFO = 1,
+    DUMP_PAGES,
+    DUMP_END,
+    DUMP_TRACE,
+};
+
+/*
+    @brief CRC-32 (IEEE 802.3), continued from `crc`
+*/
+uint32_t crc32(const uint8_t* data, int length, uint32_t crc = 0);
+
+/*
+    @brief Builds a dump frame
+
+    @param type dump_frame_t
+    @param first first page
+    @param payload `length` bytes
+    @param length at most DUMP_MAX_PAYLOAD
+    @param out at least `length` + DUMP_HEADER + DUMP_TRAILER bytes
+
+    @returns the length of the frame
+*/
+int dump_frame(uint8_t type, uint32_t first, const uint8_t* payload, int length, uint8_t* out);
@@ -0,0 +1,345 @@
+#include "mpu6500.hpp"
+#include "pico/stdlib.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include <cmath>
+
+// sensitivity at the smallest ranges, it halves with every step up
+#define ACCEL_LSB_PER_G 16384.0f
+#define GYRO_LSB_PER_DPS 131.0f
+
+#define TEMP_LSB_PER_C 333.87f
+#define TEMP_OFFSET 21.0f
+
+#define FIFO_CAPACITY MPU_FIFO_CAPACITY
+
+#define FIFO_RESET 0x04
+#define FIFO_ENABLE 0x40
+
+// the sample period is measured over this many data ready interrupts
+#define PERIOD_WINDOW 1000
+
+MPU6500* MPU6500::fifoInstance = nullptr;
+
+MPU6500::MPU6500(i2c_inst_t* i2c, uint8_t addr) : i2c(i2c), addr(addr)
+{
+    accelScale = 1 / ACCEL_LSB_PER_G;
+    gyroScale = 1 / GYRO_LSB_PER_DPS;
+
+    readyCount = 0;
+    lastReadyUs = 0;
+    overflowed = false;
+    drainedCount = 0;
+    periodStartUs = 0;
+    periodStartCount = 0;
+    samplePeriodUs = 1000000 / MPU_FIFO_RATE_HZ;
+    overflows = 0;
+
+    queue = nullptr;
+    callback = nullptr;
+    draining = false;
+}
+
+bool MPU6500::begin(uint8_t accelRange, uint8_t gyroRange)
+{
+    uint8_t id = 0;
+    if (!readRegs(MPU_WHO_AM_I, &id, 1)) return false;
+    if (id != MPU_WHO_AM_I_VALUE) return false;
+
+    // out of sleep, clocked from the gyro PLL
+    if (!writeReg(MPU_PWR_MGMT_1, 0x01)) return false;
+    if (!writeReg(MPU_ACCEL_CONFIG, (accelRange & 0x3) << 3)) return false;
+    if (!writeReg(MPU_GYRO_CONFIG, (gyroRange & 0x3) << 3)) return false;
+
+    accelScale = (1 << (accelRange & 0x3)) / ACCEL_LSB_PER_G;
+    gyroScale = (1 << (gyroRange & 0x3)) / GYRO_LSB_PER_DPS;
+
+    return true;
+}
+
+bool MPU6500::read(imu_sample& sample)
+{
+    uint8_t reg = MPU_ACCEL_XOUT_H;
+    uint8_t data[MPU_SAMPLE_SIZE];
+
+    if (i2c_write_blocking(i2c, addr, &reg, 1, true) != 1) return false;
+    sample.time_us = time_us_64();
+    if (i2c_read_blocking(i2c, addr, data, MPU_SAMPLE_SIZE, false) != MPU_SAMPLE_SIZE) return false;
+
+    parse(data, sample);
+    return true;
+}
+
+void MPU6500::parse(const uint8_t* data, imu_sample& sample)
+{
+    imu_raw raw;
+    raw.time_us = sample.time_us;
+    decode(data, data + 8, raw);
+    toSample(raw, sample);
+
+    sample.raw_temp = (int16_t) (data[6] << 8 | data[7]);
+    sample.temperature = sample.raw_temp * (1 / TEMP_LSB_PER_C) + TEMP_OFFSET;
+}
+
+bool MPU6500::beginFifo(uint intPin, int batch)
+{
+    this->intPin = intPin;
+    this->batch = batch;
+
+    // 1 kHz output rate: sample rate divider 0 with the 184 Hz low pass filters.
+    // When the FIFO is full new samples are dropped instead of overwriting old ones, so the timestamps stay valid
+    if (!writeReg(MPU_SMPLRT_DIV, 1000 / MPU_FIFO_RATE_HZ - 1)) return false;
+    if (!writeReg(MPU_CONFIG, 1 << 6 | 0x01)) return false;
+    if (!writeReg(MPU_ACCEL_CONFIG_2, 0x01)) return false;
+
+    // accel and gyro into the FIFO
+    if (!writeReg(MPU_FIFO_EN, 0x78)) return false;
+
+    // 50 us active high pulse on every new sample, no need to read INT_STATUS to clear it
+    if (!writeReg(MPU_INT_PIN_CFG, 0x00)) return false;
+    if (!writeReg(MPU_INT_ENABLE, 0x01)) return false;
+
+    fifoInstance = this;
+
+    gpio_init(intPin);
+    gpio_set_dir(intPin, GPIO_IN);
+    // a raw handler, so it does not replace the GPIO callback of the radio
+    gpio_add_raw_irq_handler(intPin, &MPU6500::onDataReady);
+    gpio_set_irq_enabled(intPin, GPIO_IRQ_EDGE_RISE, true);
+    irq_set_enabled(IO_IRQ_BANK0, true);
+
+    resetFifo();
+    return true;
+}
+
+bool MPU6500::fifoReady()
+{
+    return overflowed || readyCount - drainedCount >= (uint32_t) batch;
+}
+
+int MPU6500::drainFifo(imu_sample* samples, int max)
+{
+    if (overflowed)
+    {
+        overflows++;
+        resetFifo();
+        return -1;
+    }
+
+    // The count and the time of the newest sample have to belong together,
+    // so read the count again if a sample came in while it was being read
+    uint8_t countData[2];
+    uint32_t before, after;
+    uint64_t newestUs;
+    int tries = 0;
+    do
+    {
+        if (tries++ == 3) return -1;
+
+        before = readyCount;
+        if (!readRegs(MPU_FIFO_COUNTH, countData, 2)) return -1;
+
+        uint32_t status = save_and_disable_interrupts();
+        after = readyCount;
+        newestUs = lastReadyUs;
+        restore_interrupts(status);
+    } while (before != after);
+
+    int count = ((countData[0] & 0x1F) << 8 | countData[1]) / MPU_FIFO_SAMPLE_SIZE;
+    int n = count < max ? count : max;
+    if (n > FIFO_CAPACITY) n = FIFO_CAPACITY;
+
+    uint8_t data[FIFO_CAPACITY * MPU_FIFO_SAMPLE_SIZE];
+    if (n > 0 && !readRegs(MPU_FIFO_R_W, data, n * MPU_FIFO_SAMPLE_SIZE)) return -1;
+
+    imu_raw raw[FIFO_CAPACITY];
+    n = unpackFifo(data, count, n, after, newestUs, raw);
+    for (int i = 0; i < n; i++) toSample(raw[i], samples[i]);
+
+    return n;
+}
+
+void MPU6500::drainAsync(I2CQueue* queue, imu_callback_t callback)
+{
+    this->callback = callback;
+    this->queue = queue;
+}
+
+int MPU6500::unpackFifo(const uint8_t* data, int count, int n, uint32_t after, uint64_t newestUs, imu_raw* samples)
+{
+    // the newest sample in the FIFO arrived with the last interrupt, the others one period apart
+    for (int i = 0; i < n; i++)
+    {
+        decode(data + i * MPU_FIFO_SAMPLE_SIZE, data + i * MPU_FIFO_SAMPLE_SIZE + 6, samples[i]);
+        samples[i].time_us = newestUs - (uint64_t) (count - 1 - i) * samplePeriodUs;
+    }
+
+    // samples left in the FIFO still count as waiting
+    drainedCount = after - (count - n);
+
+    // the sensor clock drifts a few percent, measure its period from the interrupts
+    if (periodStartUs == 0)
+    {
+        periodStartUs = newestUs;
+        periodStartCount = after;
+    }
+    else if (after - periodStartCount >= PERIOD_WINDOW)
+    {
+        samplePeriodUs = (uint32_t) ((newestUs - periodStartUs) / (after - periodStartCount));
+        periodStartUs = newestUs;
+        periodStartCount = after;
+    }
+
+    return n;
+}
+
+// Background draining: FIFO count -> FIFO data -> callback, each step started from the completion of the previous one
+void MPU6500::startDrain()
+{
+    draining = true;
+
+    if (overflowed)
+    {
+        static const uint8_t reset = FIFO_RESET;
+        static const uint8_t enable = FIFO_ENABLE;
+
+        overflows++;
+        if (!queue->write(addr, MPU_USER_CTRL, &reset, 1) || !queue->write(addr, MPU_USER_CTRL, &enable, 1, onReset, this)) draining = false;
+        return;
+    }
+
+    drainBefore = readyCount;
+    if (!queue->read(addr, MPU_FIFO_COUNTH, drainCountData, 2, onCount, this)) draining = false;
+}
+
+void MPU6500::onCount(int result, void* ctx)
+{
+    MPU6500* imu = (MPU6500*) ctx;
+    if (result < 0)
+    {
+        imu->draining = false;
+        return;
+    }
+
+    uint32_t status = save_and_disable_interrupts();
+    imu->drainAfter = imu->readyCount;
+    imu->drainNewestUs = imu->lastReadyUs;
+    restore_interrupts(status);
+
+    // a sample came in while the count was read, so it's unknown if it is included
+    if (imu->drainAfter != imu->drainBefore)
+    {
+        imu->startDrain();
+        return;
+    }
+
+    imu->drainCount = ((imu->drainCountData[0] & 0x1F) << 8 | imu->drainCountData[1]) / MPU_FIFO_SAMPLE_SIZE;
+    int n = imu->drainCount < FIFO_CAPACITY ? imu->drainCount : FIFO_CAPACITY;
+
+    if (n == 0 || !imu->queue->read(imu->addr, MPU_FIFO_R_W, imu->drainData, n * MPU_FIFO_SAMPLE_SIZE, onData, imu)) imu->draining = false;
+}
+
+void MPU6500::onData(int result, void* ctx)
+{
+    MPU6500* imu = (MPU6500*) ctx;
+    if (result < 0)
+    {
+        imu->draining = false;
+        return;
+    }
+
+    int n = imu->unpackFifo(imu->drainData, imu->drainCount, result / MPU_FIFO_SAMPLE_SIZE, imu->drainAfter, imu->drainNewestUs, imu->drainSamples);
+    imu->draining = false;
+
+    if (imu->callback) imu->callback(imu->drainSamples, n);
+}
+
+void MPU6500::onReset(int result, void* ctx)
+{
+    MPU6500* imu = (MPU6500*) ctx;
+
+    // still overflowed, the next drain tries the reset again
+    if (result < 0)
+    {
+        imu->draining = false;
+        return;
+    }
+
+    imu->drainedCount = imu->readyCount;
+    imu->overflowed = false;
+    imu->draining = false;
+}
+
+uint32_t MPU6500::getSamplePeriod()
+{
+    return samplePeriodUs;
+}
+
+uint32_t MPU6500::getOverflows()
+{
+    return overflows;
+}
+
+void MPU6500::resetFifo()
+{
+    // FIFO_RST also clears FIFO_EN, the samples that arrive before it is enabled again do not count
+    writeReg(MPU_USER_CTRL, FIFO_RESET);
+    drainedCount = readyCount;
+    overflowed = false;
+    writeReg(MPU_USER_CTRL, FIFO_ENABLE);
+}
+
+void MPU6500::onDataReady()
+{
+    MPU6500* imu = fifoInstance;
+
+    if (!(gpio_get_irq_event_mask(imu->intPin) & GPIO_IRQ_EDGE_RISE)) return;
+    gpio_acknowledge_irq(imu->intPin, GPIO_IRQ_EDGE_RISE);
+
+    imu->lastReadyUs = time_us_64();
+    imu->readyCount = imu->readyCount + 1;
+
+    if (imu->readyCount - imu->drainedCount > FIFO_CAPACITY) imu->overflowed = true;
+
+    if (imu->queue && !imu->draining && imu->fifoReady()) imu->startDrain();
+}
+
+void MPU6500::toSample(const imu_raw& raw, imu_sample& sample)
+{
+    sample.time_us = raw.time_us;
+
+    for (int i = 0; i < 3; i++)
+    {
+        sample.raw_accel[i] = raw.accel[i];
+        sample.raw_gyro[i] = raw.gyro[i];
+
+        sample.accel[i] = raw.accel[i] * accelScale;
+        sample.gyro[i] = raw.gyro[i] * gyroScale;
+    }
+
+    // the temperature isn't in the FIFO
+    sample.raw_temp = 0;
+    sample.temperature = NAN;
+}
+
+void MPU6500::decode(const uint8_t* accel, const uint8_t* gyro, imu_raw& raw)
+{
+    // registers are big-endian: high byte first
+    for (int i = 0; i < 3; i++)
+    {
+        raw.accel[i] = (int16_t) (accel[2 * i] << 8 | accel[2 * i + 1]);
+        raw.gyro[i] = (int16_t) (gyro[2 * i] << 8 | gyro[2 * i + 1]);
+    }
+}
+
+bool MPU6500::writeReg(uint8_t reg, uint8_t val)
+{
+    uint8_t buff[] = {reg, val};
+    return i2c_write_blocking(i2c, addr, buff, 2, false) == 2;
+}
+
+bool MPU6500::readRegs(uint8_t reg, uint8_t* data, int length)
+{
+    if (i2c_write_blocking(i2c, addr, &reg, 1, true) != 1) return false;
+    return i2c_read_blocking(i2c, addr, data, length, false) == length;
+}
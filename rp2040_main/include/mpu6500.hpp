@@ -0,0 +1,183 @@
+#pragma once
+#include <cstdint>
+#include "hardware/i2c.h"
+#include "i2c_queue.hpp"
+
+#define MPU_SMPLRT_DIV 0x19
+#define MPU_CONFIG 0x1A
+#define MPU_GYRO_CONFIG 0x1B
+#define MPU_ACCEL_CONFIG 0x1C
+#define MPU_ACCEL_CONFIG_2 0x1D
+#define MPU_FIFO_EN 0x23
+#define MPU_INT_PIN_CFG 0x37
+#define MPU_INT_ENABLE 0x38
+#define MPU_INT_STATUS 0x3A
+#define MPU_ACCEL_XOUT_H 0x3B
+#define MPU_USER_CTRL 0x6A
+#define MPU_PWR_MGMT_1 0x6B
+#define MPU_FIFO_COUNTH 0x72
+#define MPU_FIFO_R_W 0x74
+#define MPU_WHO_AM_I 0x75
+
+#define MPU_WHO_AM_I_VALUE 0x70
+
+// accel, temperature and gyro registers are consecutive, so one read gets all of them
+#define MPU_SAMPLE_SIZE 14
+
+// The FIFO holds accel and gyro (no temperature), at 1 kHz it fills up in 42 ms
+#define MPU_FIFO_SAMPLE_SIZE 12
+#define MPU_FIFO_SIZE 512
+#define MPU_FIFO_RATE_HZ 1000
+#define MPU_FIFO_BATCH 10 // samples per drain
+
+// One reading of all axes, taken in a single I2C transaction
+struct imu_sample {
+    uint64_t time_us;   // when the registers were read, time_us_64()
+    int16_t raw_accel[3];
+    int16_t raw_temp;
+    int16_t raw_gyro[3];
+    float accel[3];     // g
+    float gyro[3];      // deg/s
+    float temperature;  // C, NAN for samples read from the FIFO
+};
+
+// Unconverted accel and gyro values, as they come out of the FIFO
+struct imu_raw {
+    uint64_t time_us;
+    int16_t accel[3];
+    int16_t gyro[3];
+};
+
+#define MPU_FIFO_CAPACITY (MPU_FIFO_SIZE / MPU_FIFO_SAMPLE_SIZE)
+
+// Receives the samples drained in the background, oldest first, to be converted with `toSample()`.
+// Called from the I2C interrupt
+typedef void (*imu_callback_t)(const imu_raw* samples, int n);
+
+/*
+    Driver of the MPU6500 on the I2C bus
+*/
+class MPU6500 {
+    public:
+        MPU6500(i2c_inst_t* i2c, uint8_t addr);
+
+        /*
+            @brief Wakes the sensor up and sets the full scale ranges
+
+            @param accelRange AFS_SEL, ±2g << accelRange (0-3)
+            @param gyroRange FS_SEL, ±250 deg/s << gyroRange (0-3)
+
+            @returns true if the sensor answered with the right WHO_AM_I
+        */
+        bool begin(uint8_t accelRange, uint8_t gyroRange);
+
+        /*
+            @brief Reads accel, temperature and gyro with one burst read starting at ACCEL_XOUT_H
+
+            @param sample the sample to fill in
+
+            @returns true on success, false if the transaction failed
+        */
+        bool read(imu_sample& sample);
+
+        /*
+            @brief Converts the 14 big-endian bytes starting at ACCEL_XOUT_H into a sample, without any I/O
+        */
+        void parse(const uint8_t* data, imu_sample& sample);
+
+        /*
+            @brief Converts raw FIFO values into g and deg/s with the current ranges, without any I/O
+        */
+        void toSample(const imu_raw& raw, imu_sample& sample);
+
+        /*
+            @brief Samples accel and gyro into the on-chip FIFO at 1 kHz. Has to be called after `begin()`.
+            The data ready interrupt of the sensor, on `intPin`, timestamps the samples and tells when a batch is waiting
+
+            @param intPin the GPIO the INT pin of the sensor is connected to
+            @param batch how many samples have to be in the FIFO before `fifoReady()` returns true
+
+            @returns true on success
+        */
+        bool beginFifo(uint intPin, int batch = MPU_FIFO_BATCH);
+
+        /*
+            @brief Returns true if at least a batch of samples is waiting in the FIFO
+        */
+        bool fifoReady();
+
+        /*
+            @brief Reads every sample in the FIFO in one burst. Timestamps are reconstructed from the time of the
+            last data ready interrupt and the measured sample period, the newest sample being the last one.
+            If the FIFO overflowed, it is reset and the samples in it are dropped
+
+            @param samples where the samples are stored, oldest first
+            @param max the size of `samples`, at least MPU_FIFO_SIZE / MPU_FIFO_SAMPLE_SIZE to never leave samples behind
+
+            @returns number of samples read, or -1 on error or overflow
+        */
+        int drainFifo(imu_sample* samples, int max);
+
+        /*
+            @brief Drains the FIFO in the background from now on: the data ready interrupt queues the reads on `queue`
+            as soon as a batch is waiting, and `callback` gets the samples. `drainFifo()` must not be used anymore
+
+            @param queue the queue of the bus the sensor is on, it has to be started already
+            @param callback called from the I2C interrupt with each batch of raw samples
+        */
+        void drainAsync(I2CQueue* queue, imu_callback_t callback);
+
+        /* @returns the sample period measured from the data ready interrupts, in microseconds */
+        uint32_t getSamplePeriod();
+
+        /* @returns how many times the FIFO overflowed since `beginFifo()` */
+        uint32_t getOverflows();
+
+    private:
+        bool writeReg(uint8_t reg, uint8_t val);
+        bool readRegs(uint8_t reg, uint8_t* data, int length);
+        void resetFifo();
+        void decode(const uint8_t* accel, const uint8_t* gyro, imu_raw& raw);
+        int unpackFifo(const uint8_t* data, int count, int n, uint32_t after, uint64_t newestUs, imu_raw* samples);
+
+        void startDrain();
+        static void onCount(int result, void* ctx);
+        static void onData(int result, void* ctx);
+        static void onReset(int result, void* ctx);
+
+        static void onDataReady();
+        static MPU6500* fifoInstance;
+
+        i2c_inst_t* i2c;
+        uint8_t addr;
+
+        // multiplied with the raw values, so no division is needed per sample
+        float accelScale;
+        float gyroScale;
+
+        uint intPin;
+        int batch;
+
+        // written by the data ready interrupt
+        volatile uint32_t readyCount;
+        volatile uint64_t lastReadyUs;
+        volatile bool overflowed;
+
+        uint32_t drainedCount;   // value of readyCount at the last drain
+        uint64_t periodStartUs;  // data ready time and count the sample period is measured from
+        uint32_t periodStartCount;
+        uint32_t samplePeriodUs;
+        uint32_t overflows;
+
+        // background draining
+        I2CQueue* queue;
+        imu_callback_t callback;
+        volatile bool draining;
+        uint8_t drainCountData[2];
+        uint32_t drainBefore;   // readyCount when the FIFO count was requested
+        uint32_t drainAfter;
+        uint64_t drainNewestUs;
+        int drainCount;
+        uint8_t drainData[MPU_FIFO_CAPACITY * MPU_FIFO_SAMPLE_SIZE];
+        imu_raw drainSamples[MPU_FIFO_CAPACITY];
+};
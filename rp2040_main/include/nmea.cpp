@@ -0,0 +1,241 @@
+#include "nmea.hpp"
+#include <cstring>
+
+#define KNOTS_TO_MS 0.514444f
+
+// Parses a decimal number into an integer scaled by 10^decimals, extra decimals are cut off.
+// Returns false for an empty or malformed field
+static bool parse_fixed(const char* s, int decimals, int32_t& value)
+{
+    bool negative = *s == '-';
+    if (negative) s++;
+
+    int32_t v = 0;
+    int digits = 0;
+    while (*s >= '0' && *s <= '9')
+    {
+        v = v * 10 + (*s++ - '0');
+        digits++;
+    }
+
+    int fraction = 0;
+    if (*s == '.')
+    {
+        s++;
+        while (*s >= '0' && *s <= '9')
+        {
+            if (fraction < decimals)
+            {
+                v = v * 10 + (*s - '0');
+                fraction++;
+            }
+            s++;
+            digits++;
+        }
+    }
+
+    if (digits == 0 || *s != '\0') return false;
+
+    for (; fraction < decimals; fraction++) v *= 10;
+    value = negative ? -v : v;
+    return true;
+}
+
+// dddmm.mmmmm into 1e-7 degrees
+static bool parse_coordinate(const char* s, int32_t& value)
+{
+    int32_t v;
+    if (!parse_fixed(s, 5, v)) return false;
+
+    int32_t degrees = v / 10000000;
+    int32_t minutes = v % 10000000; // 1e-5 minutes
+
+    value = degrees * 10000000 + (int32_t) ((int64_t) minutes * 5 / 3);
+    return true;
+}
+
+// hhmmss.sss into ms of the day
+static bool parse_time(const char* s, uint32_t& ms)
+{
+    int32_t v;
+    if (!parse_fixed(s, 3, v)) return false;
+
+    int32_t hours = v / 10000000;
+    int32_t minutes = v / 100000 % 100;
+    ms = (hours * 3600 + minutes * 60) * 1000 + v % 100000;
+    return true;
+}
+
+static bool parse_float(const char* s, int decimals, float scale, float& value)
+{
+    int32_t v;
+    if (!parse_fixed(s, decimals, v)) return false;
+
+    value = v * scale;
+    return true;
+}
+
+static int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+NmeaParser::NmeaParser()
+{
+    state = IDLE;
+    sentence = OTHER;
+    std::memset(&fix, 0, sizeof(fix));
+    sentences = 0;
+    errors = 0;
+}
+
+bool NmeaParser::feed(char c)
+{
+    // a new sentence can start anywhere, whatever came before it was cut off
+    if (c == '$')
+    {
+        if (state != IDLE && sentence != OTHER) errors++;
+
+        state = BODY;
+        sentence = OTHER;
+        checksum = 0;
+        fieldIndex = 0;
+        fieldLength = 0;
+        overflow = false;
+        pending = fix;
+        return false;
+    }
+
+    switch (state)
+    {
+        case BODY:
+            if (c == '*')
+            {
+                endField();
+                state = CHECKSUM;
+                received = 0;
+                checksumDigits = 0;
+                return false;
+            }
+
+            // the checksum is mandatory for GGA and RMC
+            if (c == '\r' || c == '\n')
+            {
+                if (sentence != OTHER) errors++;
+                state = IDLE;
+                return false;
+            }
+
+            checksum ^= c;
+            if (c == ',') endField();
+            else if (sentence != OTHER || fieldIndex == 0)
+            {
+                if (fieldLength < NMEA_MAX_FIELD) field[fieldLength++] = c;
+                else overflow = true;
+            }
+            return false;
+
+        case CHECKSUM:
+        {
+            int digit = hex_digit(c);
+            if (digit < 0)
+            {
+                if (sentence != OTHER) errors++;
+                state = IDLE;
+                return false;
+            }
+
+            received = (received << 4) | digit;
+            if (++checksumDigits < 2) return false;
+
+            state = IDLE;
+            if (sentence == OTHER) return false;
+
+            if (received != checksum || overflow)
+            {
+                errors++;
+                return false;
+            }
+
+            fix = pending;
+            sentences++;
+            return true;
+        }
+
+        default:
+            return false;
+    }
+}
+
+void NmeaParser::endField()
+{
+    field[fieldLength] = '\0';
+
+    if (fieldIndex == 0)
+    {
+        // talker (GP, GN, ...) and the sentence type
+        if (fieldLength == 5 && std::strcmp(field + 2, "GGA") == 0) sentence = GGA;
+        else if (fieldLength == 5 && std::strcmp(field + 2, "RMC") == 0) sentence = RMC;
+    }
+    else if (sentence == GGA) parseGga();
+    else if (sentence == RMC) parseRmc();
+
+    fieldIndex++;
+    fieldLength = 0;
+}
+
+// $GPGGA,time,lat,N,lon,E,quality,satellites,hdop,altitude,M,geoid,M,age,station*cs
+void NmeaParser::parseGga()
+{
+    int32_t v;
+
+    switch (fieldIndex)
+    {
+        case 1: parse_time(field, pending.utc_ms); break;
+        case 2: if (!parse_coordinate(field, coordinate)) coordinate = INT32_MIN; break;
+        case 3: if (coordinate != INT32_MIN) pending.latitude = field[0] == 'S' ? -coordinate : coordinate; break;
+        case 4: if (!parse_coordinate(field, coordinate)) coordinate = INT32_MIN; break;
+        case 5: if (coordinate != INT32_MIN) pending.longitude = field[0] == 'W' ? -coordinate : coordinate; break;
+        case 6: if (parse_fixed(field, 0, v)) pending.quality = v; break;
+        case 7: if (parse_fixed(field, 0, v)) pending.satellites = v; break;
+        case 8: parse_float(field, 2, 0.01f, pending.hdop); break;
+        case 9: parse_float(field, 2, 0.01f, pending.altitude); break;
+    }
+}
+
+// $GPRMC,time,status,lat,N,lon,E,speed,course,date,variation,E,mode*cs
+void NmeaParser::parseRmc()
+{
+    int32_t v;
+
+    switch (fieldIndex)
+    {
+        case 1: parse_time(field, pending.utc_ms); break;
+        case 2: pending.valid = field[0] == 'A'; break;
+        case 3: if (!parse_coordinate(field, coordinate)) coordinate = INT32_MIN; break;
+        case 4: if (coordinate != INT32_MIN) pending.latitude = field[0] == 'S' ? -coordinate : coordinate; break;
+        case 5: if (!parse_coordinate(field, coordinate)) coordinate = INT32_MIN; break;
+        case 6: if (coordinate != INT32_MIN) pending.longitude = field[0] == 'W' ? -coordinate : coordinate; break;
+        case 7: parse_float(field, 2, 0.01f * KNOTS_TO_MS, pending.speed); break;
+        case 8: parse_float(field, 2, 0.01f, pending.course); break;
+        case 9: if (parse_fixed(field, 0, v)) pending.date = v; break;
+    }
+}
+
+const gps_fix& NmeaParser::getFix()
+{
+    return fix;
+}
+
+uint32_t NmeaParser::getSentences()
+{
+    return sentences;
+}
+
+uint32_t NmeaParser::getErrors()
+{
+    return errors;
+}
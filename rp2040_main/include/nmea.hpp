@@ -0,0 +1,73 @@
+#pragma once
+#include <cstdint>
+
+#define NMEA_MAX_FIELD 16 // longest field that is parsed, e.g. "4807.0382312"
+
+// Everything the GGA and RMC sentences say about the position
+struct gps_fix {
+    uint64_t time_us;   // when the sentence arrived, time_us_64(), set by the reader
+    uint32_t utc_ms;    // UTC time of day of the fix, ms
+    uint32_t date;      // ddmmyy, 0 until an RMC arrived
+    int32_t latitude;   // 1e-7 degrees, north positive
+    int32_t longitude;  // 1e-7 degrees, east positive
+    float altitude;     // above mean sea level, m
+    float speed;        // over ground, m/s
+    float course;       // over ground, degrees from north
+    float hdop;         // horizontal dilution of precision
+    uint8_t quality;    // GGA fix quality, 0 = no fix
+    uint8_t satellites; // used in the fix
+    bool valid;         // RMC status, A = valid
+};
+
+/*
+    Incremental NMEA 0183 parser, fed one character at a time. Fields of GGA and RMC sentences (any talker, e.g. GP or GN)
+    are converted as they arrive, with integer arithmetic, into a copy of the fix. The copy only replaces the fix once the
+    checksum matched, so a corrupted sentence never changes it. Nothing is allocated, and other sentences are skipped
+*/
+class NmeaParser {
+    public:
+        NmeaParser();
+
+        /*
+            @brief Feeds the next received character
+
+            @returns true if a GGA or RMC sentence was completed and the fix was updated
+        */
+        bool feed(char c);
+
+        /* @returns the last fix, its fields are only as new as the sentences that carry them */
+        const gps_fix& getFix();
+
+        /* @returns number of valid GGA and RMC sentences */
+        uint32_t getSentences();
+
+        /* @returns number of sentences with a wrong checksum, or that were too long */
+        uint32_t getErrors();
+
+    private:
+        enum State { IDLE, BODY, CHECKSUM };
+        enum Sentence { OTHER, GGA, RMC };
+
+        void endField();
+        void parseGga();
+        void parseRmc();
+
+        State state;
+        Sentence sentence;
+        uint8_t checksum;       // XOR of everything between $ and *
+        uint8_t received;       // the checksum at the end of the sentence
+        int checksumDigits;
+        int fieldIndex;
+        int fieldLength;
+        char field[NMEA_MAX_FIELD + 1];
+        bool overflow;          // a field was longer than NMEA_MAX_FIELD
+
+        // hemisphere comes in the field after the coordinate
+        int32_t coordinate;
+
+        gps_fix pending;
+        gps_fix fix;
+
+        uint32_t sentences;
+        uint32_t errors;
+};
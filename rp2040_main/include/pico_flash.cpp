@@ -0,0 +1,47 @@
+#include "pico_flash.hpp"
+#include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+
+// end of the program in flash, from the linker script
+extern char __flash_binary_end;
+
+PicoFlash::PicoFlash(uint32_t offset, uint32_t size)
+{
+    this->offset = offset;
+    length = size;
+}
+
+uint32_t PicoFlash::size()
+{
+    return length;
+}
+
+const uint8_t* PicoFlash::read(uint32_t address)
+{
+    return (const uint8_t*) (XIP_BASE + offset + address);
+}
+
+void PicoFlash::program(uint32_t address, const uint8_t* page)
+{
+    multicore_lockout_start_blocking();
+    uint32_t status = save_and_disable_interrupts();
+    flash_range_program(offset + address, page, FLASH_PAGE_SIZE);
+    restore_interrupts(status);
+    multicore_lockout_end_blocking();
+}
+
+void PicoFlash::erase(uint32_t address)
+{
+    multicore_lockout_start_blocking();
+    uint32_t status = save_and_disable_interrupts();
+    flash_range_erase(offset + address, FLASH_SECTOR_SIZE);
+    restore_interrupts(status);
+    multicore_lockout_end_blocking();
+}
+
+bool PicoFlash::isFree()
+{
+    return (uintptr_t) &__flash_binary_end <= XIP_BASE + offset && offset + length <= PICO_FLASH_SIZE_BYTES;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+#include "flash.hpp"
+
+/*
+    A region of the QSPI flash the program runs from. The flash can't be read while it is programmed or erased,
+    so both cores are stopped for that time: this core with its interrupts disabled, the other one waiting in RAM.
+    The other core has to call `multicore_lockout_victim_init()` before this is used.
+    A page takes about 0.5 ms, a sector about 45 ms (up to 400 ms)
+*/
+class PicoFlash : public FlashMemory {
+    public:
+        /*
+            @param offset start of the region from the start of the flash, sector aligned
+            @param size size of the region, a multiple of the sector size
+        */
+        PicoFlash(uint32_t offset, uint32_t size);
+
+        uint32_t size() override;
+        const uint8_t* read(uint32_t address) override;
+        void program(uint32_t address, const uint8_t* page) override;
+        void erase(uint32_t address) override;
+
+        /* @returns true if the region starts after the end of the program */
+        bool isFree();
+
+    private:
+        uint32_t offset;
+        uint32_t length;
+};
@@ -0,0 +1,111 @@
+#include "profiler.hpp"
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/structs/systick.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+
+uint32_t Profiler::clockCyclesPerUs = 125;
+
+Profiler::Profiler(const char* const* names, int count)
+{
+    this->names = names;
+    this->count = count < PROFILE_MAX_SECTIONS ? count : PROFILE_MAX_SECTIONS;
+    reset();
+}
+
+void Profiler::beginCore()
+{
+    clockCyclesPerUs = clock_get_hz(clk_sys) / 1000000;
+
+    systick_hw->rvr = 0x00FFFFFF;
+    systick_hw->cvr = 0;
+    systick_hw->csr = 0x5; // enabled, processor clock
+}
+
+profile_mark Profiler::now()
+{
+    return {systick_hw->cvr, timer_hw->timerawl};
+}
+
+uint32_t Profiler::cyclesSince(const profile_mark& start)
+{
+    uint32_t systick = systick_hw->cvr;
+    uint32_t us = timer_hw->timerawl - start.us;
+
+    // SysTick counts down, and wraps after 2^24 cycles
+    if (us < PROFILE_SYSTICK_LIMIT_US) return (start.systick - systick) & 0x00FFFFFF;
+    return us * clockCyclesPerUs;
+}
+
+uint32_t Profiler::cyclesPerUs()
+{
+    return clockCyclesPerUs;
+}
+
+void Profiler::record(int section, uint32_t cycles)
+{
+    if (section < 0 || section >= count) return;
+
+    int bucket = cycles ? 31 - __builtin_clz(cycles) : 0;
+    if (bucket >= PROFILE_BUCKETS) bucket = PROFILE_BUCKETS - 1;
+
+    // sections can be measured in interrupts as well
+    uint32_t status = save_and_disable_interrupts();
+
+    ProfileStats& s = stats[section];
+    if (s.count == 0 || cycles < s.min) s.min = cycles;
+    if (cycles > s.max) s.max = cycles;
+    s.count++;
+    s.total += cycles;
+    s.histogram[bucket]++;
+
+    restore_interrupts(status);
+}
+
+int Profiler::getSectionCount()
+{
+    return count;
+}
+
+const char* Profiler::getName(int section)
+{
+    return names[section];
+}
+
+ProfileStats Profiler::getStats(int section)
+{
+    uint32_t status = save_and_disable_interrupts();
+    ProfileStats s = stats[section];
+    restore_interrupts(status);
+
+    return s;
+}
+
+void Profiler::reset()
+{
+    uint32_t status = save_and_disable_interrupts();
+    for (int i = 0; i < PROFILE_MAX_SECTIONS; i++) stats[i] = {};
+    restore_interrupts(status);
+}
+
+void Profiler::print()
+{
+    for (int i = 0; i < count; i++)
+    {
+        ProfileStats s = getStats(i);
+        if (s.count == 0) continue;
+
+        uint32_t mean = (uint32_t) (s.total / s.count);
+        printf("%-12s %lu runs, cycles min %lu mean %lu max %lu (max %lu us)\n", names[i], s.count, s.min, mean, s.max,
+            s.max / clockCyclesPerUs);
+
+        // only the buckets that were hit, as the lower bound in cycles
+        printf("             ");
+        for (int b = 0; b < PROFILE_BUCKETS; b++)
+        {
+            if (s.histogram[b]) printf(" %lu%s:%lu", 1ul << b, b == PROFILE_BUCKETS - 1 ? "+" : "", s.histogram[b]);
+        }
+        printf("\n");
+    }
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <cstdint>
+
+#define PROFILE_MAX_SECTIONS 16
+// Powers of two of cycles, bucket i counts [2^i, 2^(i+1)). The last one takes everything from 2^23 (67 ms at 125 MHz)
+#define PROFILE_BUCKETS 24
+// Up to this long SysTick (24 bits, 134 ms at 125 MHz) counts the cycles, anything longer is taken from the 1 MHz timer
+#define PROFILE_SYSTICK_LIMIT_US 100000
+
+// Timing of one section, all times in processor cycles
+struct ProfileStats {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t total;
+    uint32_t histogram[PROFILE_BUCKETS];
+};
+
+// Where a measurement started, both clocks
+struct profile_mark {
+    uint32_t systick;
+    uint32_t us;
+};
+
+/*
+    Cycle counts of sections of code, kept as min, max, mean and a histogram in RAM.
+    A measurement costs two reads of SysTick and the timer, and about 30 cycles to add it with the interrupts disabled,
+    so it can stay in the firmware. SysTick belongs to the core, every core that measures has to call `beginCore()`
+*/
+class Profiler {
+    public:
+        /*
+            @param names name of every section, the index is the id
+            @param count number of sections, at most PROFILE_MAX_SECTIONS
+        */
+        Profiler(const char* const* names, int count);
+
+        /* @brief Starts SysTick on the calling core, counting processor cycles */
+        static void beginCore();
+
+        /* @returns the current time on both clocks of the calling core */
+        static profile_mark now();
+
+        /* @returns processor cycles since `start`, which has to be from the calling core */
+        static uint32_t cyclesSince(const profile_mark& start);
+
+        /* @returns how many processor cycles a microsecond has */
+        static uint32_t cyclesPerUs();
+
+        /*
+            @brief Adds a measurement
+
+            @param section id of the section
+            @param cycles how long it took
+        */
+        void record(int section, uint32_t cycles);
+
+        int getSectionCount();
+        const char* getName(int section);
+        ProfileStats getStats(int section);
+        void reset();
+
+        /* @brief Prints the statistics and the histogram of every section that ran */
+        void print();
+
+    private:
+        const char* const* names;
+        int count;
+        ProfileStats stats[PROFILE_MAX_SECTIONS];
+
+        static uint32_t clockCyclesPerUs;
+};
+
+/* Measures from its construction to the end of the scope */
+class ProfileScope {
+    public:
+        ProfileScope(Profiler& profiler, int section) : profiler(profiler), section(section), start(Profiler::now()) {}
+        ~ProfileScope() { profiler.record(section, Profiler::cyclesSince(start)); }
+
+    private:
+        Profiler& profiler;
+        int section;
+        profile_mark start;
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Print.h"
+#include "airtime.hpp"
+
+/*
+    Hardware independent interface of a LoRa radio.
+    `LoRaClass` implements it for the SX127x on the Pico, and `SimRadio` (in `host`) simulates a channel on a PC,
+    so code written against this interface can run on both
+*/
+class Radio : public Print {
+public:
+  virtual ~Radio() {}
+
+  virtual int beginPacket(int implicitHeader = false) = 0;
+  virtual int endPacket(bool async = false) = 0;
+
+  virtual int parsePacket(int size = 0) = 0;
+  virtual int packetRssi() = 0;
+  virtual float packetSnr() = 0;
+
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+
+  virtual void onReceive(void (*callback)(int)) = 0;
+  virtual void onTxDone(void (*callback)()) = 0;
+
+  virtual void receive(int size = 0) = 0;
+  virtual bool isChannelBusy() = 0; // channel activity detection
+  virtual void idle() = 0;
+  virtual void sleep() = 0;
+
+  virtual void setSpreadingFactor(int sf) = 0;
+  virtual void setSignalBandwidth(long sbw) = 0;
+  virtual void setCodingRate4(int denominator) = 0;
+  virtual void setPreambleLength(long length) = 0;
+  virtual void enableCrc() = 0;
+  virtual void disableCrc() = 0;
+
+  virtual LoRaModem getModem() = 0; // current modem settings
+
+  // time on air of a packet with the current settings, in microseconds
+  virtual long timeOnAir(int size) { return time_on_air_us(getModem(), size); }
+};
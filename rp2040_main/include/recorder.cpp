@@ -0,0 +1,256 @@
+#include "recorder.hpp"
+#include <cstring>
+
+// CRC-16/CCITT-FALSE (polynomial 0x1021), a byte at a time
+static uint16_t crc_table[256];
+
+static void init_crc_table()
+{
+    for (int i = 0; i < 256; i++)
+    {
+        uint16_t crc = i << 8;
+        for (int bit = 0; bit < 8; bit++) crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+        crc_table[i] = crc;
+    }
+}
+
+uint16_t crc16(const uint8_t* data, int length, uint16_t crc)
+{
+    if (crc_table[1] == 0) init_crc_table();
+
+    for (int i = 0; i < length; i++) crc = (crc << 8) ^ crc_table[(crc >> 8) ^ data[i]];
+    return crc;
+}
+
+int log_parse_page(const uint8_t* page, log_record* records, int max)
+{
+    if ((page[0] | (page[1] << 8)) != LOG_MAGIC) return -1;
+
+    int n = 0;
+    int pos = LOG_PAGE_HEADER;
+    while (n < max && pos + LOG_RECORD_HEADER <= FLASH_PAGE_BYTES && page[pos] != LOG_END)
+    {
+        const uint8_t* r = page + pos;
+        if (pos + LOG_RECORD_HEADER + r[1] > FLASH_PAGE_BYTES) break;
+
+        uint16_t crc = crc16(r, 2);
+        crc = crc16(r + LOG_RECORD_HEADER, r[1], crc);
+        if ((r[2] | (r[3] << 8)) != crc) break;
+
+        records[n++] = {r[0], r[1], r + LOG_RECORD_HEADER};
+        pos += LOG_RECORD_HEADER + r[1];
+    }
+
+    return n;
+}
+
+FlightRecorder::FlightRecorder(FlashMemory* flash)
+{
+    this->flash = flash;
+    // before any record can be appended from an interrupt
+    init_crc_table();
+    capacity = flash->size() / FLASH_PAGE_BYTES;
+    fill = LOG_PAGE_HEADER;
+    head = 0;
+    session = 0;
+    clearSector = 0;
+    recording = false;
+    clearing = false;
+    written = 0;
+    dropped = 0;
+}
+
+bool FlightRecorder::isBlank(uint32_t page)
+{
+    const uint32_t* p = (const uint32_t*) flash->read(page * FLASH_PAGE_BYTES);
+    for (int i = 0; i < FLASH_PAGE_BYTES / 4; i++)
+    {
+        if (p[i] != 0xFFFFFFFF) return false;
+    }
+    return true;
+}
+
+uint32_t FlightRecorder::begin()
+{
+    // the pages in use are always at the start of the log, so the first blank sector can be bisected for
+    uint32_t sectors = capacity / FLASH_PAGES_PER_SECTOR;
+    uint32_t low = 0, high = sectors;
+    while (low < high)
+    {
+        uint32_t mid = (low + high) / 2;
+        if (isBlank(mid * FLASH_PAGES_PER_SECTOR)) high = mid;
+        else low = mid + 1;
+    }
+
+    // then the first blank page in the sector before it. A page cut off by a power loss isn't blank, it is skipped
+    head = low * FLASH_PAGES_PER_SECTOR;
+    while (head > 0 && isBlank(head - 1)) head--;
+
+    // the session of the last page that made it. Pages are written from the start, so the header of a page
+    // with a valid record is complete
+    session = 0;
+    for (uint32_t page = head; page > 0; page--)
+    {
+        const uint8_t* p = flash->read((page - 1) * FLASH_PAGE_BYTES);
+        log_record record;
+        if (log_parse_page(p, &record, 1) > 0)
+        {
+            session = p[2] | (p[3] << 8);
+            break;
+        }
+    }
+    session++;
+
+    written = 0;
+    return head;
+}
+
+bool FlightRecorder::append(uint8_t type, const void* payload, int length)
+{
+    if (length > LOG_MAX_RECORD) return false;
+
+    bool queued = true;
+    if (fill + LOG_RECORD_HEADER + length > FLASH_PAGE_BYTES)
+    {
+        queued = queue.size() < LOG_RAM_PAGES - 1;
+        flush();
+    }
+
+    uint8_t* r = current.data + fill;
+    r[0] = type;
+    r[1] = length;
+    std::memcpy(r + LOG_RECORD_HEADER, payload, length);
+
+    uint16_t crc = crc16(r, 2);
+    crc = crc16(r + LOG_RECORD_HEADER, length, crc);
+    r[2] = crc & 0xFF;
+    r[3] = crc >> 8;
+
+    fill += LOG_RECORD_HEADER + length;
+    return queued;
+}
+
+int FlightRecorder::getRoom()
+{
+    int room = FLASH_PAGE_BYTES - fill - LOG_RECORD_HEADER;
+    return room > 0 ? room : 0;
+}
+
+void FlightRecorder::flush()
+{
+    if (fill == LOG_PAGE_HEADER) return;
+
+    // left erased, so the rest of the page can be told from a record
+    std::memset(current.data + fill, 0xFF, FLASH_PAGE_BYTES - fill);
+    queue.push(current);
+    fill = LOG_PAGE_HEADER;
+}
+
+void FlightRecorder::setRecording(bool recording)
+{
+    this->recording = recording;
+}
+
+bool FlightRecorder::isRecording()
+{
+    return recording;
+}
+
+void FlightRecorder::clear()
+{
+    if (clearing) return;
+
+    // from the last sector in use down, the log stays contiguous if this is cut off
+    clearSector = (head + FLASH_PAGES_PER_SECTOR - 1) / FLASH_PAGES_PER_SECTOR;
+    clearing = true;
+}
+
+bool FlightRecorder::isClearing()
+{
+    return clearing;
+}
+
+int FlightRecorder::service(bool mayErase)
+{
+    Page page;
+
+    if (clearing)
+    {
+        if (mayErase)
+        {
+            if (clearSector > 0)
+            {
+                clearSector--;
+                flash->erase(clearSector * FLASH_SECTOR_BYTES);
+                head = clearSector * FLASH_PAGES_PER_SECTOR;
+            }
+            if (clearSector == 0)
+            {
+                head = 0;
+                clearing = false;
+            }
+        }
+    }
+
+    // nothing is written while the log is erased or not recording, only the newest pages are kept
+    if (clearing || !recording)
+    {
+        while (queue.size() > LOG_PRETRIGGER_PAGES) queue.pop(page);
+        return 0;
+    }
+
+    int n = 0;
+    while (queue.pop(page))
+    {
+        // a page left behind by a power loss during a write can't be written again
+        while (head < capacity && !isBlank(head)) head++;
+
+        if (head == capacity)
+        {
+            dropped++;
+            continue;
+        }
+
+        page.data[0] = LOG_MAGIC & 0xFF;
+        page.data[1] = LOG_MAGIC >> 8;
+        page.data[2] = session & 0xFF;
+        page.data[3] = session >> 8;
+
+        flash->program(head * FLASH_PAGE_BYTES, page.data);
+        head++;
+        written++;
+        n++;
+    }
+
+    return n;
+}
+
+const uint8_t* FlightRecorder::getPage(uint32_t index)
+{
+    return flash->read(index * FLASH_PAGE_BYTES);
+}
+
+uint32_t FlightRecorder::getUsed()
+{
+    return head;
+}
+
+uint32_t FlightRecorder::getCapacity()
+{
+    return capacity;
+}
+
+uint16_t FlightRecorder::getSession()
+{
+    return session;
+}
+
+uint32_t FlightRecorder::getWritten()
+{
+    return written;
+}
+
+uint32_t FlightRecorder::getDropped()
+{
+    return dropped + queue.getDropped();
+}
@@ -0,0 +1,176 @@
+#pragma once
+#include <cstdint>
+#include "flash.hpp"
+#include "spsc_queue.hpp"
+
+/*
+    Layout of the log: pages filled from the start of the region, never rewritten until the whole log is cleared.
+    Page: magic (2), session (2), records, 0xFF up to the end of the page.
+    Record: type (1), payload length (1), CRC-16 of type, length and payload (2), payload.
+    A page cut off by a power loss keeps the records before the cut, the CRC tells where it ends
+*/
+#define LOG_MAGIC 0xB10C
+#define LOG_PAGE_HEADER 4
+#define LOG_RECORD_HEADER 4
+#define LOG_MAX_RECORD (FLASH_PAGE_BYTES - LOG_PAGE_HEADER - LOG_RECORD_HEADER)
+#define LOG_END 0xFF // type of the erased rest of a page
+
+// Pages waiting in RAM, about 1.2 s of raw IMU samples. Before the recording starts the newest ones are kept,
+// so the moments before the launch end up in the log
+#define LOG_RAM_PAGES 64
+#define LOG_PRETRIGGER_PAGES 48
+
+/*
+    Records written by the firmware, all values little endian:
+    LOG_CONFIG: afs_sel, fs_sel, 21 bytes of BMP390 calibration data (see parse_calib_data()), written once per session
+    LOG_IMU: time of the first sample (us, 8), time between samples (us, 2), then accel xyz and gyro xyz as they come
+        out of the MPU6500 FIFO (2 each), up to LOG_IMU_SAMPLES samples
+    LOG_BARO: up to LOG_BARO_FRAMES frames of time (us, 8), uncompensated temperature (4) and pressure (4)
+    LOG_PHASE: time (us, 8), new flight_phase_t (1)
+    LOG_GPS: time (us, 8), latitude, longitude (1e-7 deg, 4 each), altitude (m, float), speed (m/s, float),
+        course (deg, float), UTC time of day (ms, 4), satellites (1), quality (1)
+    LOG_RADIO: time of the TX or RX done interrupt (us, 8), log_radio_t (1)
+
+    All times are time_us_64() at acquisition: the FIFO read, spread back over the samples in it, the DIO0
+    interrupt of the radio, and the start of the UART burst of the GPS message
+*/
+enum log_record_t {
+    LOG_CONFIG = 1,
+    LOG_IMU,
+    LOG_BARO,
+    LOG_PHASE,
+    LOG_GPS,
+    LOG_RADIO,
+};
+
+enum log_radio_t {
+    LOG_RADIO_TX = 1,
+    LOG_RADIO_RX,
+};
+
+#define LOG_IMU_SAMPLES 19
+#define LOG_BARO_FRAMES 15
+
+// a record read back from the log, `payload` points into the page
+struct log_record {
+    uint8_t type;
+    uint8_t length;
+    const uint8_t* payload;
+};
+
+/*
+    @brief CRC-16/CCITT-FALSE, continued from `crc`
+*/
+uint16_t crc16(const uint8_t* data, int length, uint16_t crc = 0xFFFF);
+
+/*
+    @brief Splits a page of the log into its records
+
+    @param page FLASH_PAGE_BYTES bytes
+    @param records where the records are stored
+    @param max the size of `records`
+
+    @returns number of valid records before the end of the page or the first broken one, -1 if it isn't a log page
+*/
+int log_parse_page(const uint8_t* page, log_record* records, int max);
+
+/*
+    Black box recorder: an append-only log in flash, written a page at a time.
+    Records are collected into pages by `append()`, which never touches the flash, so it can be called from the
+    sensor interrupts. Whole pages are queued in RAM and written by `service()` from a task, which is also the only
+    place that erases. The log is never overwritten: it stops when it is full, and only `clear()` erases it, one
+    sector per `service()` call, from the end, so a log cut off by a power loss during the erase is still valid.
+    After a reset `begin()` finds the end of the log by bisection and continues after it, in a new session.
+
+    One producer (`append()`, `flush()`) and one consumer (`service()`), like `SpscQueue`
+*/
+class FlightRecorder {
+    public:
+        FlightRecorder(FlashMemory* flash);
+
+        /*
+            @brief Finds the end of the log, reading about 10 sectors
+
+            @returns number of pages in use
+        */
+        uint32_t begin();
+
+        /*
+            @brief Adds a record to the current page, and queues the page when it is full
+
+            @param type log_record_t
+            @param payload `length` bytes
+            @param length at most LOG_MAX_RECORD
+
+            @returns false if the record is too long, or the page queue was full and a page was dropped
+        */
+        bool append(uint8_t type, const void* payload, int length);
+
+        /* @returns the longest payload that still fits into the current page, called by the producer only */
+        int getRoom();
+
+        /* @brief Queues the current page even if it isn't full */
+        void flush();
+
+        /*
+            @brief Starts or stops writing the queued pages to flash.
+            While stopped only the newest LOG_PRETRIGGER_PAGES pages are kept in RAM
+        */
+        void setRecording(bool recording);
+        bool isRecording();
+
+        /* @brief Erases the whole log, in the background of `service()` */
+        void clear();
+        bool isClearing();
+
+        /*
+            @brief Writes the queued pages if recording, and erases a sector if clearing and allowed to.
+            Every page stops both cores for about 0.5 ms, every sector for about 45 ms
+
+            @param mayErase false while a sector erase would cost sensor samples (the IMU FIFO lasts 42 ms)
+
+            @returns number of pages written
+        */
+        int service(bool mayErase);
+
+        /* @returns the page at `index`, FLASH_PAGE_BYTES bytes */
+        const uint8_t* getPage(uint32_t index);
+
+        /* @returns number of pages in use, and in the whole log */
+        uint32_t getUsed();
+        uint32_t getCapacity();
+
+        /* @returns number of this session, counted up on every `begin()` */
+        uint16_t getSession();
+
+        /* @returns number of pages written since `begin()` */
+        uint32_t getWritten();
+
+        /* @returns number of pages lost because the queue was full or the log was */
+        uint32_t getDropped();
+
+    private:
+        struct Page {
+            uint8_t data[FLASH_PAGE_BYTES];
+        };
+
+        bool isBlank(uint32_t page);
+
+        FlashMemory* flash;
+        uint32_t capacity;
+
+        // producer
+        Page current;
+        int fill;
+        SpscQueue<Page, LOG_RAM_PAGES> queue;
+
+        // consumer
+        uint32_t head;        // next page to write
+        uint16_t session;
+        uint32_t clearSector; // next sector to erase, counting down
+        volatile bool recording;
+        volatile bool clearing;
+
+        uint32_t written;
+        uint32_t dropped;
+};
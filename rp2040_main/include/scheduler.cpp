@@ -0,0 +1,215 @@
+#include "scheduler.hpp"
+#include "pico/stdlib.h"
+#include "hardware/timer.h"
+#include "hardware/sync.h"
+
+Scheduler* Scheduler::instances[4] = {nullptr, nullptr, nullptr, nullptr};
+
+Scheduler::Scheduler()
+{
+    taskCount = 0;
+    alarm = -1;
+}
+
+int Scheduler::addTask(const char* name, task_fn_t fn, uint32_t periodUs, uint32_t deadlineUs, bool inInterrupt)
+{
+    if (taskCount == SCHEDULER_MAX_TASKS || alarm >= 0) return -1;
+
+    Task& task = tasks[taskCount];
+    task.name = name;
+    task.fn = fn;
+    task.period = periodUs;
+    task.deadline = deadlineUs ? deadlineUs : periodUs;
+    task.inInterrupt = inInterrupt;
+    task.nextRelease = 0;
+    task.release = 0;
+    task.pending = false;
+    task.stats = {};
+
+    return taskCount++;
+}
+
+void Scheduler::setPeriod(int task, uint32_t periodUs, uint32_t deadlineUs)
+{
+    uint32_t status = save_and_disable_interrupts();
+
+    Task& t = tasks[task];
+    t.period = periodUs;
+    t.deadline = deadlineUs ? deadlineUs : periodUs;
+
+    // don't wait out the rest of a long period, the alarm is moved forward if needed
+    uint64_t next = time_us_64() + periodUs;
+    if (alarm >= 0 && t.nextRelease > next)
+    {
+        t.nextRelease = next;
+        handleAlarm();
+    }
+
+    restore_interrupts(status);
+}
+
+bool Scheduler::begin()
+{
+    alarm = hardware_alarm_claim_unused(false);
+    if (alarm < 0) return false;
+
+    instances[alarm] = this;
+    hardware_alarm_set_callback(alarm, &Scheduler::onAlarm);
+
+    uint64_t now = time_us_64();
+    for (int i = 0; i < taskCount; i++) tasks[i].nextRelease = now;
+
+    handleAlarm();
+    return true;
+}
+
+bool Scheduler::runPending()
+{
+    // earliest deadline first
+    uint32_t status = save_and_disable_interrupts();
+
+    Task* next = nullptr;
+    for (int i = 0; i < taskCount; i++)
+    {
+        Task& task = tasks[i];
+        if (task.pending && (!next || task.release + task.deadline < next->release + next->deadline)) next = &task;
+    }
+
+    uint64_t release = 0;
+    if (next)
+    {
+        next->pending = false;
+        release = next->release;
+    }
+
+    restore_interrupts(status);
+
+    if (!next) return false;
+
+    execute(*next, release);
+    return true;
+}
+
+void Scheduler::run()
+{
+    for (;;)
+    {
+        if (runPending()) continue;
+
+        // with interrupts disabled a release can't slip in between the check and the sleep,
+        // the pending interrupt still wakes the core up
+        uint32_t status = save_and_disable_interrupts();
+        bool released = false;
+        for (int i = 0; i < taskCount; i++) released |= tasks[i].pending;
+        if (!released) __wfi();
+        restore_interrupts(status);
+    }
+}
+
+int Scheduler::getTaskCount()
+{
+    return taskCount;
+}
+
+const char* Scheduler::getName(int task)
+{
+    return tasks[task].name;
+}
+
+TaskStats Scheduler::getStats(int task)
+{
+    uint32_t status = save_and_disable_interrupts();
+    TaskStats stats = tasks[task].stats;
+    restore_interrupts(status);
+
+    return stats;
+}
+
+void Scheduler::resetStats()
+{
+    uint32_t status = save_and_disable_interrupts();
+    for (int i = 0; i < taskCount; i++) tasks[i].stats = {};
+    restore_interrupts(status);
+}
+
+void Scheduler::printStats()
+{
+    for (int i = 0; i < taskCount; i++)
+    {
+        TaskStats stats = getStats(i);
+        uint32_t meanJitter = stats.runs ? (uint32_t) (stats.totalJitter / stats.runs) : 0;
+
+        printf("%-10s runs %lu missed %lu skipped %lu jitter mean %lu max %lu us, run max %lu us, slack min %ld us\n",
+            tasks[i].name, stats.runs, stats.misses, stats.skipped, meanJitter, stats.maxJitter, stats.maxRun, stats.minSlack);
+    }
+}
+
+void Scheduler::execute(Task& task, uint64_t release)
+{
+    uint64_t start = time_us_64();
+    task.fn();
+    uint64_t end = time_us_64();
+
+    // interrupt tasks update their statistics in the interrupt, the others could be interrupted by it
+    uint32_t status = save_and_disable_interrupts();
+
+    TaskStats& stats = task.stats;
+    uint32_t jitter = (uint32_t) (start - release);
+    uint32_t runTime = (uint32_t) (end - start);
+
+    stats.runs++;
+    stats.totalJitter += jitter;
+    if (jitter > stats.maxJitter) stats.maxJitter = jitter;
+    if (runTime > stats.maxRun) stats.maxRun = runTime;
+    if (end - release > task.deadline) stats.misses++;
+
+    int32_t slack = (int32_t) (task.deadline - (uint32_t) (end - release));
+    if (stats.runs == 1 || slack < stats.minSlack) stats.minSlack = slack;
+
+    restore_interrupts(status);
+}
+
+void Scheduler::handleAlarm()
+{
+    uint64_t next;
+
+    // releasing tasks takes time as well, keep going until the next release is in the future
+    do
+    {
+        uint64_t now = time_us_64();
+        next = UINT64_MAX;
+
+        for (int i = 0; i < taskCount; i++)
+        {
+            Task& task = tasks[i];
+
+            if (task.nextRelease <= now)
+            {
+                uint64_t release = task.nextRelease;
+
+                if (task.inInterrupt) execute(task, release);
+                else if (task.pending) task.stats.skipped++;
+                else
+                {
+                    task.release = release;
+                    task.pending = true;
+                }
+
+                // the period stays fixed, releases that were missed completely are skipped
+                task.nextRelease += task.period;
+                while (task.nextRelease <= now)
+                {
+                    task.nextRelease += task.period;
+                    task.stats.skipped++;
+                }
+            }
+
+            if (task.nextRelease < next) next = task.nextRelease;
+        }
+    } while (next != UINT64_MAX && hardware_alarm_set_target(alarm, from_us_since_boot(next)));
+}
+
+void Scheduler::onAlarm(unsigned alarmNum)
+{
+    instances[alarmNum]->handleAlarm();
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <cstdint>
+
+#define SCHEDULER_MAX_TASKS 12
+
+typedef void (*task_fn_t)();
+
+// Timing statistics of one task, all times in microseconds
+struct TaskStats {
+    uint32_t runs;
+    uint32_t misses;      // finished after their deadline
+    uint32_t skipped;     // releases dropped because the previous one hadn't run yet
+    uint32_t maxJitter;   // start time - release time
+    uint64_t totalJitter;
+    uint32_t maxRun;      // execution time
+    int32_t minSlack;     // deadline - finish time, the headroom of the worst run, negative if it missed
+};
+
+/*
+    Runs periodic tasks at fixed rates, released by a hardware alarm.
+    Interrupt tasks run directly in the alarm interrupt, so they have to be short and must not block.
+    The others are marked as released by the interrupt and run from `run()` in earliest deadline first order.
+    Every core can have its own scheduler, the alarm interrupt goes to the core that calls `begin()`
+*/
+class Scheduler {
+    public:
+        Scheduler();
+
+        /*
+            @brief Adds a periodic task. All tasks have to be added before `begin()`
+
+            @param name shown in the statistics
+            @param fn the function to run
+            @param periodUs time between two releases
+            @param deadlineUs the task has to be done this long after its release, 0 for the period
+            @param inInterrupt run directly in the alarm interrupt
+
+            @returns the id of the task, or -1 if there are too many
+        */
+        int addTask(const char* name, task_fn_t fn, uint32_t periodUs, uint32_t deadlineUs = 0, bool inInterrupt = false);
+
+        /*
+            @brief Changes the period of a task. A shorter period takes effect right away, a longer one after the next release
+
+            @param task id returned by `addTask()`
+            @param periodUs new time between two releases
+            @param deadlineUs new deadline, 0 for the period
+        */
+        void setPeriod(int task, uint32_t periodUs, uint32_t deadlineUs = 0);
+
+        /*
+            @brief Claims a hardware alarm and releases every task for the first time
+
+            @returns false if no hardware alarm is free
+        */
+        bool begin();
+
+        /*
+            @brief Runs the released task with the earliest deadline
+
+            @returns false if no task was released
+        */
+        bool runPending();
+
+        /* @brief Runs tasks forever, sleeping until the next release when there is nothing to do */
+        void run();
+
+        int getTaskCount();
+        const char* getName(int task);
+        TaskStats getStats(int task);
+        void resetStats();
+
+        /* @brief Prints the statistics of every task */
+        void printStats();
+
+    private:
+        struct Task {
+            const char* name;
+            task_fn_t fn;
+            uint32_t period;
+            uint32_t deadline;
+            bool inInterrupt;
+            uint64_t nextRelease;
+            uint64_t release;       // of the pending run
+            volatile bool pending;
+            TaskStats stats;
+        };
+
+        void handleAlarm();
+        void execute(Task& task, uint64_t release);
+        static void onAlarm(unsigned alarmNum);
+        static Scheduler* instances[4]; // one per hardware alarm
+
+        Task tasks[SCHEDULER_MAX_TASKS];
+        int taskCount;
+        int alarm;
+};
@@ -0,0 +1,69 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+/*
+    Lock-free queue between exactly one producer and one consumer, e.g. the two cores of the RP2040.
+    The producer only writes `head` and the consumer only writes `tail`, so no lock is needed.
+    N has to be a power of 2, one slot is always left empty
+*/
+template <typename T, uint32_t N>
+class SpscQueue {
+    static_assert((N & (N - 1)) == 0, "N has to be a power of 2");
+
+    public:
+        /*
+            @brief Adds an element, called by the producer only
+
+            @returns false if the queue is full, the element is dropped then
+        */
+        bool push(const T& value)
+        {
+            uint32_t h = head.load(std::memory_order_relaxed);
+            uint32_t next = (h + 1) & (N - 1);
+
+            if (next == tail.load(std::memory_order_acquire))
+            {
+                dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                return false;
+            }
+
+            buffer[h] = value;
+            // the element has to be written before the consumer can see the new head
+            head.store(next, std::memory_order_release);
+            return true;
+        }
+
+        /*
+            @brief Removes the oldest element, called by the consumer only
+
+            @returns false if the queue is empty
+        */
+        bool pop(T& value)
+        {
+            uint32_t t = tail.load(std::memory_order_relaxed);
+            if (t == head.load(std::memory_order_acquire)) return false;
+
+            value = buffer[t];
+            tail.store((t + 1) & (N - 1), std::memory_order_release);
+            return true;
+        }
+
+        /* @returns number of elements waiting, exact only when called by the consumer or producer */
+        uint32_t size()
+        {
+            return (head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire)) & (N - 1);
+        }
+
+        /* @returns number of elements dropped because the queue was full */
+        uint32_t getDropped()
+        {
+            return dropped.load(std::memory_order_relaxed);
+        }
+
+    private:
+        T buffer[N];
+        std::atomic<uint32_t> head{0};
+        std::atomic<uint32_t> tail{0};
+        std::atomic<uint32_t> dropped{0};
+};
@@ -0,0 +1,87 @@
+#include "trace.hpp"
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+
+#define TRACE_MASK (TRACE_BUFFER - 1)
+
+static uint8_t buffer[TRACE_BUFFER];
+static volatile uint32_t head = 0;     // bytes written, by the producers
+static volatile uint32_t tail = 0;     // bytes read, by the consumer
+static volatile uint32_t dropped = 0;
+static spin_lock_t* lock = nullptr;
+
+// copies into the ring, in at most two pieces
+static void put(uint32_t position, const uint8_t* data, int length)
+{
+    uint32_t index = position & TRACE_MASK;
+    int first = TRACE_BUFFER - index < (uint32_t) length ? TRACE_BUFFER - index : length;
+
+    std::memcpy(buffer + index, data, first);
+    if (first < length) std::memcpy(buffer, data + first, length - first);
+}
+
+static void get(uint32_t position, uint8_t* data, int length)
+{
+    uint32_t index = position & TRACE_MASK;
+    int first = TRACE_BUFFER - index < (uint32_t) length ? TRACE_BUFFER - index : length;
+
+    std::memcpy(data, buffer + index, first);
+    if (first < length) std::memcpy(data + first, buffer, length - first);
+}
+
+void trace_begin()
+{
+    lock = spin_lock_init(spin_lock_claim_unused(true));
+}
+
+void trace_write(uint8_t id, const uint8_t* args, int length)
+{
+    if (!lock || length > TRACE_MAX_ARGS) return;
+
+    uint8_t header[TRACE_HEADER] = {id, (uint8_t) length};
+    uint32_t now = timer_hw->timerawl;
+    std::memcpy(header + 2, &now, 4);
+
+    // both cores and their interrupts
+    uint32_t status = spin_lock_blocking(lock);
+
+    uint32_t position = head;
+    if (TRACE_BUFFER - (position - tail) < (uint32_t) (TRACE_HEADER + length)) dropped++;
+    else
+    {
+        put(position, header, TRACE_HEADER);
+        put(position + TRACE_HEADER, args, length);
+        head = position + TRACE_HEADER + length;
+    }
+
+    spin_unlock(lock, status);
+}
+
+int trace_read(uint8_t* out, int max)
+{
+    uint32_t position = tail;
+    uint32_t end = head;
+    int length = 0;
+
+    while (position != end)
+    {
+        uint8_t header[2];
+        get(position, header, 2);
+
+        int size = TRACE_HEADER + header[1];
+        if (length + size > max) break;
+
+        get(position, out + length, size);
+        length += size;
+        position += size;
+    }
+
+    tail = position;
+    return length;
+}
+
+uint32_t trace_dropped()
+{
+    return dropped;
+}
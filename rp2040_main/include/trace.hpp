@@ -0,0 +1,93 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include "trace_messages.hpp"
+
+#define TRACE_BUFFER 4096   // bytes, a power of two
+#define TRACE_HEADER 6      // id (1), argument bytes (1), time (us, 4, wraps after 71 minutes)
+#define TRACE_MAX_ARGS 64   // bytes of arguments
+
+enum trace_id_t {
+#define TRACE_ID(id, format) id,
+    TRACE_MESSAGES(TRACE_ID)
+#undef TRACE_ID
+    TRACE_COUNT
+};
+
+/*
+    Binary diagnostics instead of printf: a record is the id of the message, the time and the raw arguments, put into
+    a ring buffer in RAM. Nothing is formatted on the board, a host tool does that with the table in trace_messages.hpp.
+    A message costs a few dozen cycles, so it can be used from any core and from interrupts, in flight as well.
+    When the buffer is full new records are dropped and counted.
+
+    Records are taken out by `trace_read()`, firmware sends them over USB (see DUMP_TRACE in log_dump.hpp)
+*/
+
+/* @brief Claims a hardware spin lock, before the first message */
+void trace_begin();
+
+/*
+    @brief Adds a record, called by `trace()`
+
+    @param id trace_id_t
+    @param args packed arguments
+    @param length at most TRACE_MAX_ARGS
+*/
+void trace_write(uint8_t id, const uint8_t* args, int length);
+
+/*
+    @brief Takes whole records out of the buffer, one consumer only
+
+    @param out where the records are copied to
+    @param max size of `out`, at least TRACE_HEADER + TRACE_MAX_ARGS
+
+    @returns number of bytes copied
+*/
+int trace_read(uint8_t* out, int max);
+
+/* @returns number of records dropped because the buffer was full */
+uint32_t trace_dropped();
+
+// one argument: floating point as float, 64 bit integers as they are, everything else as 32 bits
+template <typename T>
+inline int trace_pack(uint8_t* out, T value)
+{
+    static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value, "only numbers can be traced");
+
+    if constexpr (std::is_floating_point<T>::value)
+    {
+        float f = value;
+        std::memcpy(out, &f, 4);
+        return 4;
+    }
+    else if constexpr (sizeof(T) == 8)
+    {
+        std::memcpy(out, &value, 8);
+        return 8;
+    }
+    else
+    {
+        uint32_t v = (uint32_t) value;
+        std::memcpy(out, &v, 4);
+        return 4;
+    }
+}
+
+/*
+    @brief Sends a message of trace_messages.hpp
+
+    @param id the message
+    @param args its arguments, they have to match the format
+*/
+template <typename... Args>
+inline void trace(trace_id_t id, Args... args)
+{
+    static_assert(8 * sizeof...(Args) <= TRACE_MAX_ARGS, "too many arguments");
+
+    uint8_t packed[8 * sizeof...(Args) + 1];
+    int length = 0;
+    ((length += trace_pack(packed + length, args)), ...);
+
+    trace_write(id, packed, length);
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+/*
+    Messages of the binary trace (trace.hpp): X(id, format). The firmware only sends the id and the raw arguments,
+    the format is applied on the host by src/ground_station/trace_view.cpp, which includes this table as well.
+    Arguments are numbers only: %d %i %u %x %X %c take 32 bits, %ll... 64 bits, %f %e %g a float.
+    A single l is ignored, on the board long has 32 bits. New messages go at the end, the ids are in the trace
+*/
+#define TRACE_MESSAGES(X) \
+    X(TRACE_LORA_SPI, "LoRa SPI at %u Hz") \
+    X(TRACE_LORA_VERSION, "LoRa version: 0x%x") \
+    X(TRACE_WARM_RESET, "warm reset, continuing in flight phase %u") \
+    X(TRACE_GPS_FALLBACK, "GPS didn't accept UBX, staying on NMEA") \
+    X(TRACE_FLIGHT_PHASE, "flight phase: %u (0 pad, 1 boost, 2 coast, 3 apogee, 4 descent, 5 landed)") \
+    X(TRACE_CALIBRATION_SAVED, "calibration saved for warm resets") \
+    X(TRACE_CORE0_STATS, "i2c errors %lu, imu overflows %lu, baro overflows %lu") \
+    X(TRACE_QUEUE_DROPS, "queue drops: imu %lu, baro %lu") \
+    X(TRACE_GPS_STATS, "gps (UBX %u): %lu messages, %lu checksum errors, %lu bytes dropped") \
+    X(TRACE_RECORDER_STATS, "recorder (session %u): %lu/%lu pages, %lu written, %lu dropped, erasing %u") \
+    X(TRACE_REPORT_STATS, "reports: %lu sent, %lu refused by the duty cycle or a busy channel, period %lu us")
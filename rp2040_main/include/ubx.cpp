@@ -0,0 +1,219 @@
+#include "ubx.hpp"
+#include <cstring>
+
+#define MS_PER_DAY 86400000
+
+// little endian fields, byte by byte since the M0+ can't load unaligned words
+static uint16_t u16(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t u32(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static int32_t i32(const uint8_t* p)
+{
+    return (int32_t) u32(p);
+}
+
+int ubx_frame(uint8_t cls, uint8_t id, const uint8_t* payload, int length, uint8_t* out)
+{
+    out[0] = UBX_SYNC1;
+    out[1] = UBX_SYNC2;
+    out[2] = cls;
+    out[3] = id;
+    out[4] = length & 0xFF;
+    out[5] = length >> 8;
+    std::memcpy(out + 6, payload, length);
+
+    // 8 bit Fletcher over class, id, length and payload
+    uint8_t a = 0, b = 0;
+    for (int i = 2; i < 6 + length; i++)
+    {
+        a += out[i];
+        b += a;
+    }
+    out[6 + length] = a;
+    out[7 + length] = b;
+
+    return length + UBX_OVERHEAD;
+}
+
+UbxParser::UbxParser()
+{
+    state = SYNC1;
+    std::memset(&fix, 0, sizeof(fix));
+    utcOffsetMs = 0;
+    utcKnown = false;
+    messages = 0;
+    errors = 0;
+    clearAck();
+}
+
+bool UbxParser::feed(uint8_t byte)
+{
+    switch (state)
+    {
+        case SYNC1:
+            if (byte == UBX_SYNC1) state = SYNC2;
+            return false;
+
+        case SYNC2:
+            state = byte == UBX_SYNC2 ? CLASS : byte == UBX_SYNC1 ? SYNC2 : SYNC1;
+            return false;
+
+        case CLASS:
+            cls = byte;
+            ckA = ckB = 0;
+            break;
+
+        case ID:
+            id = byte;
+            break;
+
+        case LENGTH1:
+            length = byte;
+            break;
+
+        case LENGTH2:
+            length |= byte << 8;
+            index = 0;
+            // a false sync would otherwise swallow the next messages as its payload
+            if (length > UBX_MAX_LENGTH)
+            {
+                state = SYNC1;
+                errors++;
+                return false;
+            }
+            break;
+
+        case PAYLOAD:
+            if (index < UBX_MAX_PAYLOAD) payload[index] = byte;
+            index++;
+            break;
+
+        case CHECKSUM_A:
+            state = byte == ckA ? CHECKSUM_B : SYNC1;
+            if (state == SYNC1) errors++;
+            return false;
+
+        case CHECKSUM_B:
+            state = SYNC1;
+            if (byte != ckB)
+            {
+                errors++;
+                return false;
+            }
+            messages++;
+            return length <= UBX_MAX_PAYLOAD && handleMessage();
+    }
+
+    // everything from the class to the end of the payload is in the checksum
+    ckA += byte;
+    ckB += ckA;
+
+    switch (state)
+    {
+        case CLASS: state = ID; break;
+        case ID: state = LENGTH1; break;
+        case LENGTH1: state = LENGTH2; break;
+        case LENGTH2: state = length ? PAYLOAD : CHECKSUM_A; break;
+        case PAYLOAD: if (index == length) state = CHECKSUM_A; break;
+        default: break;
+    }
+
+    return false;
+}
+
+bool UbxParser::handleMessage()
+{
+    if (cls == UBX_CLASS_ACK && length == 2)
+    {
+        ackClass = payload[0];
+        ackId = payload[1];
+        ack = id == UBX_ACK_ACK ? 1 : 0;
+        return false;
+    }
+
+    if (cls != UBX_CLASS_NAV) return false;
+
+    const uint8_t* p = payload;
+    uint32_t iTow = u32(p);
+
+    switch (id)
+    {
+        case UBX_NAV_POSLLH:
+            if (length < 28) return false;
+            fix.longitude = i32(p + 4);
+            fix.latitude = i32(p + 8);
+            fix.altitude = i32(p + 16) * 0.001f; // hMSL, mm
+            break;
+
+        case UBX_NAV_VELNED:
+            if (length < 36) return false;
+            fix.speed = u32(p + 20) * 0.01f;     // gSpeed, cm/s
+            fix.course = i32(p + 24) * 1e-5f;    // heading, 1e-5 degrees
+            break;
+
+        case UBX_NAV_SOL:
+        {
+            if (length < 52) return false;
+            uint8_t gpsFix = p[10];
+            bool fixOk = p[11] & 0x01;
+            fix.valid = fixOk;
+            fix.quality = fixOk && gpsFix >= 2 && gpsFix <= 4 ? 1 : 0;
+            fix.hdop = u16(p + 44) * 0.01f;      // position DOP, NAV-SOL has no horizontal one
+            fix.satellites = p[47];
+            break;
+        }
+
+        case UBX_NAV_TIMEUTC:
+        {
+            if (length < 20) return false;
+            // only once the receiver knows the leap seconds
+            if (!(p[19] & 0x04)) return false;
+
+            uint32_t ms = ((p[16] * 60 + p[17]) * 60 + p[18]) * 1000 + i32(p + 8) / 1000000;
+            utcOffsetMs = (int32_t) (ms - iTow % MS_PER_DAY);
+            utcKnown = true;
+            fix.date = p[15] * 10000 + p[14] * 100 + u16(p + 12) % 100;
+            break;
+        }
+
+        default:
+            return false;
+    }
+
+    if (utcKnown) fix.utc_ms = (uint32_t) (((int64_t) iTow % MS_PER_DAY + utcOffsetMs + MS_PER_DAY) % MS_PER_DAY);
+    return true;
+}
+
+const gps_fix& UbxParser::getFix()
+{
+    return fix;
+}
+
+int UbxParser::getAck(uint8_t cls, uint8_t id)
+{
+    return ackClass == cls && ackId == id ? ack : -1;
+}
+
+void UbxParser::clearAck()
+{
+    ackClass = 0;
+    ackId = 0;
+    ack = -1;
+}
+
+uint32_t UbxParser::getMessages()
+{
+    return messages;
+}
+
+uint32_t UbxParser::getErrors()
+{
+    return errors;
+}
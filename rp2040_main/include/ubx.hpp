@@ -0,0 +1,97 @@
+#pragma once
+#include <cstdint>
+#include "nmea.hpp"
+
+// Frame: sync (2), class, id, length (2, little endian), payload, Fletcher checksum (2)
+#define UBX_SYNC1 0xB5
+#define UBX_SYNC2 0x62
+#define UBX_OVERHEAD 8
+#define UBX_MAX_PAYLOAD 64 // longer messages are skipped
+#define UBX_MAX_LENGTH 512 // longer than any u-blox 6 message, a length field read from noise
+
+#define UBX_CLASS_NAV 0x01
+#define UBX_CLASS_ACK 0x05
+#define UBX_CLASS_CFG 0x06
+
+#define UBX_NAV_POSLLH 0x02
+#define UBX_NAV_SOL 0x06
+#define UBX_NAV_VELNED 0x12
+#define UBX_NAV_TIMEUTC 0x21
+#define UBX_ACK_NAK 0x00
+#define UBX_ACK_ACK 0x01
+#define UBX_CFG_PRT 0x00
+#define UBX_CFG_MSG 0x01
+#define UBX_CFG_RATE 0x08
+
+/*
+    @brief Builds a UBX frame
+
+    @param cls message class
+    @param id message id
+    @param payload `length` bytes
+    @param out at least `length` + UBX_OVERHEAD bytes
+
+    @returns the length of the frame
+*/
+int ubx_frame(uint8_t cls, uint8_t id, const uint8_t* payload, int length, uint8_t* out);
+
+/*
+    Incremental parser of the binary UBX protocol, fed one byte at a time.
+    The navigation messages of the u-blox 6 (NEO-6M has no NAV-PVT) are decoded into the same fix as the NMEA parser:
+    NAV-POSLLH (position), NAV-VELNED (velocity), NAV-SOL (fix type, satellites) and NAV-TIMEUTC (UTC time and date).
+    Acknowledgements of configuration messages are recorded, so the configuration can wait for them
+*/
+class UbxParser {
+    public:
+        UbxParser();
+
+        /*
+            @brief Feeds the next received byte
+
+            @returns true if a navigation message with a valid checksum updated the fix
+        */
+        bool feed(uint8_t byte);
+
+        const gps_fix& getFix();
+
+        /*
+            @brief Answer of the receiver to a configuration message
+
+            @returns 1 if it was acknowledged, 0 if it was rejected, -1 if no answer arrived (since `clearAck()`)
+        */
+        int getAck(uint8_t cls, uint8_t id);
+        void clearAck();
+
+        /* @returns number of messages with a valid checksum */
+        uint32_t getMessages();
+
+        /* @returns number of messages with a wrong checksum */
+        uint32_t getErrors();
+
+    private:
+        enum State { SYNC1, SYNC2, CLASS, ID, LENGTH1, LENGTH2, PAYLOAD, CHECKSUM_A, CHECKSUM_B };
+
+        bool handleMessage();
+
+        State state;
+        uint8_t cls;
+        uint8_t id;
+        uint16_t length;
+        uint16_t index;
+        uint8_t ckA;
+        uint8_t ckB;
+        uint8_t payload[UBX_MAX_PAYLOAD];
+
+        uint8_t ackClass;
+        uint8_t ackId;
+        int ack;
+
+        // UTC - GPS time of week, learned from NAV-TIMEUTC, so every message can be given a UTC time
+        int32_t utcOffsetMs;
+        bool utcKnown;
+
+        gps_fix fix;
+
+        uint32_t messages;
+        uint32_t errors;
+};
@@ -1,11 +1,33 @@
 #include <comm.hpp>
+#include <adr.hpp>
+#include <bmp390_i2c.hpp>
+#include <mpu6500.hpp>
+#include <i2c_queue.hpp>
+#include <scheduler.hpp>
+#include <spsc_queue.hpp>
+#include <altitude_kf.hpp>
+#include <ahrs.hpp>
+#include <decimator.hpp>
+#include <flight_phase.hpp>
+#include <gps.hpp>
+#include <pico_flash.hpp>
+#include <recorder.hpp>
+#include <log_dump.hpp>
+#include <boot_state.hpp>
+#include <profiler.hpp>
+#include <trace.hpp>
 #include <string>
 #include <stdio.h>
 #include <LoRa-RP2040.h>
 #include "pico/stdlib.h"
 #include "pico/binary_info.h"
+#include "pico/multicore.h"
+#include "pico/stdio_usb.h"
 #include "hardware/i2c.h"
+#include "hardware/structs/systick.h"
+#include "hardware/sync.h"
 #include <cmath>
+#include <cstring>
 
 #define PIN_SDA 0
 #define PIN_SCL 1
@@ -13,290 +35,1203 @@
 #define ADDR_MPU 0x69
 #define ADDR_BMP 0x76
 
-#define BMP_CMD 0x7E
-#define BMP_PWR_CTL 0x1B
+// INT pin of the MPU6500, pulses on every new sample
+#define PIN_MPU_INT 6
 
-#define BMP_RST 0xB6
-#define BMP_OSR 0x1C
-#define BMP_CONF 0x1F
-#define BMP3_REG_CALIB_DATA 0x31
-#define BMP3_REG_DATA 0x04
+// NEO-6M on UART0
+#define PIN_GPS_TX 12
+#define PIN_GPS_RX 13
 
-#define GYRO_CONFIG 0x1B
-#define ACCEL_CONFIG 0x1C
-#define GYRO_XOUT_H 0x43
-#define ACCEL_XOUT_H 0x3B
+// task periods
+#define BARO_PERIOD_US 100000 // 5 frames at 50 Hz
+#define FUSION_PERIOD_US 10000
+#define RADIO_PERIOD_US 50000
+#define PHASE_PERIOD_US 100000
+#define GPS_PERIOD_US 50000 // 192 bytes at 38400 baud
+#define RECORDER_PERIOD_US 20000 // about 1 page
+#define CONSOLE_PERIOD_US 100000
+#define PROFILE_STREAM_PERIOD_US 5000000
+#define STATS_PERIOD_US 10000000
+#define TRACE_PERIOD_US 50000
+
+// The flight recorder takes the flash after the program, about 100 s of raw samples,
+// except for the last sector, which keeps the calibration for a warm reset
+#define LOG_FLASH_OFFSET (512 * 1024)
+#define BOOT_CACHE_OFFSET (PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_BYTES)
+#define LOG_FLASH_SIZE (BOOT_CACHE_OFFSET - LOG_FLASH_OFFSET)
+
+// A cold start waits this long for a USB terminal, so the startup messages can be read. A warm reset doesn't
+#define USB_WAIT_MS 2000
+#define RADIO_RETRY_MS 100
+
+// Groups of fields in the reports, every flight phase sends its own selection
+#define REPORT_EXAMPLE (1 << 0)   // the example fields
+#define REPORT_ALTITUDE (1 << 1)  // pressure, altitude, vertical speed
+#define REPORT_MOTION (1 << 2)    // peak g and the window statistics
+#define REPORT_ATTITUDE (1 << 3)  // packed quaternion
+#define REPORT_GPS (1 << 4)       // position, GPS altitude and satellites
+#define REPORT_LINK (1 << 5)      // when the last packet was sent and received
+
+// Every report carries the time it was made, the times of what is in it are relative to that, in these units,
+// negative before it. They saturate at about -3.3 s, which means older or never
+#define REPORT_TIME_UNIT_US 100
+
+// Reports on the pad, in the descent and after the landing use at most this share of the duty cycle. The rest is
+// saved for the short phases of the flight, which spread what is left of the budget over their expected length
+#define TELEMETRY_DUTY_SHARE 0.5f
+
+// x8 pressure and x1 temperature oversampling take 19 ms, which fits into 50 Hz
+#define BARO_OSR_PRESS BMP_OSR_X8
+#define BARO_OSR_TEMP BMP_OSR_X1
+#define BARO_IIR BMP_IIR_3
+#define BARO_ODR BMP_ODR_50_HZ
 
 #define FS_SEL 1
 #define AFS_SEL 1
 
-struct calib_data {
-    double par_t1;
-    double par_t2;
-    double par_t3;
-    double par_p1;
-    double par_p2;
-    double par_p3;
-    double par_p4;
-    double par_p5;
-    double par_p6;
-    double par_p7;
-    double par_p8;
-    double par_p9;
-    double par_p10;
-    double par_p11;
-    double t_lin;
+// The satellite has to be at rest while this many IMU and barometer samples are averaged at startup
+#define IMU_CALIBRATION_SAMPLES 1000
+#define BARO_CALIBRATION_SAMPLES 25
+
+// The attitude is updated with the average of this many IMU samples (500 Hz)
+#define AHRS_DECIMATION 2
+
+// Samples on their way from core 0 to core 1. Fusion runs every 10 ms, so they only fill up if core 1 hangs
+#define IMU_QUEUE_SIZE 256
+#define BARO_QUEUE_SIZE 64
+
+// Uplink packets on their way from the radio interrupt to the radio task, the ground station sends a few per second at most
+#define UPLINK_QUEUE_SIZE 4
+
+// Listen before talk doubles its backoff window at most this many times, while the channel stays busy
+#define LBT_ATTEMPTS 5
+
+// Sections of code whose cycles are counted, printed with the "profile" console command
+enum profile_section_t {
+    PROFILE_IMU_SAMPLE,     // everything done with one IMU sample on core 1
+    PROFILE_AHRS,           // one attitude update
+    PROFILE_COMPENSATE,     // compensation of one barometer frame
+    PROFILE_SET_FIELDS,     // setting the fields of a report
+    PROFILE_REPORT,         // Comm::sendReport(), with the radio
+    PROFILE_LORA_FIFO,      // writing a packet into the FIFO of the radio
+    PROFILE_LORA_TX,        // listen before talk and the transmission
+    PROFILE_RECORDER,       // writing the queued pages of the flight log
+    PROFILE_SECTIONS
 };
 
-struct bmp3_data {
-  double temperature;
-  double pressure;
-  bool success;
+const char* const profile_names[PROFILE_SECTIONS] = {
+    "imu sample", "ahrs", "compensate", "set fields", "report", "lora fifo", "lora tx", "recorder",
 };
 
-calib_data _calib_data;
-
-void readReg(uint8_t addr, uint8_t reg, uint8_t* buff, uint8_t len)
-{
-    i2c_write_blocking(i2c0, addr, &reg, 1, true);
-    i2c_read_blocking(i2c0, addr, buff, len, false);
-}
-
-void parse_calib_data(const uint8_t* reg_data) {
-    auto u16 = [](uint8_t msb, uint8_t lsb) { return (uint16_t)(((uint16_t)msb << 8) | lsb); };
-
-    uint16_t par_t1_u = u16(reg_data[1], reg_data[0]);
-    uint16_t par_t2_u = u16(reg_data[3], reg_data[2]);
-    int8_t   par_t3_s = (int8_t)reg_data[4];
-
-    int16_t  par_p1_s = (int16_t)u16(reg_data[6], reg_data[5]);
-    int16_t  par_p2_s = (int16_t)u16(reg_data[8], reg_data[7]);
-    int8_t   par_p3_s = (int8_t)reg_data[9];
-    int8_t   par_p4_s = (int8_t)reg_data[10];
-    uint16_t par_p5_u = u16(reg_data[12], reg_data[11]);
-    uint16_t par_p6_u = u16(reg_data[14], reg_data[13]);
-    int8_t   par_p7_s = (int8_t)reg_data[15];
-    int8_t   par_p8_s = (int8_t)reg_data[16];
-    int16_t  par_p9_s = (int16_t)u16(reg_data[18], reg_data[17]);
-    int8_t   par_p10_s = (int8_t)reg_data[19];
-    int8_t   par_p11_s = (int8_t)reg_data[20];
-
-    _calib_data.par_t1 = (double)par_t1_u / 0.00390625f;
-    _calib_data.par_t2 = (double)par_t2_u / 1073741824.0f;
-    _calib_data.par_t3 = (double)par_t3_s / 281474976710656.0f;
-
-    _calib_data.par_p1 = ((double)par_p1_s - 16384.0) / 1048576.0f;
-    _calib_data.par_p2 = ((double)par_p2_s - 16384.0) / 536870912.0f;
-    _calib_data.par_p3 = (double)par_p3_s / 4294967296.0f;
-    _calib_data.par_p4 = (double)par_p4_s / 137438953472.0f;
-    _calib_data.par_p5 = (double)par_p5_u / 0.125f;
-    _calib_data.par_p6 = (double)par_p6_u / 64.0f;
-    _calib_data.par_p7 = (double)par_p7_s / 256.0f;
-    _calib_data.par_p8 = (double)par_p8_s / 32768.0f;
-    _calib_data.par_p9 = (double)par_p9_s / 281474976710656.0f;
-    _calib_data.par_p10 = (double)par_p10_s / 281474976710656.0f;
-    _calib_data.par_p11 = (double)par_p11_s / 36893488147419103232.0f;
-}
-bool get_calib_data() {
-    uint8_t calib_buffer[21];
-    readReg(ADDR_BMP, BMP3_REG_CALIB_DATA, calib_buffer, 21);
-    
-    bool all_zeros = true;
-    for (int i = 0; i < 21; ++i) {
-        if (calib_buffer[i] != 0) {
-            all_zeros = false;
-            break;
-        }
-    }
-    if (all_zeros) {
-        printf("Calib data zero.\n");
-        return false;
-    }
-    
-    parse_calib_data(calib_buffer);
-    return true;
-}
+// With "profile stream on" the statistics are sent as Comm diagnostics, as many sections per packet as fit.
+// Section: id (1), runs (4), cycles min, mean and max (4 each), little endian
+#define PROFILE_RECORD 17
+
+// Bytes of trace records per USB frame
+#define TRACE_FRAME 512
+
+Profiler profiler(profile_names, PROFILE_SECTIONS);
 
 // you should supply a function that can send a packet to the receiver
 // the max possible packet size is 255 bytes
-// the arguments should be the buffer and the size of it
+// the arguments should be the buffer and the size of it, it returns -1 if the packet wasn't sent
 int send(uint8_t* data, int size) {
-    LoRa.beginPacket();
-    LoRa.write(data, size);
-    LoRa.endPacket();
-    return 0;
+    int sent;
+    {
+        ProfileScope scope(profiler, PROFILE_LORA_FIFO);
+        LoRa.beginPacket();
+        LoRa.write(data, size);
+    }
+    {
+        ProfileScope scope(profiler, PROFILE_LORA_TX);
+        sent = LoRa.endPacket();
+    }
+
+    // listen for profile changes from the ground station between transmissions. Continuously, the ground station
+    // sends with the normal preamble, which a radio that only wakes up for a CAD now and then would mostly miss
+    LoRa.receive();
+    return sent ? 0 : -1;
+}
+
+// same as send(), but without a PHY header, used for fixed size report frames
+int send_implicit(uint8_t* data, int size) {
+    int sent;
+    {
+        ProfileScope scope(profiler, PROFILE_LORA_FIFO);
+        LoRa.beginPacket(true);
+        LoRa.write(data, size);
+    }
+    {
+        ProfileScope scope(profiler, PROFILE_LORA_TX);
+        sent = LoRa.endPacket();
+    }
+
+    LoRa.receive();
+    return sent ? 0 : -1;
 }
 
-int16_t read_i16(uint8_t reg)
+Comm comm(send);
+MPU6500 imu(i2c0, ADDR_MPU);
+BMP390 baro(i2c0, ADDR_BMP);
+I2CQueue i2c_queue(i2c0);
+DutyCycle duty_cycle;
+BufferedUart gps_uart(uart0);
+Gps gps(&gps_uart);
+PicoFlash log_flash(LOG_FLASH_OFFSET, LOG_FLASH_SIZE);
+FlightRecorder recorder(&log_flash);
+PicoFlash boot_flash(BOOT_CACHE_OFFSET, FLASH_SECTOR_BYTES);
+
+// whether the duty cycle allows all packets of a transfer right now, counted with a PHY header, which is the longer
+bool budget(const int* sizes, int count)
 {
-    uint8_t buff[2];
+    LoRaModem modem = LoRa.getModem();
+    modem.implicitHeader = false;
+
+    uint32_t airtime = 0;
+    for (int i = 0; i < count; i++) airtime += time_on_air_us(modem, sizes[i]);
+    return duty_cycle.allow(time_us_64(), airtime);
+}
+
+// Core 0 acquires the sensors, core 1 does everything else, so a transmit never delays a sample
+Scheduler acquisition;
+Scheduler processing;
+
+SpscQueue<imu_raw, IMU_QUEUE_SIZE> imu_queue;
+SpscQueue<baro_frame, BARO_QUEUE_SIZE> baro_queue;
+
+// a packet as it came out of the FIFO
+struct uplink_packet {
+    uint8_t data[MAX_PKT_LENGTH];
+    int size;
+};
+SpscQueue<uplink_packet, UPLINK_QUEUE_SIZE> uplink_queue;
+
+// written by the fusion task, reset with every report
+float max_accel_sq = 0;
+uint32_t last_pressure = 0;
+uint64_t last_pressure_us = 0;
+
+// radio events that are in the flight log already
+uint64_t logged_tx_us = 0;
+uint64_t logged_rx_us = 0;
+
+// written by the GPS task
+gps_fix last_fix = {};
+
+// accel and gyro decimated to 62.5 Hz, and summarized between reports
+CicDecimator imu_cic(6);
+FirDecimator imu_fir(6);
+WindowStats vertical_stats;   // vertical acceleration, m/s^2, gravity removed
+WindowStats rate_stats;       // rotation rate, deg/s
 
-    i2c_write_blocking(i2c0, ADDR_MPU, &reg, 1, true);
-    i2c_read_blocking(i2c0, ADDR_MPU, buff, 2, false);
-    int16_t val = (buff[1] << 8 )| buff[0];
+// attitude and vertical motion, from the barometer and the IMU
+Mahony ahrs;
+AltitudeFilter altitude_filter;
+float gyro_bias[3];       // dps, measured at rest
+float pad_accel[3];       // g, measured at rest
+float gravity = 0;        // length of the gravity vector, in g, absorbs the scale error of the accelerometer
+float ahrs_gyro[3];       // sums of the samples since the last attitude update
+float ahrs_accel[3];
+int ahrs_pending = 0;
+uint64_t last_ahrs_us = 0;
+float reference_pressure = 0;
+int imu_calibration = 0;
+int baro_calibration = 0;
+uint64_t last_imu_us = 0;
 
-    if (val & 0x8000) val -= 0x10000;
+// raw IMU samples on their way into the flight recorder, see LOG_IMU
+uint8_t log_imu_batch[10 + LOG_IMU_SAMPLES * 12];
+int log_imu_pending = 0;
+bool recorder_ready = false;
 
-    return val;
+// After a reset in flight the state from before it is taken over, with the calibration from the pad
+bool warm_boot = false;
+warm_state warm = {};
+boot_cache cache = {};
+bool cache_saved = false;
+
+// set by core 0 once the sensors are read, or it gave up on them, core 1 waits for it before it starts its tasks
+volatile bool sensors_ready = false;
+volatile bool sensors_failed = false;
+char console_line[32];
+int console_length = 0;
+bool profile_stream = false;
+int profile_next = 0;
+
+// What each flight phase sends, and how often
+struct PhaseConfig {
+    uint32_t telemetryPeriodUs; // shortest, the duty cycle usually allows less, see telemetry_period_us()
+    uint32_t report;    // REPORT_* groups
+    int profile;        // radio profile on entering the phase, kept when the keep-alives stop, -1 leaves it to the ground station
+    uint32_t expectedMs; // expected length of a phase that ends on its own, 0 for the others
+};
+
+const PhaseConfig phase_configs[PHASE_COUNT] = {
+    /* pad */     {2000000, REPORT_EXAMPLE | REPORT_ALTITUDE | REPORT_ATTITUDE | REPORT_GPS | REPORT_LINK, -1, 0},
+    /* boost */   {200000, REPORT_ALTITUDE | REPORT_MOTION | REPORT_ATTITUDE | REPORT_LINK, ADR_FLIGHT_PROFILE, 3000},
+    /* coast */   {200000, REPORT_ALTITUDE | REPORT_MOTION | REPORT_ATTITUDE | REPORT_LINK, ADR_FLIGHT_PROFILE, 12000},
+    /* apogee */  {100000, REPORT_ALTITUDE | REPORT_ATTITUDE | REPORT_LINK, ADR_FLIGHT_PROFILE, PHASE_APOGEE_US / 1000},
+    /* descent */ {250000, REPORT_ALTITUDE | REPORT_MOTION | REPORT_ATTITUDE | REPORT_GPS | REPORT_LINK, -1, 0},
+    /* landed */  {30000000, REPORT_ALTITUDE | REPORT_GPS | REPORT_LINK, ADR_DEFAULT_PROFILE, 0},
+};
+
+// detected by the fusion task, applied by the phase task
+FlightPhase flight_phase;
+int applied_phase = -1;
+uint32_t flight_start_ms = 0; // first phase that keeps ADR_FLIGHT_PROFILE, see adr_pinned()
+uint32_t report_groups = 0;
+int telemetry_task_id = -1;
+uint32_t telemetry_period = 0;
+uint32_t reports_sent = 0;
+uint32_t reports_refused = 0;   // by the duty cycle or a busy channel
+
+int current_profile = ADR_DEFAULT_PROFILE;
+
+// announcements the duty cycle or a busy channel refused, they are sent again until they are out
+bool structure_pending = false;
+int announce_profile = -1;
+uint32_t last_uplink_ms = 0;
+
+void apply_profile(int profile);
+
+// called by Comm from the radio task
+void on_profile_change(uint8_t profile)
+{
+    apply_profile(profile);
 }
 
-uint8_t readByte(uint8_t addr, uint8_t reg)
+// the radio interrupt only empties the FIFO, Comm handles the packet in the radio task
+void on_receive(int size)
 {
-    uint8_t ret;
-    i2c_write_blocking(i2c0, addr, &reg, 1, true);
-    i2c_read_blocking(i2c0, addr, &ret, 1, false);
+    uplink_packet packet;
+    packet.size = size;
+    for (int i = 0; i < size; i++) packet.data[i] = LoRa.read();
 
-    return ret;
+    uplink_queue.push(packet);
 }
 
+// both called from the I2C interrupt on core 0, they only hand the raw samples over to core 1
+void on_imu_samples(const imu_raw* samples, int n)
+{
+    for (int i = 0; i < n; i++) imu_queue.push(samples[i]);
+}
+
+void on_baro_frames(const baro_frame* frames, int n)
+{
+    for (int i = 0; i < n; i++) baro_queue.push(frames[i]);
+}
 
-int read_accel(float *x, float *y, float *z)
+void apply_profile(int profile)
 {
-    *x = (float) read_i16(ACCEL_XOUT_H) / (16384.0 / pow(2, AFS_SEL));
-    *y = (float) read_i16(ACCEL_XOUT_H + 2) / (16384.0 / pow(2, AFS_SEL));
-    *z = (float) read_i16(ACCEL_XOUT_H + 4) / (16384.0 / pow(2, AFS_SEL));
+    const RadioProfile& p = adrProfiles[profile];
+
+    // the modem is configured in standby
+    LoRa.idle();
 
-    return 0;
+    LoRa.setSpreadingFactor(p.sf);
+    LoRa.setSignalBandwidth(p.bw);
+    LoRa.setCodingRate4(p.cr);
+    LoRa.receive();
+    current_profile = profile;
+}
+
+// core 0: the barometer only needs its FIFO read, which is queued from the alarm interrupt
+void baro_task()
+{
+    baro.startDrain();
 }
 
-void writeReg(uint8_t addr, uint8_t reg, uint8_t val)
+void acquisition_stats_task()
 {
-    uint8_t buff[] = {reg, val};
-    i2c_write_blocking(i2c0, addr, buff, 1, false);
+    printf("core 0:\n");
+    acquisition.printStats();
+    trace(TRACE_CORE0_STATS, i2c_queue.getErrors(), imu.getOverflows(), baro.getOverflows());
 }
 
-double compensate_temperature(uint32_t uncomp_temp) {
-    double partial_data1 = (double)(uncomp_temp - _calib_data.par_t1);
-    double partial_data2 = (double)(partial_data1 * _calib_data.par_t2);
-    _calib_data.t_lin = partial_data2 + (partial_data1 * partial_data1) * _calib_data.par_t3;
-    return _calib_data.t_lin;
+bool calibrated()
+{
+    return imu_calibration == IMU_CALIBRATION_SAMPLES && baro_calibration == BARO_CALIBRATION_SAMPLES;
 }
 
-double compensate_pressure(uint32_t uncomp_press) {
-    double partial_data1 = _calib_data.par_p6 * _calib_data.t_lin;
-    double partial_data2 = _calib_data.par_p7 * (_calib_data.t_lin * _calib_data.t_lin);
-    double partial_data3 = _calib_data.par_p8 * (_calib_data.t_lin * _calib_data.t_lin * _calib_data.t_lin);
-    double partial_out1 = _calib_data.par_p5 + partial_data1 + partial_data2 + partial_data3;
+// core 1: the IMU and the barometer are averaged while at rest, then they feed the attitude and altitude filters
+void process_imu(const imu_sample& sample)
+{
+    const float* a = sample.accel;
+    const float* g = sample.gyro;
+
+    if (imu_calibration < IMU_CALIBRATION_SAMPLES)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            gyro_bias[i] += g[i] / IMU_CALIBRATION_SAMPLES;
+            pad_accel[i] += a[i] / IMU_CALIBRATION_SAMPLES;
+        }
+
+        if (++imu_calibration == IMU_CALIBRATION_SAMPLES)
+        {
+            gravity = sqrtf(pad_accel[0] * pad_accel[0] + pad_accel[1] * pad_accel[1] + pad_accel[2] * pad_accel[2]);
+            ahrs.reset(pad_accel);
+            last_imu_us = last_ahrs_us = sample.time_us;
+        }
+        return;
+    }
+
+    // the first sample after a warm reset, the filters continue from here
+    if (last_imu_us == 0)
+    {
+        last_imu_us = last_ahrs_us = sample.time_us;
+        return;
+    }
+
+    // the attitude at a lower rate, from the average rate and acceleration in between
+    for (int i = 0; i < 3; i++)
+    {
+        ahrs_gyro[i] += (g[i] - gyro_bias[i]) * DEG_TO_RAD;
+        ahrs_accel[i] += a[i];
+    }
+    if (++ahrs_pending == AHRS_DECIMATION)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            ahrs_gyro[i] /= AHRS_DECIMATION;
+            ahrs_accel[i] /= AHRS_DECIMATION * gravity;
+        }
+        {
+            ProfileScope scope(profiler, PROFILE_AHRS);
+            ahrs.update(ahrs_gyro, ahrs_accel, (sample.time_us - last_ahrs_us) * 1e-6f);
+        }
+
+        for (int i = 0; i < 3; i++) ahrs_gyro[i] = ahrs_accel[i] = 0;
+        ahrs_pending = 0;
+        last_ahrs_us = sample.time_us;
+    }
+
+    if (baro_calibration < BARO_CALIBRATION_SAMPLES) return;
 
-    partial_data1 = _calib_data.par_p2 * _calib_data.t_lin;
-    partial_data2 = _calib_data.par_p3 * (_calib_data.t_lin * _calib_data.t_lin);
-    partial_data3 = _calib_data.par_p4 * (_calib_data.t_lin * _calib_data.t_lin * _calib_data.t_lin);
-    double partial_out2 = (double)uncomp_press * (_calib_data.par_p1 + partial_data1 + partial_data2 + partial_data3);
-    
-    partial_data1 = (double)uncomp_press * (double)uncomp_press;
-    double partial_data_p9_p10 = _calib_data.par_p9 + _calib_data.par_p10 * _calib_data.t_lin;
-    double partial_data3_calc = partial_data1 * partial_data_p9_p10;
-    double partial_data4 = partial_data3_calc + ((double)uncomp_press * (double)uncomp_press * (double)uncomp_press) * _calib_data.par_p11;
+    float vertical = ahrs.vertical(a) - gravity;
 
-    return partial_out1 + partial_out2 + partial_data4;
+    altitude_filter.predict((sample.time_us - last_imu_us) * 1e-6f);
+    altitude_filter.updateAccel(vertical * STANDARD_GRAVITY);
+    last_imu_us = sample.time_us;
 }
 
-bmp3_data get_bmp_values() {
-    bmp3_data sensor_data;
-    sensor_data.success = false;
+void process_baro(const baro_sample& sample)
+{
+    float pressure = sample.pressure * 0.01f;
+
+    if (baro_calibration < BARO_CALIBRATION_SAMPLES)
+    {
+        reference_pressure += pressure / BARO_CALIBRATION_SAMPLES;
+        if (++baro_calibration == BARO_CALIBRATION_SAMPLES) altitude_filter.reset(0);
+        return;
+    }
+
+    if (imu_calibration < IMU_CALIBRATION_SAMPLES) return;
+
+    // frames arrive in batches, up to a few hundred ms after they were measured
+    float age = (int64_t) (last_imu_us - sample.time_us) * 1e-6f;
+    altitude_filter.updateBaro(pressure_altitude(pressure, reference_pressure), age > 0 ? age : 0);
+}
+
+// core 1: anti-aliased IMU samples at the decimated rate, for the statistics of the report
+void decimate_imu(const imu_raw& raw)
+{
+    int16_t in[6], mid[6], out[6];
+    for (int i = 0; i < 3; i++)
+    {
+        in[i] = raw.accel[i];
+        in[i + 3] = raw.gyro[i];
+    }
+
+    if (!imu_cic.push(in, mid) || !imu_fir.push(mid, out)) return;
+    if (imu_calibration < IMU_CALIBRATION_SAMPLES) return;
 
-    uint8_t reg_data[6];
-    readReg(ADDR_BMP, BMP3_REG_DATA, reg_data, 6);
+    imu_raw decimated = {raw.time_us, {out[0], out[1], out[2]}, {out[3], out[4], out[5]}};
+    imu_sample sample;
+    imu.toSample(decimated, sample);
 
-    uint32_t uncomp_press = (uint32_t)((reg_data[2] << 16) | (reg_data[1] << 8) | reg_data[0]);
-    uint32_t uncomp_temp = (uint32_t)((reg_data[5] << 16) | (reg_data[4] << 8) | reg_data[3]);
-    
-    if (uncomp_press == 0 && uncomp_temp == 0) {
-        printf("Raw data zero.\n");
-        return sensor_data;
+    float rate = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        float g = sample.gyro[i] - gyro_bias[i];
+        rate += g * g;
     }
-    
-    sensor_data.temperature = compensate_temperature(uncomp_temp);
-    sensor_data.pressure = compensate_pressure(uncomp_press);
-    
-    sensor_data.success = true;
-    return sensor_data;
+
+    vertical_stats.add((ahrs.vertical(sample.accel) - gravity) * STANDARD_GRAVITY);
+    rate_stats.add(sqrtf(rate));
 }
 
+// core 1: raw samples into the flight recorder, in batches that fill up its pages
+void log_imu(const imu_raw& raw)
+{
+    if (log_imu_pending == 0) std::memcpy(log_imu_batch, &raw.time_us, 8);
 
-int main() {
-    stdio_init_all();
+    uint8_t* s = log_imu_batch + 10 + log_imu_pending * 12;
+    std::memcpy(s, raw.accel, 6);
+    std::memcpy(s + 6, raw.gyro, 6);
+    log_imu_pending++;
 
-    sleep_ms(2000);
-    printf("start pls...");
+    int room = (recorder.getRoom() - 10) / 12;
+    if (log_imu_pending < std::min(room > 0 ? room : LOG_IMU_SAMPLES, LOG_IMU_SAMPLES)) return;
 
-    i2c_init(i2c0, 400000);
+    uint64_t first;
+    std::memcpy(&first, log_imu_batch, 8);
+    uint16_t interval = log_imu_pending > 1 ? (raw.time_us - first) / (log_imu_pending - 1) : 0;
+    std::memcpy(log_imu_batch + 8, &interval, 2);
 
-    gpio_set_function(PIN_SDA, GPIO_FUNC_I2C);
-    gpio_set_function(PIN_SCL, GPIO_FUNC_I2C);
+    recorder.append(LOG_IMU, log_imu_batch, 10 + log_imu_pending * 12);
+    log_imu_pending = 0;
+}
 
-    // Make the I2C pins available to picotool
-    bi_decl(bi_2pins_with_func(PIN_SDA, PIN_SCL, GPIO_FUNC_I2C));
+void log_baro(const baro_frame* frames, int n)
+{
+    uint8_t payload[LOG_BARO_FRAMES * 16];
+    for (int i = 0; i < n; i++)
+    {
+        std::memcpy(payload + i * 16, &frames[i].time_us, 8);
+        std::memcpy(payload + i * 16 + 8, &frames[i].uncomp_temp, 4);
+        std::memcpy(payload + i * 16 + 12, &frames[i].uncomp_press, 4);
+    }
+    recorder.append(LOG_BARO, payload, n * 16);
+}
+
+void log_gps(const gps_fix& fix)
+{
+    uint8_t payload[34];
+    std::memcpy(payload, &fix.time_us, 8);
+    std::memcpy(payload + 8, &fix.latitude, 4);
+    std::memcpy(payload + 12, &fix.longitude, 4);
+    std::memcpy(payload + 16, &fix.altitude, 4);
+    std::memcpy(payload + 20, &fix.speed, 4);
+    std::memcpy(payload + 24, &fix.course, 4);
+    std::memcpy(payload + 28, &fix.utc_ms, 4);
+    payload[32] = fix.satellites;
+    payload[33] = fix.quality;
+    recorder.append(LOG_GPS, payload, sizeof(payload));
+}
 
-    printf("read id: %u\n", readByte(ADDR_BMP, 0x00));
+// the newest packet sent and received since the last call, stamped by the radio interrupt
+void log_radio()
+{
+    uint64_t times[2] = {LoRa.txDoneTime(), LoRa.packetTime()};
+    uint64_t* logged[2] = {&logged_tx_us, &logged_rx_us};
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (times[i] == *logged[i]) continue;
 
-    printf("soft resetting BMP390...\n");
-    writeReg(ADDR_BMP, BMP_CMD, BMP_RST);
+        uint8_t payload[9];
+        std::memcpy(payload, &times[i], 8);
+        payload[8] = i == 0 ? LOG_RADIO_TX : LOG_RADIO_RX;
+        recorder.append(LOG_RADIO, payload, sizeof(payload));
+        *logged[i] = times[i];
+    }
+}
 
-    if (!get_calib_data())
+// core 1: converts and compensates the samples of core 0. Runs in the alarm interrupt, so a transmit doesn't hold it up
+void fusion_task()
+{
+    imu_raw raw;
+    while (imu_queue.pop(raw))
     {
-        printf("failed to get calibration data\n");
-        return 1;
-    } 
+        ProfileScope scope(profiler, PROFILE_IMU_SAMPLE);
+        imu_sample sample;
+        imu.toSample(raw, sample);
 
-    printf("enabling readings...\n");
-    writeReg(ADDR_BMP, BMP_CMD, 0b001 << 4 | 0b11);
+        const float* a = sample.accel;
+        max_accel_sq = std::max(max_accel_sq, a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+
+        process_imu(sample);
+        decimate_imu(raw);
+        log_imu(raw);
+    }
+
+    // in small batches, core 1 only has a 4 kB stack
+    baro_frame frames[8];
+    int n;
+    do
+    {
+        n = 0;
+        while (n < 8 && baro_queue.pop(frames[n])) n++;
+        if (n == 0) break;
+
+        baro_sample samples[8];
+        log_baro(frames, n);
+
+        profile_mark start = Profiler::now();
+        compensate_batch(frames, samples, n);
+        profiler.record(PROFILE_COMPENSATE, Profiler::cyclesSince(start) / n);
+        for (int i = 0; i < n; i++) process_baro(samples[i]);
+        last_pressure = samples[n - 1].pressure;
+        last_pressure_us = samples[n - 1].time_us;
+    } while (n == 8);
+
+    log_radio();
+
+    if (calibrated())
+    {
+        if (flight_phase.update(last_imu_us, altitude_filter.getAltitude(), altitude_filter.getVelocity(),
+            altitude_filter.getAcceleration()))
+        {
+            uint8_t payload[9];
+            std::memcpy(payload, &last_imu_us, 8);
+            payload[8] = flight_phase.getPhase();
+            recorder.append(LOG_PHASE, payload, sizeof(payload));
+        }
+    }
+}
+
+// handles what the ground station sent, profile changes are applied through on_profile_change()
+void radio_task()
+{
+    uint32_t now = to_ms_since_boot(get_absolute_time());
+
+    // in the fast part of the flight the ground station keeps the profile as well, from the phase in the reports
+    bool pinned = applied_phase >= 0 && adr_pinned(applied_phase, now - flight_start_ms);
+    comm.lockProfile(pinned);
+
+    uplink_packet packet;
+    while (uplink_queue.pop(packet))
+    {
+        last_uplink_ms = now;
+        comm.receiverCallback(packet.data, packet.size);
+    }
+
+    if (announce_profile >= 0 && comm.sendProfile(announce_profile) == 0) announce_profile = -1;
+
+    // the ground station's keep-alives stopped, it falls back to the default profile after the same time
+    if (!pinned && now - last_uplink_ms > adr_link_timeout_ms(current_profile))
+    {
+        comm.setProfile(ADR_DEFAULT_PROFILE);
+        last_uplink_ms = now;
+    }
+}
+
+// core 1: parses what the GPS sent since the last run, the UART interrupt has buffered it
+void gps_task()
+{
+    if (!gps.update()) return;
+
+    last_fix = gps.getFix();
+    log_gps(last_fix);
+}
+
+// core 1: writes the recorded pages. An erase stops the sensors for longer than their FIFOs last, so only on the pad
+void recorder_task()
+{
+    bool onPad = flight_phase.getPhase() == PHASE_PAD;
+    if (recorder_ready)
+    {
+        ProfileScope scope(profiler, PROFILE_RECORDER);
+        recorder.service(onPad);
+    }
+
+    // the calibration for the next warm reset, written once it is done, and only if it changed
+    if (!cache_saved && onPad && calibrated() && boot_flash.isFree())
+    {
+        cache = {};
+        std::memcpy(cache.gyroBias, gyro_bias, sizeof(gyro_bias));
+        std::memcpy(cache.padAccel, pad_accel, sizeof(pad_accel));
+        cache.gravity = gravity;
+        cache.referencePressure = reference_pressure;
+        cache.afsSel = AFS_SEL;
+        cache.fsSel = FS_SEL;
+        std::memcpy(cache.bmpCalib, baro.getCalibration(), BMP_CALIB_SIZE);
+
+        if (boot_cache_save(&boot_flash, cache)) trace(TRACE_CALIBRATION_SAVED);
+        cache_saved = true;
+    }
+}
+
+// core 1: sends pages of the flight log as binary frames. They go straight to the USB driver, as stdio would turn
+// every \n into \r\n, and each one in a single call, so the text printed by the other core can only come in between
+void dump_log(uint32_t first, uint32_t count)
+{
+    static uint8_t frame[DUMP_MAX_FRAME];
+
+    uint32_t used = recorder.getUsed();
+    uint32_t end = first < used ? first + std::min(count, used - first) : first;
+    for (uint32_t page = first; page < end; page += DUMP_CHUNK_PAGES)
+    {
+        int pages = std::min(end - page, (uint32_t) DUMP_CHUNK_PAGES);
+        // the pages of the log are one block of memory mapped flash
+        int size = dump_frame(DUMP_PAGES, page, recorder.getPage(page), pages * FLASH_PAGE_BYTES, frame);
+        stdio_usb.out_chars((const char*) frame, size);
+    }
 
-    writeReg(ADDR_BMP, BMP_OSR, 0x0A);
-    writeReg(ADDR_BMP, BMP_CONF, 0x03);
+    int size = dump_frame(DUMP_END, end, nullptr, 0, frame);
+    stdio_usb.out_chars((const char*) frame, size);
+}
+
+void send_log_info()
+{
+    uint8_t info[12], frame[DUMP_HEADER + sizeof(info) + DUMP_TRAILER];
+    uint32_t used = recorder.getUsed(), capacity = recorder.getCapacity();
+    uint16_t session = recorder.getSession(), pageSize = FLASH_PAGE_BYTES;
+    std::memcpy(info, &used, 4);
+    std::memcpy(info + 4, &capacity, 4);
+    std::memcpy(info + 8, &session, 2);
+    std::memcpy(info + 10, &pageSize, 2);
+
+    int size = dump_frame(DUMP_INFO, 0, info, sizeof(info), frame);
+    stdio_usb.out_chars((const char*) frame, size);
+}
 
+// core 1: sends the binary trace to src/ground_station/trace_view.cpp, as frames like the log dump.
+// Without a USB terminal the trace stays in RAM until the buffer is full
+void trace_task()
+{
+    static uint8_t records[TRACE_FRAME], frame[DUMP_HEADER + TRACE_FRAME + DUMP_TRAILER];
+    if (!stdio_usb_connected()) return;
+
+    int length;
+    while ((length = trace_read(records, sizeof(records))) > 0)
+    {
+        int size = dump_frame(DUMP_TRACE, trace_dropped(), records, length, frame);
+        stdio_usb.out_chars((const char*) frame, size);
+    }
+}
 
-    for (;;)
+// core 1: commands typed over USB, or sent by src/ground_station/log_dump.cpp
+void console_task()
+{
+    int c;
+    while ((c = getchar_timeout_us(0)) >= 0)
     {
-        bmp3_data data = get_bmp_values();
+        if (c != '\n' && c != '\r')
+        {
+            if (console_length < (int) sizeof(console_line) - 1) console_line[console_length++] = c;
+            continue;
+        }
+
+        console_line[console_length] = 0;
+        console_length = 0;
 
-        if (data.success) printf("P: %d T: %d\n", data.pressure, data.temperature);
-        sleep_ms(500);
+        // the log can only be read while nothing is written to it, and the dump holds up the other tasks
+        int phase = flight_phase.getPhase();
+        bool grounded = phase == PHASE_PAD || phase == PHASE_LANDED;
+        unsigned long first, count;
+
+        if (strcmp(console_line, "info") == 0) send_log_info();
+        else if (sscanf(console_line, "dump %lu %lu", &first, &count) == 2)
+        {
+            if (!grounded || recorder.isClearing()) printf("the log can't be dumped right now\n");
+            else dump_log(first, count);
+        }
+        else if (strcmp(console_line, "erase") == 0)
+        {
+            if (phase != PHASE_PAD) printf("the log is only erased on the pad\n");
+            else
+            {
+                recorder.clear();
+                printf("erasing the log, %lu pages\n", recorder.getUsed());
+            }
+        }
+        else if (strcmp(console_line, "profile") == 0)
+        {
+            profiler.print();
+            processing.printStats();
+        }
+        else if (strcmp(console_line, "profile reset") == 0)
+        {
+            profiler.reset();
+            processing.resetStats();
+        }
+        else if (strcmp(console_line, "profile stream on") == 0) profile_stream = true;
+        else if (strcmp(console_line, "profile stream off") == 0) profile_stream = false;
+        else if (console_line[0]) printf("unknown command: %s\n", console_line);
     }
+}
 
-    uint8_t buff[] = {ACCEL_CONFIG, (AFS_SEL << 3)};
-    i2c_write_blocking(i2c0, ADDR_MPU, buff, 2, false);
+// core 1: the fields of the report, they are only announced again when the groups change.
+// After a warm reset the ground station still knows them, so they aren't announced
+void build_report(uint32_t groups, bool announce = true)
+{
+    comm.clearFields();
+    comm.addField<uint8_t>("phase"); // flight_phase_t
+    comm.addField<uint32_t>("time"); // when the report was made, us since the start, wraps after 71 minutes
 
-    for(;;)
+    if (groups & REPORT_EXAMPLE)
     {
-        float x, y, z;
+        comm.addField<int>("example_int");
+        comm.addField<unsigned long long>("example_ull"); // Any primitive can be used basically
+        comm.addField<std::string>("string_example", 8); // Please use std::string for string types. It is also necessary to set a maximum length
+    }
+    if (groups & REPORT_ALTITUDE)
+    {
+        comm.addField<uint32_t>("pressure"); // 0.01 Pa
+        comm.addField<float>("altitude"); // m above the launch site, from the altitude filter
+        comm.addField<float>("vspeed"); // vertical velocity, m/s
+        comm.addField<int16_t>("t_baro"); // when the pressure was measured, see REPORT_TIME_UNIT_US
+    }
+    if (groups & (REPORT_ALTITUDE | REPORT_ATTITUDE))
+    {
+        comm.addField<int16_t>("t_state"); // time of the IMU sample the altitude, vspeed and attitude are updated to
+    }
+    if (groups & REPORT_MOTION)
+    {
+        comm.addField<float>("max_accel"); // largest acceleration since the last report, in g
+        // vertical acceleration (m/s^2, gravity removed) and rotation rate (deg/s) since the last report, from the 62.5 Hz IMU data
+        comm.addField<float>("vacc_min");
+        comm.addField<float>("vacc_max");
+        comm.addField<float>("vacc_mean");
+        comm.addField<float>("vacc_std");
+        comm.addField<float>("rate_max");
+    }
+    if (groups & REPORT_ATTITUDE)
+    {
+        comm.addField<uint32_t>("attitude"); // quaternion from the sensor to the earth frame, see pack_quaternion()
+    }
+    if (groups & REPORT_GPS)
+    {
+        comm.addField<int32_t>("latitude"); // 1e-7 degrees
+        comm.addField<int32_t>("longitude"); // 1e-7 degrees
+        comm.addField<float>("gps_alt"); // m above sea level
+        comm.addField<uint8_t>("sats"); // satellites in the fix, 0 without a fix
+        comm.addField<int16_t>("t_gps"); // when the fix arrived from the GPS
+    }
+    if (groups & REPORT_LINK)
+    {
+        // the ground station compares these with its own receive times for the latency and jitter of the link
+        comm.addField<int16_t>("t_tx"); // end of the last packet sent, usually the previous report
+        comm.addField<int16_t>("t_rx"); // end of the last packet received from the ground station
+    }
+
+    // Sends packet metadata to the receiver
+    if (announce) structure_pending = comm.sendStructure() < 0;
+
+    // Set field values
+    comm.setField("example_int", 16);
+    comm.setField("example_ull", (unsigned long long)42069); // Always make sure that it is specifically the type that has been set as the field type
+
+    report_groups = groups;
+}
+
+// The period of the phase, or longer if the reports wouldn't fit into the duty cycle
+uint32_t telemetry_period_us(int phase)
+{
+    const PhaseConfig& config = phase_configs[phase];
+
+    LoRaModem modem = LoRa.getModem();
+    modem.implicitHeader = false;
+    int size = comm.getReportFrameSize();
+    uint64_t airtime = time_on_air_us(modem, size > 0 ? size : MAX_PKT_LENGTH);
+
+    // what is left of this phase and the ones after it that end on their own
+    uint64_t elapsed_ms = (time_us_64() - flight_phase.getPhaseStart()) / 1000;
+    uint64_t remaining_ms = config.expectedMs > elapsed_ms ? config.expectedMs - elapsed_ms : 0;
+    for (int p = phase + 1; p < PHASE_COUNT && phase_configs[p].expectedMs; p++) remaining_ms += phase_configs[p].expectedMs;
+
+    uint32_t available = duty_cycle.available(time_us_64());
+    uint64_t period = config.expectedMs && remaining_ms && available ? airtime * remaining_ms * 1000 / available
+        : airtime / (TELEMETRY_DUTY_SHARE * DUTY_CYCLE_RATIO);
+
+    // a report is sent before the next one is made
+    if (period < airtime) period = airtime;
+    if (period < config.telemetryPeriodUs) return config.telemetryPeriodUs;
+    return period < UINT32_MAX ? period : UINT32_MAX;
+}
+
+// core 1: switches the report rate, contents and radio profile when the fusion task detected a new flight phase
+void apply_phase(int phase)
+{
+    const PhaseConfig& config = phase_configs[phase];
+    trace(TRACE_FLIGHT_PHASE, phase);
+
+    if (adr_pinned(phase, 0) && !adr_pinned(applied_phase, 0)) flight_start_ms = to_ms_since_boot(get_absolute_time());
+    if (config.report != report_groups) build_report(config.report);
+    announce_profile = config.profile >= 0 && comm.sendProfile(config.profile) < 0 ? config.profile : -1;
+
+    // the link timeout starts over, so leaving a phase with a fixed profile doesn't fall back right away
+    last_uplink_ms = to_ms_since_boot(get_absolute_time());
+
+    // right away, the period of the last phase can be minutes
+    telemetry_period = telemetry_period_us(phase);
+    processing.setPeriod(telemetry_task_id, telemetry_period);
+
+    // from the launch to the landing, with the last second on the pad that is still in RAM
+    recorder.setRecording(phase != PHASE_PAD && phase != PHASE_LANDED);
+
+    applied_phase = phase;
+}
+
+// core 1: what a warm reset needs to continue the flight, kept in RAM
+void save_warm_state()
+{
+    warm_state state = {};
+    state.profile = current_profile;
+    state.frameSize = comm.getAnnouncedFrameSize();
+    state.gpsBinary = gps.isBinary();
+    state.reportGroups = report_groups;
+
+    // the fusion task runs in an interrupt on this core
+    uint32_t status = save_and_disable_interrupts();
+    state.phase = flight_phase.getPhase();
+    state.phaseAgeUs = time_us_64() - flight_phase.getPhaseStart();
+    state.altitude = altitude_filter.getAltitude();
+    state.velocity = altitude_filter.getVelocity();
+    ahrs.getQuaternion(state.attitude);
+    warm_state_save(state);
+    restore_interrupts(status);
+}
+
+void phase_task()
+{
+    int phase = flight_phase.getPhase();
+    if (phase != applied_phase) apply_phase(phase);
+
+    if (calibrated()) save_warm_state();
+}
+
+// core 1: continues the flight from before a warm reset. The radio is on the profile from before already, and the
+// ground station still decodes reports with the structure and frame size from before, so nothing is announced
+void resume_flight()
+{
+    std::memcpy(gyro_bias, cache.gyroBias, sizeof(gyro_bias));
+    std::memcpy(pad_accel, cache.padAccel, sizeof(pad_accel));
+    gravity = cache.gravity;
+    reference_pressure = cache.referencePressure;
+    imu_calibration = IMU_CALIBRATION_SAMPLES;
+    baro_calibration = BARO_CALIBRATION_SAMPLES;
+
+    ahrs.setQuaternion(warm.attitude);
+    altitude_filter.reset(warm.altitude, warm.velocity);
+    flight_phase.resume((flight_phase_t) warm.phase, time_us_64() - warm.phaseAgeUs);
+
+    build_report(warm.reportGroups, false);
+    comm.resumeFrameSize(warm.frameSize);
+    recorder.setRecording(true);
+    applied_phase = warm.phase;
+    flight_start_ms = to_ms_since_boot(get_absolute_time()) - warm.phaseAgeUs / 1000; // the start of this phase, not of the flight
+
+    uint8_t payload[9];
+    uint64_t now = time_us_64();
+    std::memcpy(payload, &now, 8);
+    payload[8] = warm.phase;
+    recorder.append(LOG_PHASE, payload, sizeof(payload));
+}
+
+// a time relative to the one of the report, see REPORT_TIME_UNIT_US
+int16_t report_time(uint64_t timeUs, uint64_t reportUs)
+{
+    int64_t offset = ((int64_t) timeUs - (int64_t) reportUs) / REPORT_TIME_UNIT_US;
+    if (timeUs == 0 || offset < INT16_MIN) return INT16_MIN;
+    return offset > INT16_MAX ? INT16_MAX : offset;
+}
+
+// The report size only changes with the flight phase, so reports can be sent without a PHY header. That only makes
+// them shorter if the 20 bits of the header take the payload across a symbol group, for this size and profile
+bool implicit_saves_airtime()
+{
+    int size = comm.getReportFrameSize();
+    if (size < 0) return false;
+
+    LoRaModem modem = LoRa.getModem();
+    modem.implicitHeader = false;
+    uint32_t explicit_us = time_on_air_us(modem, size);
+    modem.implicitHeader = true;
+
+    return time_on_air_us(modem, size) < explicit_us;
+}
+
+void telemetry_task()
+{
+    // the ground station can't decode reports of a structure it hasn't received
+    if (structure_pending) structure_pending = comm.sendStructure() < 0;
+    if (structure_pending) return;
 
-        read_accel(&x, &y, &z);
+    // the fusion task runs in an interrupt on this core
+    uint32_t status = save_and_disable_interrupts();
+    uint64_t now = time_us_64();
+    uint64_t state_us = last_imu_us;
+    uint64_t pressure_us = last_pressure_us;
+    uint64_t tx_us = LoRa.txDoneTime();
+    uint64_t rx_us = LoRa.packetTime();
+    float max_accel = sqrtf(max_accel_sq);
+    max_accel_sq = 0;
+    uint32_t pressure = last_pressure;
+    float altitude = altitude_filter.getAltitude();
+    float vspeed = altitude_filter.getVelocity();
+    float attitude[4];
+    ahrs.getQuaternion(attitude);
+    WindowStats vertical = vertical_stats;
+    WindowStats rate = rate_stats;
+    vertical_stats.reset();
+    rate_stats.reset();
+    gps_fix fix = last_fix;
+    restore_interrupts(status);
 
-        printf("accel data: x:%f y:%f z:%f\n", x, y, z);
+    // fields that aren't part of the report of this phase are ignored by Comm
+    profile_mark start = Profiler::now();
+    comm.setField("phase", (uint8_t) flight_phase.getPhase());
+    comm.setField("time", (uint32_t) now);
+    comm.setField("t_state", report_time(state_us, now));
+    comm.setField("t_baro", report_time(pressure_us, now));
+    comm.setField("t_gps", report_time(fix.time_us, now));
+    comm.setField("t_tx", report_time(tx_us, now));
+    comm.setField("t_rx", report_time(rx_us, now));
+    comm.setField("max_accel", max_accel);
+    comm.setField("pressure", pressure);
+    comm.setField("altitude", altitude);
+    comm.setField("vspeed", vspeed);
+    comm.setField("attitude", pack_quaternion(attitude));
+    comm.setField("vacc_min", vertical.getMin());
+    comm.setField("vacc_max", vertical.getMax());
+    comm.setField("vacc_mean", vertical.getMean());
+    comm.setField("vacc_std", vertical.getStd());
+    comm.setField("rate_max", rate.getMax());
+    comm.setField("latitude", fix.latitude);
+    comm.setField("longitude", fix.longitude);
+    comm.setField("gps_alt", fix.altitude);
+    comm.setField("sats", (uint8_t) (fix.quality ? fix.satellites : 0));
+    profiler.record(PROFILE_SET_FIELDS, Profiler::cyclesSince(start));
 
-        sleep_ms(200);
+    ProfileScope scope(profiler, PROFILE_REPORT);
+    comm.setImplicitReports(implicit_saves_airtime() ? send_implicit : nullptr);
+    if (comm.sendReport() < 0) reports_refused++;
+    else reports_sent++;
+
+    // the profile, the report and the budget change, so the period follows them
+    uint32_t period = telemetry_period_us(flight_phase.getPhase());
+    if (period != telemetry_period)
+    {
+        telemetry_period = period;
+        processing.setPeriod(telemetry_task_id, period);
+    }
+}
+
+// core 1: the profile over the radio, as many sections per packet as fit, in turns
+void profile_stream_task()
+{
+    if (!profile_stream) return;
+
+    uint8_t block[250];
+    int room = std::min(comm.getDiagnosticsSize(), (int) sizeof(block));
+    int length = 0;
+
+    for (int i = 0; i < PROFILE_SECTIONS && length + PROFILE_RECORD <= room; i++)
+    {
+        ProfileStats stats = profiler.getStats(profile_next);
+        uint32_t values[4] = {stats.count, stats.min, stats.count ? (uint32_t) (stats.total / stats.count) : 0, stats.max};
+
+        block[length] = profile_next;
+        std::memcpy(block + length + 1, values, sizeof(values));
+        length += PROFILE_RECORD;
+        profile_next = (profile_next + 1) % PROFILE_SECTIONS;
     }
 
-    sleep_ms(2000);
-    printf("starting...\n");
+    if (length > 0) comm.sendDiagnostics(block, length);
+}
+
+void processing_stats_task()
+{
+    printf("core 1:\n");
+    processing.printStats();
+    trace(TRACE_QUEUE_DROPS, imu_queue.getDropped(), baro_queue.getDropped());
+    trace(TRACE_GPS_STATS, gps.isBinary(), gps.getMessages(), gps.getErrors(), gps_uart.getOverflows());
+    trace(TRACE_RECORDER_STATS, recorder.getSession(), recorder.getUsed(), recorder.getCapacity(), recorder.getWritten(),
+        recorder.getDropped(), recorder.isClearing());
+    trace(TRACE_REPORT_STATS, reports_sent, reports_refused, telemetry_period);
+}
+
+#ifdef BMP_BENCHMARK
+// Cycles per sample of the double and the integer compensation, measured with SysTick (24 bit, counts down)
+void bmp_benchmark(uint32_t uncomp_temp, uint32_t uncomp_press)
+{
+    systick_hw->rvr = 0x00FFFFFF;
+    systick_hw->cvr = 0;
+    systick_hw->csr = 0x5; // enabled, processor clock
+
+    volatile double d;
+    volatile uint32_t i;
+
+    uint32_t start = systick_hw->cvr;
+    d = compensate_temperature(uncomp_temp);
+    d = compensate_pressure(uncomp_press);
+    uint32_t double_cycles = (start - systick_hw->cvr) & 0x00FFFFFF;
+
+    start = systick_hw->cvr;
+    i = compensate_temperature_int(uncomp_temp);
+    i = compensate_pressure_int(uncomp_press);
+    uint32_t int_cycles = (start - systick_hw->cvr) & 0x00FFFFFF;
+
+    printf("compensation cycles/sample: double %lu, integer %lu\n", double_cycles, int_cycles);
+}
+#endif
+
+#ifdef AHRS_BENCHMARK
+// Cycles of one attitude update with and without the accelerometer correction, measured with SysTick (24 bit, counts down).
+// SysTick belongs to the core, so this runs on core 1 like the AHRS
+void ahrs_benchmark()
+{
+    systick_hw->rvr = 0x00FFFFFF;
+    systick_hw->cvr = 0;
+    systick_hw->csr = 0x5; // enabled, processor clock
+
+    Mahony bench;
+    const float gyro[3] = {0.1f, -0.2f, 0.3f};
+    const float rest[3] = {0.05f, 0.02f, 0.99f};
+    const float boost[3] = {0.1f, 0.0f, 6.0f};
+
+    uint32_t start = systick_hw->cvr;
+    bench.update(gyro, rest, 0.002f);
+    uint32_t corrected = (start - systick_hw->cvr) & 0x00FFFFFF;
+
+    start = systick_hw->cvr;
+    bench.update(gyro, boost, 0.002f);
+    uint32_t uncorrected = (start - systick_hw->cvr) & 0x00FFFFFF;
+
+    printf("AHRS cycles/update: %lu, without accelerometer correction %lu\n", corrected, uncorrected);
+}
+#endif
+
+// Core 1: radio, Comm and everything computed from the samples
+void core1_main()
+{
+    // the radio is only used from this core, its interrupt is enabled here by receive()
+    Profiler::beginCore();
+
+#ifdef AHRS_BENCHMARK
+    ahrs_benchmark();
+#endif
 
-    printf("initializing comms interface...\n");
-    // Create interface and set transmit function
-    Comm comm(send);
-    
     printf("Initializing LoRa...\n");
     // Initialize lora
     while (!LoRa.begin(868E6))
     {   
         printf("LoRa initialization failed, retrying...\n");
-        sleep_ms(1000);
+        sleep_ms(RADIO_RETRY_MS);
     }
 
-    // Create fields
-    comm.addField<int>("example_int");
-    comm.addField<unsigned long long>("example_ull"); // Any primitive can be used basically
-    comm.addField<std::string>("string_example", 8); // Please use std::string for string types. It is also necessary to set a maximum length
+    // Both ends start on the most robust profile, the ground station steps it up from there.
+    // After a warm reset it is still on the profile from before
+    apply_profile(warm_boot ? warm.profile : ADR_DEFAULT_PROFILE);
+    comm.setProfile(current_profile);
+    comm.onProfileChange(on_profile_change);
+    LoRa.onReceive(on_receive);
 
-    printf("sending packet structure...  \n");
-    // Sends packet metadata to the receiver
-    comm.sendStructure();
+    // stay within the EU868 1% duty cycle
+    LoRa.setDutyCycle(&duty_cycle);
+    comm.setBudget(budget);
 
-    // Set field values
-    comm.setField("example_int", 16);
-    comm.setField("example_ull", (unsigned long long)42069); // Always make sure that it is specifically the type that has been set as the field type
+    // other teams share the band, wait for a free channel before transmitting
+    LoRa.setListenBeforeTalk(LBT_ATTEMPTS);
+
+    // the UART interrupt has to be on this core, with the GPS task. The receiver wasn't reset with a warm reset,
+    // so it isn't configured again, which would take about a second
+    printf("configuring GPS...\n");
+    if (warm_boot) gps.resume(PIN_GPS_TX, PIN_GPS_RX, warm.gpsBinary);
+    else if (!gps.begin(PIN_GPS_TX, PIN_GPS_RX)) trace(TRACE_GPS_FALLBACK);
+
+    // the barometer calibration and the samples come from core 0, which brings up the sensors meanwhile
+    while (!sensors_ready) tight_loop_contents();
+
+    // the log continues after what is in the flash already, the first record makes the raw samples readable.
+    // Without the sensors there is nothing to record, but the reports and the GPS still help to find the satellite
+    if (sensors_failed) printf("no sensors, not recording\n");
+    else if (!log_flash.isFree()) printf("the program overlaps the flight log, not recording\n");
+    else
+    {
+        printf("flight log: %lu of %lu pages in use\n", recorder.begin(), recorder.getCapacity());
+
+        uint8_t config[2 + BMP_CALIB_SIZE] = {AFS_SEL, FS_SEL};
+        std::memcpy(config + 2, baro.getCalibration(), BMP_CALIB_SIZE);
+        recorder.append(LOG_CONFIG, config, sizeof(config));
+        recorder_ready = true;
+    }
+
+    if (warm_boot) resume_flight();
+    else
+    {
+        printf("sending packet structure...  \n");
+        build_report(phase_configs[PHASE_PAD].report);
+    }
+
+    processing.addTask("fusion", fusion_task, FUSION_PERIOD_US, 0, true);
+    processing.addTask("gps", gps_task, GPS_PERIOD_US, 0, true);
+    processing.addTask("radio", radio_task, RADIO_PERIOD_US);
+    telemetry_task_id = processing.addTask("telemetry", telemetry_task, phase_configs[flight_phase.getPhase()].telemetryPeriodUs);
+    processing.addTask("phase", phase_task, PHASE_PERIOD_US);
+    processing.addTask("recorder", recorder_task, RECORDER_PERIOD_US);
+    processing.addTask("console", console_task, CONSOLE_PERIOD_US);
+    processing.addTask("profile", profile_stream_task, PROFILE_STREAM_PERIOD_US);
+    processing.addTask("stats", processing_stats_task, STATS_PERIOD_US);
+    processing.addTask("trace", trace_task, TRACE_PERIOD_US);
 
     printf("transmitting data... \n");
-    // Sends field values
-    comm.sendReport();
-}
\ No newline at end of file
+    if (!processing.begin())
+    {
+        printf("no free hardware alarm\n");
+        return;
+    }
+    processing.run();
+}
+
+// core 0 gives up on the sensors, core 1 must not wait for them
+int sensors_fail(const char* message)
+{
+    printf("%s\n", message);
+    sensors_failed = true;
+    sensors_ready = true;
+    return 1;
+}
+
+int main() {
+    stdio_init_all();
+    trace_begin();
+
+    // a reset in flight continues the flight, if the calibration from the pad is in flash. On the ground the
+    // satellite is at rest, so it starts over
+    warm_boot = warm_state_load(warm) && warm.phase != PHASE_PAD && warm.phase != PHASE_LANDED &&
+        boot_cache_load(&boot_flash, cache) && cache.afsSel == AFS_SEL && cache.fsSel == FS_SEL;
+
+    if (!warm_boot)
+    {
+        absolute_time_t timeout = make_timeout_time_ms(USB_WAIT_MS);
+        while (!stdio_usb_connected() && absolute_time_diff_us(get_absolute_time(), timeout) > 0) sleep_ms(10);
+        printf("starting...\n");
+    }
+    else trace(TRACE_WARM_RESET, warm.phase);
+
+    // core 1 brings up the radio and the GPS while this core does the sensors.
+    // It writes the flight log, this core has to wait in RAM meanwhile
+    multicore_lockout_victim_init();
+    multicore_launch_core1(core1_main);
+
+    i2c_init(i2c0, 400000);
+
+    gpio_set_function(PIN_SDA, GPIO_FUNC_I2C);
+    gpio_set_function(PIN_SCL, GPIO_FUNC_I2C);
+
+    // Make the I2C pins available to picotool
+    bi_decl(bi_2pins_with_func(PIN_SDA, PIN_SCL, GPIO_FUNC_I2C));
+
+    printf("initializing BMP390...\n");
+    if (!baro.begin(warm_boot ? cache.bmpCalib : nullptr)) return sensors_fail("failed to get calibration data");
+
+#ifdef BMP_BENCHMARK
+    bmp_benchmark(8400000, 7000000);
+#endif
+
+    printf("enabling readings...\n");
+    if (!baro.configure(BARO_OSR_PRESS, BARO_OSR_TEMP, BARO_IIR, BARO_ODR) || !baro.beginFifo()) return sensors_fail("invalid BMP390 configuration");
+
+    // accel and gyro at 1 kHz into the FIFO of the MPU6500
+    if (!imu.begin(AFS_SEL, FS_SEL) || !imu.beginFifo(PIN_MPU_INT)) printf("MPU6500 not found\n");
+
+    // from here on the sensors are only read in the background, with DMA, on this core
+    if (!i2c_queue.begin()) return sensors_fail("no free DMA channels");
+    imu.drainAsync(&i2c_queue, on_imu_samples);
+    baro.drainAsync(&i2c_queue, on_baro_frames);
+    sensors_ready = true;
+
+    acquisition.addTask("baro", baro_task, BARO_PERIOD_US, 0, true);
+    acquisition.addTask("stats", acquisition_stats_task, STATS_PERIOD_US);
+
+    if (!acquisition.begin())
+    {
+        printf("no free hardware alarm\n");
+        return 1;
+    }
+    acquisition.run();
+}
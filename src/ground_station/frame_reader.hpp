@@ -0,0 +1,118 @@
+#pragma once
+/*
+    Frames of log_dump.hpp in the bytes from the USB serial port of the satellite, shared by the tools that read them
+*/
+#include <log_dump.hpp>
+#include <boost/asio.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+struct Frame {
+    uint8_t type;
+    uint32_t first;
+    std::vector<uint8_t> payload;
+};
+
+inline uint32_t get32(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+// Finds the frames in the bytes from the serial port, skipping the text printed in between
+class FrameReader {
+public:
+    FrameReader(boost::asio::io_context& io, boost::asio::serial_port& serial) : io(io), serial(serial) {}
+
+    // Returns false if no valid frame arrived within the timeout
+    bool next(Frame& frame, std::chrono::milliseconds timeout)
+    {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+
+        for (;;)
+        {
+            if (parse(frame)) return true;
+
+            auto left = deadline - std::chrono::steady_clock::now();
+            if (left <= std::chrono::milliseconds(0)) return false;
+            if (!receive(std::chrono::duration_cast<std::chrono::milliseconds>(left))) return false;
+        }
+    }
+
+    // Throws away everything until nothing arrives for a while
+    void drain(std::chrono::milliseconds quiet)
+    {
+        while (receive(quiet)) {}
+        buffer.clear();
+    }
+
+    uint32_t getCorrupted() { return corrupted; }
+    uint64_t getReceived() { return received; }
+
+private:
+    bool receive(std::chrono::milliseconds timeout)
+    {
+        uint8_t chunk[8192];
+        size_t length = 0;
+        bool done = false;
+
+        serial.async_read_some(boost::asio::buffer(chunk), [&](const boost::system::error_code& ec, size_t n) {
+            length = ec ? 0 : n;
+            done = true;
+        });
+
+        io.restart();
+        io.run_for(timeout);
+        if (!done)
+        {
+            serial.cancel();
+            io.restart();
+            io.run();
+        }
+
+        buffer.insert(buffer.end(), chunk, chunk + length);
+        received += length;
+        return length > 0;
+    }
+
+    bool parse(Frame& frame)
+    {
+        for (;;)
+        {
+            // the magic, anything before it is text
+            size_t start = 0;
+            while (start + 4 <= buffer.size() && get32(&buffer[start]) != DUMP_MAGIC) start++;
+            buffer.erase(buffer.begin(), buffer.begin() + std::min(start, buffer.size() >= 3 ? buffer.size() - 3 : 0));
+            if (buffer.size() < DUMP_HEADER) return false;
+
+            size_t length = buffer[6] | (buffer[7] << 8);
+            if (length > DUMP_MAX_PAYLOAD)
+            {
+                buffer.erase(buffer.begin());
+                corrupted++;
+                continue;
+            }
+            if (buffer.size() < DUMP_HEADER + length + DUMP_TRAILER) return false;
+
+            if (crc32(buffer.data(), DUMP_HEADER + length) != get32(&buffer[DUMP_HEADER + length]))
+            {
+                buffer.erase(buffer.begin());
+                corrupted++;
+                continue;
+            }
+
+            frame.type = buffer[4];
+            frame.first = get32(&buffer[8]);
+            frame.payload.assign(buffer.begin() + DUMP_HEADER, buffer.begin() + DUMP_HEADER + length);
+            buffer.erase(buffer.begin(), buffer.begin() + DUMP_HEADER + length + DUMP_TRAILER);
+            return true;
+        }
+    }
+
+    boost::asio::io_context& io;
+    boost::asio::serial_port& serial;
+    std::vector<uint8_t> buffer;
+    uint32_t corrupted = 0;
+    uint64_t received = 0;
+};
@@ -0,0 +1,177 @@
+/*
+    Copies the flight log of the satellite into a file over USB, and checks what it got.
+    Every chunk of the log comes with a CRC, broken or missing chunks are asked for again, and a dump that
+    was interrupted continues where the file ends. The satellite has to be on the pad or landed.
+
+    build: g++ -std=c++17 -O2 -I../../rp2040_main/include log_dump.cpp ../../rp2040_main/include/log_dump.cpp ../../rp2040_main/include/recorder.cpp -lpthread -o log_dump
+    usage: ./log_dump /dev/ttyACM0 flight.log
+*/
+#include <log_dump.hpp>
+#include <recorder.hpp>
+#include "frame_reader.hpp"
+#include <boost/asio.hpp>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <vector>
+
+using namespace std;
+using namespace boost;
+
+#define FRAME_TIMEOUT_MS 1000   // the satellite only looks at commands every 100 ms
+#define MAX_RETRIES 10
+
+void sendCommand(asio::serial_port& serial, const string& command)
+{
+    asio::write(serial, asio::buffer(command + "\n"));
+}
+
+// Reads the log back like the ground station would, and prints what is in it
+void summarize(const string& path)
+{
+    ifstream file(path, ios::binary);
+    vector<uint8_t> page(FLASH_PAGE_BYTES);
+    log_record records[64];
+    set<uint16_t> sessions;
+    uint32_t pages = 0, broken = 0, counts[8] = {0};
+
+    while (file.read((char*) page.data(), FLASH_PAGE_BYTES))
+    {
+        pages++;
+        int n = log_parse_page(page.data(), records, 64);
+        if (n <= 0)
+        {
+            broken++;
+            continue;
+        }
+
+        sessions.insert(page[2] | (page[3] << 8));
+        for (int i = 0; i < n; i++) counts[records[i].type < 8 ? records[i].type : 0]++;
+    }
+
+    cout << pages << " pages, " << sessions.size() << " sessions, " << broken << " broken pages\n";
+    cout << "records: " << counts[LOG_CONFIG] << " config, " << counts[LOG_IMU] << " imu, " << counts[LOG_BARO]
+         << " baro, " << counts[LOG_PHASE] << " phase, " << counts[LOG_GPS] << " gps, " << counts[LOG_RADIO] << " radio, "
+         << counts[0] << " other\n";
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        cerr << "usage: " << argv[0] << " <serial port> <output file>\n";
+        return 1;
+    }
+
+    asio::io_context io;
+    asio::serial_port serial(io);
+    try {
+        serial.open(argv[1]);
+    }
+    catch (const std::exception& e) {
+        cerr << "Error opening serial port: " << e.what() << endl;
+        return 1;
+    }
+
+    FrameReader reader(io, serial);
+    reader.drain(chrono::milliseconds(200));
+
+    Frame frame;
+    bool info = false;
+    for (int attempt = 0; attempt < MAX_RETRIES && !info; attempt++)
+    {
+        sendCommand(serial, "info");
+        while (reader.next(frame, chrono::milliseconds(FRAME_TIMEOUT_MS)))
+        {
+            if (frame.type == DUMP_INFO && frame.payload.size() >= 12)
+            {
+                info = true;
+                break;
+            }
+        }
+    }
+    if (!info)
+    {
+        cerr << "no answer from the satellite\n";
+        return 1;
+    }
+
+    uint32_t used = get32(&frame.payload[0]);
+    uint32_t capacity = get32(&frame.payload[4]);
+    uint16_t session = frame.payload[8] | (frame.payload[9] << 8);
+    cout << "log: " << used << " of " << capacity << " pages in use, session " << session << "\n";
+
+    // whole pages already in the file were checked when they were written, the dump continues after them.
+    // Unless the log was erased since, then the first page is different
+    uint32_t next = 0;
+    vector<uint8_t> firstPage(FLASH_PAGE_BYTES);
+    {
+        ifstream existing(argv[2], ios::binary);
+        if (existing.read((char*) firstPage.data(), FLASH_PAGE_BYTES))
+        {
+            existing.seekg(0, ios::end);
+            next = min((uint32_t) (existing.tellg() / FLASH_PAGE_BYTES), used);
+        }
+    }
+    if (next > 0)
+    {
+        bool same = false;
+        sendCommand(serial, "dump 0 1");
+        while (reader.next(frame, chrono::milliseconds(FRAME_TIMEOUT_MS)) && frame.type != DUMP_END)
+        {
+            if (frame.type == DUMP_PAGES && frame.first == 0) same = frame.payload == firstPage;
+        }
+        if (same) cout << "continuing after page " << next << "\n";
+        else next = 0;
+    }
+
+    fstream file(argv[2], ios::binary | ios::in | ios::out);
+    if (!file) file.open(argv[2], ios::binary | ios::out | ios::trunc);
+    file.seekp((streamoff) next * FLASH_PAGE_BYTES);
+
+    auto start = chrono::steady_clock::now();
+    uint32_t resumed = next;
+    int retries = 0;
+
+    while (next < used && retries < MAX_RETRIES)
+    {
+        sendCommand(serial, "dump " + to_string(next) + " " + to_string(used - next));
+
+        bool progress = false;
+        bool ended = false;
+        while (!ended && reader.next(frame, chrono::milliseconds(FRAME_TIMEOUT_MS)))
+        {
+            if (frame.type == DUMP_END) ended = true;
+            if (frame.type != DUMP_PAGES) continue;
+
+            // a chunk after one that was lost is thrown away, it is asked for again with the lost one
+            if (frame.first != next || frame.payload.size() % FLASH_PAGE_BYTES) continue;
+
+            file.write((const char*) frame.payload.data(), frame.payload.size());
+            next += frame.payload.size() / FLASH_PAGE_BYTES;
+            progress = true;
+
+            if (next % 512 < DUMP_CHUNK_PAGES) cout << "\r" << next << "/" << used << " pages" << flush;
+        }
+
+        if (!ended) reader.drain(chrono::milliseconds(200));
+        retries = progress ? 0 : retries + 1;
+    }
+    file.close();
+    filesystem::resize_file(argv[2], (uintmax_t) next * FLASH_PAGE_BYTES);
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "\r" << next << "/" << used << " pages, " << (next - resumed) * FLASH_PAGE_BYTES / 1024.0 / seconds
+         << " kB/s, " << reader.getCorrupted() << " corrupted frames\n";
+
+    if (next < used)
+    {
+        cerr << "the satellite stopped answering, run again to continue\n";
+        return 1;
+    }
+
+    summarize(argv[2]);
+    return 0;
+}
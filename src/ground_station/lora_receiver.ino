@@ -1,26 +1,85 @@
 #include <LoRa.h>
 
+/*
+    Bridges the LoRa module to the USB serial port, usb_receiver.cpp does everything else.
+    Every packet is printed as "packet received:<hex> <rssi> <snr>", and these lines are taken as commands:
+        send <hex>                transmits a packet
+        profile <sf> <bw> <cr>    changes the modem settings, they have to match the satellite (adrProfiles in adr.cpp)
+        frame <size>              receives fixed size frames without a PHY header, or with a header when the size is 0
+*/
+
+String command = "";
+int frameSize = 0;
+
 void setup()
 {
     Serial.begin(115200);
-    while(!Serial);
-    
-    if (!LoRa.begin(915E6)) {
+    while (!Serial);
+
+    if (!LoRa.begin(868E6)) {
         Serial.println("failed to initialize LoRa.");
         while (1);
     }
-    
+}
 
+void printHex(uint8_t b)
+{
+    const char digits[] = "0123456789ABCDEF";
+    Serial.print(digits[b >> 4]);
+    Serial.print(digits[b & 0x0F]);
 }
-void loop() {}
 
-void callback(int size) {
-    String packetHex = "";
+uint8_t fromHex(char c)
+{
+    return c <= '9' ? c - '0' : (c & ~0x20) - 'A' + 10;
+}
+
+void handleCommand(const String& line)
+{
+    if (line.startsWith("send "))
+    {
+        LoRa.beginPacket();
+        for (unsigned i = 5; i + 1 < line.length(); i += 2) LoRa.write(fromHex(line[i]) << 4 | fromHex(line[i + 1]));
+        LoRa.endPacket();
+    }
+    else if (line.startsWith("profile "))
+    {
+        long sf, bw, cr;
+        if (sscanf(line.c_str() + 8, "%ld %ld %ld", &sf, &bw, &cr) != 3) return;
+
+        LoRa.setSpreadingFactor(sf);
+        LoRa.setSignalBandwidth(bw);
+        LoRa.setCodingRate4(cr);
+    }
+    else if (line.startsWith("frame "))
+    {
+        frameSize = line.substring(6).toInt();
+    }
+}
 
-    for (int i = 0; i < size; i++)
+void loop()
+{
+    int size = LoRa.parsePacket(frameSize);
+    if (size > 0)
     {
-        packetHex += String((char) LoRa.read(), HEX)
+        Serial.print("packet received:");
+        while (LoRa.available()) printHex(LoRa.read());
+
+        Serial.print(' ');
+        Serial.print(LoRa.packetRssi());
+        Serial.print(' ');
+        Serial.println(LoRa.packetSnr());
     }
 
-    Serial.println("received packet:" + packetHex);
-}
\ No newline at end of file
+    // commands from usb_receiver, one per line
+    while (Serial.available())
+    {
+        char c = Serial.read();
+        if (c == '\n')
+        {
+            handleCommand(command);
+            command = "";
+        }
+        else if (c != '\r') command += c;
+    }
+}
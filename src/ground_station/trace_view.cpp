@@ -0,0 +1,174 @@
+/*
+    Prints the binary trace of the satellite (rp2040_main/include/trace.hpp) as text, formatted with the table in
+    trace_messages.hpp. The firmware has to be built from the same table, the ids are only numbers.
+    Each line starts with the time of the board in seconds, text printed by the firmware is skipped.
+
+    build: g++ -std=c++17 -O2 -I../../rp2040_main/include trace_view.cpp ../../rp2040_main/include/log_dump.cpp -lpthread -o trace_view
+    usage: ./trace_view /dev/ttyACM0
+*/
+#include <log_dump.hpp>
+#include <trace.hpp>
+#include "frame_reader.hpp"
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+using namespace std;
+using namespace boost;
+
+#define TIME_RESET_US 1000000
+
+const char* const trace_formats[TRACE_COUNT] = {
+#define TRACE_FORMAT(id, format) format,
+    TRACE_MESSAGES(TRACE_FORMAT)
+#undef TRACE_FORMAT
+};
+
+// Formats the arguments of a record like printf on the board would have
+string format(const char* fmt, const uint8_t* args, int length)
+{
+    string out;
+    int used = 0;
+    char text[64];
+
+    for (const char* p = fmt; *p; p++)
+    {
+        if (*p != '%')
+        {
+            out += *p;
+            continue;
+        }
+        if (p[1] == '%')
+        {
+            out += '%';
+            p++;
+            continue;
+        }
+
+        // flags, width and precision are passed on, the length is what the board used
+        string spec = "%";
+        p++;
+        while (*p && strchr("-+ #0123456789.", *p)) spec += *p++;
+
+        int longs = 0;
+        while (*p && strchr("hlzjt", *p)) if (*p++ == 'l') longs++;
+
+        char conversion = *p;
+        if (!conversion) break;
+
+        bool wide = longs >= 2;
+        int size = wide ? 8 : 4;
+        if (used + size > length)
+        {
+            out += "<missing>";
+            continue;
+        }
+
+        const uint8_t* arg = args + used;
+        used += size;
+
+        if (strchr("fFeEgGaA", conversion))
+        {
+            float value;
+            memcpy(&value, arg, 4);
+            snprintf(text, sizeof(text), (spec + conversion).c_str(), (double) value);
+        }
+        else if (strchr("di", conversion))
+        {
+            if (wide)
+            {
+                int64_t value;
+                memcpy(&value, arg, 8);
+                snprintf(text, sizeof(text), (spec + "ll" + conversion).c_str(), (long long) value);
+            }
+            else
+            {
+                int32_t value;
+                memcpy(&value, arg, 4);
+                snprintf(text, sizeof(text), (spec + conversion).c_str(), (int) value);
+            }
+        }
+        else if (strchr("uxXoc", conversion))
+        {
+            if (wide)
+            {
+                uint64_t value;
+                memcpy(&value, arg, 8);
+                snprintf(text, sizeof(text), (spec + "ll" + conversion).c_str(), (unsigned long long) value);
+            }
+            else
+            {
+                uint32_t value;
+                memcpy(&value, arg, 4);
+                snprintf(text, sizeof(text), (spec + conversion).c_str(), (unsigned) value);
+            }
+        }
+        else snprintf(text, sizeof(text), "<%%%c?>", conversion);
+
+        out += text;
+    }
+
+    if (used < length) out += " <" + to_string(length - used) + " more bytes>";
+    return out;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        cerr << "usage: " << argv[0] << " <serial port>\n";
+        return 1;
+    }
+
+    asio::io_context io;
+    asio::serial_port serial(io);
+    try {
+        serial.open(argv[1]);
+    }
+    catch (const std::exception& e) {
+        cerr << "Error opening serial port: " << e.what() << endl;
+        return 1;
+    }
+
+    FrameReader reader(io, serial);
+    Frame frame;
+
+    // the board has a 32 bit us clock, it is extended here
+    int64_t time = 0;
+    uint32_t last = 0, dropped = 0;
+    bool first = true;
+
+    for (;;)
+    {
+        if (!reader.next(frame, chrono::milliseconds(1000)) || frame.type != DUMP_TRACE) continue;
+
+        if (frame.first < dropped) dropped = 0; // the board was reset
+        if (frame.first > dropped) printf("... %u records dropped, the trace buffer was full\n", frame.first - dropped);
+        dropped = frame.first;
+
+        const uint8_t* p = frame.payload.data();
+        const uint8_t* end = p + frame.payload.size();
+        while (end - p >= TRACE_HEADER)
+        {
+            uint8_t id = p[0], length = p[1];
+            uint32_t now = get32(p + 2);
+            if (end - p < TRACE_HEADER + length) break;
+
+            // the records of the two cores can be a few us out of order, a big step back is a reset of the board
+            int32_t step = now - last;
+            time = first || step < -TIME_RESET_US ? now : time + step;
+            last = now;
+            first = false;
+
+            if (id < TRACE_COUNT)
+                printf("%12.6f %s\n", time / 1e6, format(trace_formats[id], p + TRACE_HEADER, length).c_str());
+            else printf("%12.6f unknown message %u, built from another trace_messages.hpp?\n", time / 1e6, id);
+
+            p += TRACE_HEADER + length;
+        }
+        fflush(stdout);
+    }
+}
@@ -1,7 +1,20 @@
+/*
+    Ground station: decodes the reports that lora_receiver.ino prints, and runs the adaptive data rate controller,
+    which sends profile changes and keep-alives to the satellite through the same sketch.
+
+    build: g++ -std=c++17 -O2 -I../../rp2040_main/include usb_receiver.cpp ../../rp2040_main/include/adr.cpp ../../rp2040_main/include/airtime.cpp ../../rp2040_main/include/duty_cycle.cpp -lpthread -o usb_receiver
+*/
 #include <comm.hpp>
+#include <adr.hpp>
+#include <duty_cycle.hpp>
+#include <flight_phase.hpp>
 #include <boost/asio.hpp>
+#include <chrono>
+#include <climits>
+#include <cstdio>
 #include <iostream>
 #include <stdexcept>
+#include <thread>
 
 using namespace std;
 using namespace boost;
@@ -35,27 +48,62 @@ string readFromSerialPort(asio::serial_port& serial)
     return string(buffer, len);
 }
 
-string readLine(asio::serial_port& serial)
-{
-    string line = "";
-    for (;;)
+// Lines from the serial port, with a timeout, so the keep-alives go out while nothing arrives
+class LineReader {
+public:
+    LineReader(asio::io_context& io, asio::serial_port& serial) : io(io), serial(serial) {}
+
+    // Returns false if no whole line arrived within the timeout
+    bool next(string& line, chrono::milliseconds timeout)
     {
-        char c;
-        system::error_code ec;
-        // Read data from the serial port
-        size_t len
-            = asio::read(serial, asio::buffer(&c, 1), ec);
-        if (ec) {
-            cerr << "Error reading from serial port: "
-                << ec.message() << endl;
-            return "";
+        auto deadline = chrono::steady_clock::now() + timeout;
+
+        for (;;)
+        {
+            size_t end = buffer.find('\n');
+            if (end != string::npos)
+            {
+                line = buffer.substr(0, end);
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                buffer.erase(0, end + 1);
+                return true;
+            }
+
+            auto left = deadline - chrono::steady_clock::now();
+            if (left <= chrono::milliseconds(0)) return false;
+            if (!receive(chrono::duration_cast<chrono::milliseconds>(left))) return false;
         }
-        // Return the read data as a string
-        if (c == '\n') return line;
-        line.append(string(&c, 1));
     }
 
-}
+private:
+    bool receive(chrono::milliseconds timeout)
+    {
+        char chunk[1024];
+        size_t length = 0;
+        bool done = false;
+
+        serial.async_read_some(asio::buffer(chunk), [&](const system::error_code& ec, size_t n) {
+            length = ec ? 0 : n;
+            done = true;
+        });
+
+        io.restart();
+        io.run_for(timeout);
+        if (!done)
+        {
+            serial.cancel();
+            io.restart();
+            io.run();
+        }
+
+        buffer.append(chunk, length);
+        return length > 0;
+    }
+
+    asio::io_context& io;
+    asio::serial_port& serial;
+    string buffer;
+};
 
 // Function to write data to the serial port
 void writeToSerialPort(asio::serial_port& serial,
@@ -70,11 +118,93 @@ void writeToSerialPort(asio::serial_port& serial,
     }
 }
 
+// Timing of the reports. The satellite stamps every report with its own clock ("time", us), and everything in it
+// relative to that (see REPORT_TIME_UNIT_US in rp2040_main.cpp). The clocks of both ends don't agree, but the smallest
+// difference between when a report was made and when it arrived is the fastest delivery, anything above it is jitter
+struct ReportTiming {
+    uint64_t satelliteUs = 0;   // "time", with its wraps counted
+    uint32_t lastTime = 0;
+    int64_t fastest = LLONG_MAX;
+};
+
+void printTiming(Comm& comm, ReportTiming& timing)
+{
+    uint32_t time = comm.getField<uint32_t>("time");
+    if (time < timing.lastTime) timing.satelliteUs += 1ull << 32;
+    timing.satelliteUs = (timing.satelliteUs & ~0xFFFFFFFFull) | time;
+    timing.lastTime = time;
+
+    int64_t arrived = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    int64_t delay = arrived - (int64_t) timing.satelliteUs;
+    timing.fastest = min(timing.fastest, delay);
+
+    // the end of the previous transmission on the satellite, and how long before the report it was made
+    cout << "report at " << timing.satelliteUs * 1e-6 << " s, jitter " << (delay - timing.fastest) * 1e-3 << " ms, "
+         << "last packet sent " << comm.getField<int16_t>("t_tx") * 0.1 << " ms before, state "
+         << comm.getField<int16_t>("t_state") * 0.1 << " ms old\n";
+}
+
+// Cycle counts of the firmware, sent with "profile stream on" (see PROFILE_RECORD in rp2040_main.cpp)
+void printProfile(uint8_t* data, int size)
+{
+    for (int i = 0; i + 17 <= size; i += 17)
+    {
+        uint32_t values[4];
+        memcpy(values, data + i + 1, sizeof(values));
+        cout << "profile section " << (int) data[i] << ": " << values[0] << " runs, cycles min " << values[1]
+             << " mean " << values[2] << " max " << values[3] << "\n";
+    }
+}
+
+// Uplink through lora_receiver.ino, within the duty cycle of the ground station
+asio::serial_port* port = nullptr;
+DutyCycle duty_cycle;
+AdaptiveRate adr;
+
+uint64_t nowUs()
+{
+    return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int send(uint8_t* data, int size)
+{
+    uint32_t airtime = time_on_air_us(adr_modem(adr.getProfile()), size);
+    if (!duty_cycle.allow(nowUs(), airtime)) return -1;
+    duty_cycle.record(nowUs(), airtime);
+
+    char hex[3];
+    string line = "send ";
+    for (int i = 0; i < size; i++)
+    {
+        snprintf(hex, sizeof(hex), "%02X", data[i]);
+        line += hex;
+    }
+    writeToSerialPort(*port, line + "\n");
+    return 0;
+}
+
+// both ends switch together, the sketch is reconfigured and the controller starts a new window
+void onProfileChange(uint8_t profile)
+{
+    const RadioProfile& p = adrProfiles[profile];
+    writeToSerialPort(*port, "profile " + to_string(p.sf) + " " + to_string(p.bw) + " " + to_string(p.cr) + "\n");
+    adr.setProfile(profile);
+
+    cout << "radio profile " << (int) profile << ": SF" << p.sf << "/" << p.bw / 1000 << "k\n";
+}
+
+// reports of this size come without a PHY header, Comm acknowledges it to the satellite
+void onFrameChange(int size)
+{
+    writeToSerialPort(*port, "frame " + to_string(size) + "\n");
+}
+
 int main()
 {
     asio::io_context io; // Create an IO service
     // Create a serial port object
     asio::serial_port serial(io);
+    port = &serial;
 
 
     try {
@@ -88,8 +218,24 @@ int main()
         return 1;
     }
 
-    Comm comm(nullptr);
+    // opening the port resets most Arduino boards, then both ends start on the default profile
+    this_thread::sleep_for(chrono::seconds(2));
+    onProfileChange(ADR_DEFAULT_PROFILE);
+
+    Comm comm(send);
     uint8_t buff[255];
+    ReportTiming timing;
+    comm.onDiagnostics(printProfile);
+    comm.onProfileChange(onProfileChange);
+    comm.onFrameChange(onFrameChange);
+
+    LineReader reader(io, serial);
+    auto lastKeepalive = chrono::steady_clock::now();
+    auto lastHeard = chrono::steady_clock::now();
+
+    // the satellite keeps ADR_FLIGHT_PROFILE in the fast part of the flight, this end does the same from the reports
+    int phase = PHASE_PAD;
+    auto flightStart = chrono::steady_clock::now();
 
     cout << "Waiting for sync packet...";
 
@@ -97,36 +243,74 @@ int main()
 
     for(;;)
     {   
-        // packet is read from usb serial as hex encoded bytes in strings
-        string d = readLine(serial);
-        if (d.compare("packet received:") == 0)
+        // packet is read from usb serial as hex encoded bytes, followed by its RSSI and SNR
+        string d;
+        bool got = reader.next(d, chrono::milliseconds(100));
+        auto now = chrono::steady_clock::now();
+        bool pinned = adr_pinned(phase, chrono::duration_cast<chrono::milliseconds>(now - flightStart).count());
+
+        if (got && d.rfind("packet received:", 0) == 0)
         {
             d = d.substr(16);
-            
-            for (int i = 0; i < d.length() / 2; i++)
-            {    
+            size_t hexEnd = min(d.find(' '), d.length());
+            int size = min<int>(hexEnd / 2, sizeof(buff));
+
+            for (int i = 0; i < size; i++)
+            {
                 char c1 = d.at(2*i);
                 char c2 = d.at(2*i+1);
-                
-                // First character: lower 4 bits
-                if (c1 <= '9') {
-                    buff[i] = c1 - '0';
-                } else {
-                    buff[i] = c1 - 'A' + 10;
-                }
-                
-                // 2nd character: higher 4 bits
-                if (c2 <= '9') {
-                    buff[i] |= 16 * (c2 - '0');
-                } else {
-                    buff[i] |= 16 * (c2 - 'A' + 10);
-                }
 
+                // First character: higher 4 bits
+                buff[i] = 16 * (c1 <= '9' ? c1 - '0' : c1 - 'A' + 10);
+
+                // 2nd character: lower 4 bits
+                buff[i] |= c2 <= '9' ? c2 - '0' : c2 - 'A' + 10;
             }
 
-            comm.receiverCallback(buff, d.length() / 2);
+            int rssi = 0;
+            float snr = 0;
+            sscanf(d.c_str() + hexEnd, "%d %f", &rssi, &snr);
+
+            lastHeard = now;
+            comm.receiverCallback(buff, size);
+
+            // every report carries the phase, the flight starts with the first one that keeps the profile
+            if (comm.getSynced())
+            {
+                int reported = comm.getField<uint8_t>("phase");
+                if (adr_pinned(reported, 0) && !adr_pinned(phase, 0)) flightStart = now;
+                phase = reported;
+                pinned = adr_pinned(phase, chrono::duration_cast<chrono::milliseconds>(now - flightStart).count());
+            }
+
+            // the link statistics of Comm go into the controller's window, profile changes are applied by onProfileChange()
+            if (!pinned)
+            {
+                adr.addPacket(snr);
+                adr.addLoss(comm.getReceivedPackets(), comm.getLostPackets());
+
+                int next = adr.decide();
+                if (next >= 0 && comm.sendProfile(next) == 0) lastKeepalive = now;
+            }
+            comm.resetLinkStats();
         }
-        
+
+        // the current profile again, so the satellite knows the link is up, and the frame size it has to send reports with
+        if (now - lastKeepalive > chrono::milliseconds(adr_keepalive_ms(comm.getProfile())) &&
+            comm.sendProfile(comm.getProfile(), 1) == 0)
+        {
+            comm.acknowledgeFrame();
+            lastKeepalive = now;
+        }
+
+        // the satellite falls back after the same time without keep-alives, but not in the fast part of the flight
+        if (!pinned && now - lastHeard > chrono::milliseconds(adr_link_timeout_ms(comm.getProfile())))
+        {
+            comm.setProfile(ADR_DEFAULT_PROFILE);
+            lastHeard = now;
+        }
+
+
         // this is useful if you have a receiver-transmitter configuration
         // this will check if a sync packet packet has arrived
         if (comm.getSynced())
@@ -140,6 +324,8 @@ int main()
 
                 /* Write code here */
 
+                printTiming(comm, timing);
+
                 // random examples
                 cout << "temperature: " << comm.getField<float>("temp") << " C\n";
                 cout << "GPS coords: " << comm.getField<std::string>("GPS") << "\n";